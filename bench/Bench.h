@@ -0,0 +1,139 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#ifndef BENCHH
+#define BENCHH
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "HisDrr.h"
+#include "Debug.h"
+
+/**
+ * Common part of the benchmarks (bench_micro, bench_macro). Each case is
+ * run a number of times, results are printed one per line, as
+ *
+ * name reps mean_s var_s2 min_s bins_per_s bytes_per_s
+ *
+ * mean_s, var_s2 and min_s being mean, variance and the shortest of
+ * single run times, and throughputs computed from the mean time
+ * (0 if not applicable). Lines starting with '#' are comments.
+ */
+namespace bench {
+    /** Prints header line of results. */
+    inline void printHeader(std::ostream& out) {
+        out << "#name reps mean_s var_s2 min_s bins_per_s bytes_per_s"
+            << std::endl;
+    }
+
+    /** Histograms of the benchmark file created by createFile. */
+    enum {
+        /** 1D, 2 bytes, spectrum1D channels. */
+        spectrum = 1,
+        /** 2D, 2 bytes, side x side. */
+        matrixShort = 2,
+        /** 2D, 4 bytes, side x side. */
+        matrixInt = 3,
+        /** Ids of small 1D histograms (1024 channels) start here. */
+        small = 100
+    };
+
+    /** Number of channels of the spectrum. */
+    const unsigned spectrum1D = 16384;
+
+    /** Returns pseudo-random numbers, deterministic (LCG). */
+    class Random {
+        public:
+            Random(unsigned long seed) : state_(seed) {}
+            unsigned next() {
+                state_ = state_ * 6364136223846793005ul
+                         + 1442695040888963407ul;
+                return state_ >> 33;
+            }
+        private:
+            unsigned long state_;
+    };
+
+    /** Creates baseName.his and .drr with the histograms listed above
+     * and nSmall small ones. Matrices have counts in about 1/4 of
+     * bins. */
+    inline void createFile(const std::string& baseName, unsigned side,
+                           unsigned nSmall) {
+        std::string input = baseName + ".inp";
+        std::ofstream def(input.c_str());
+        def << "# id halfwords x y title" << std::endl;
+        def << spectrum << " 1 " << spectrum1D << " 0 bench spectrum"
+            << std::endl;
+        def << matrixShort << " 1 " << side << " " << side
+            << " bench matrix short" << std::endl;
+        def << matrixInt << " 2 " << side << " " << side
+            << " bench matrix int" << std::endl;
+        for (unsigned i = 0; i < nSmall; ++i)
+            def << small + i << " 1 1024 0 bench small" << std::endl;
+        def.close();
+
+        HisDrr hisDrr(baseName + ".drr", baseName + ".his", input);
+        Random random(12345);
+
+        std::vector<unsigned short> data1(spectrum1D);
+        for (unsigned i = 0; i < data1.size(); ++i)
+            data1[i] = random.next() % 1000;
+        hisDrr.setValue(spectrum, data1);
+
+        std::vector<unsigned short> data2(side * side);
+        std::vector<unsigned> data4(side * side);
+        for (unsigned i = 0; i < data4.size(); ++i) {
+            unsigned r = random.next();
+            data2[i] = (r % 4 == 0) ? r % 300 : 0;
+            data4[i] = (r % 4 == 1) ? r % 100000 : 0;
+        }
+        hisDrr.setValue(matrixShort, data2);
+        hisDrr.setValue(matrixInt, data4);
+        std::remove(input.c_str());
+    }
+
+    /** Runs f reps times (after one warm-up run), and prints result
+     * line for case name processing bins channels of bytes bytes in
+     * each run. */
+    template <typename F>
+    void run(const std::string& name, unsigned reps,
+             double bins, double bytes, F f) {
+        f();
+        std::vector<double> times(reps);
+        for (unsigned r = 0; r < reps; ++r) {
+            debug::Timer start;
+            f();
+            debug::Timer stop;
+            times[r] = (stop - start) / 1.0e6;
+        }
+
+        double mean = 0;
+        double min = times[0];
+        for (unsigned r = 0; r < reps; ++r) {
+            mean += times[r];
+            if (times[r] < min)
+                min = times[r];
+        }
+        mean /= reps;
+        double variance = 0;
+        for (unsigned r = 0; r < reps; ++r)
+            variance += (times[r] - mean) * (times[r] - mean);
+        if (reps > 1)
+            variance /= reps - 1;
+
+        // Timer resolution is 1 us, runs below it count as 1 us
+        double t = (mean > 1.0e-6) ? mean : 1.0e-6;
+        std::cout << name << " " << reps << " " << mean << " "
+                  << variance << " " << min << " "
+                  << bins / t << " " << bytes / t << std::endl;
+    }
+}
+
+#endif
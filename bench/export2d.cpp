@@ -0,0 +1,107 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+/**
+ * Scaling benchmark of 2D text export. Creates a 4096 x 4096 matrix
+ * (bench2d.his, bench2d.drr) and times 'readhis -i 1 --threads n' with
+ * output to /dev/null for n = 1, 2, 4, ... up to the number of cores
+ * (at least 4). Time of '--stats' (loading only, no export) is given
+ * for reference.
+ *
+ * Usage: bench_export2d [readhis binary (./readhis)] [repetitions (3)]
+ */
+
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "HisDrr.h"
+#include "Exceptions.h"
+#include "Debug.h"
+
+using namespace std;
+
+/** Size of the matrix. */
+const unsigned nBin = 4096;
+
+/** Creates the matrix with counts in about 3/4 of bins. */
+void createMatrix(const string& baseName) {
+    string input = baseName + ".inp";
+    ofstream def(input.c_str());
+    def << "# id halfwords x y title" << endl;
+    def << "1 2 " << nBin << " " << nBin << " bench matrix" << endl;
+    def.close();
+
+    HisDrr hisDrr(baseName + ".drr", baseName + ".his", input);
+    vector<unsigned> data(nBin * nBin);
+    unsigned long state = 12345;
+    for (unsigned i = 0; i < data.size(); ++i) {
+        state = state * 6364136223846793005ul + 1442695040888963407ul;
+        unsigned r = state >> 33;
+        data[i] = (r % 4 == 0) ? 0 : r % 300;
+    }
+    hisDrr.setValue(1, data);
+    remove(input.c_str());
+}
+
+/** Returns best time in s of reps runs of command. */
+double bestTime(const string& command, unsigned reps) {
+    double best = -1;
+    for (unsigned r = 0; r < reps; ++r) {
+        debug::Timer start;
+        if (system(command.c_str()) != 0)
+            throw GenError("Command failed: " + command);
+        debug::Timer stop;
+        double t = (stop - start) / 1.0e6;
+        if (best < 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    string readhis = (argc > 1) ? argv[1] : "./readhis";
+    unsigned reps = (argc > 2) ? atoi(argv[2]) : 3;
+    string baseName = "bench2d";
+
+    try {
+        createMatrix(baseName);
+
+        string base = readhis + " -i 1 " + baseName + ".his";
+        double load = bestTime(base + " --stats > /dev/null", reps);
+
+        unsigned cores = thread::hardware_concurrency();
+        unsigned maxThreads = (cores > 4) ? cores : 4;
+        cout << "# 2D text export of " << nBin << " x " << nBin
+             << " matrix, " << cores << " cores, best of " << reps << endl;
+        cout << "# load and --stats: " << load << " s" << endl;
+        cout << "#threads  time[s]  export[s]  speedup" << endl;
+
+        double single = 0;
+        for (unsigned n = 1; n <= maxThreads; n *= 2) {
+            stringstream command;
+            command << base << " --threads " << n << " > /dev/null";
+            double t = bestTime(command.str(), reps);
+            double exportTime = t - load;
+            if (n == 1)
+                single = exportTime;
+            cout << n << " " << t << " " << exportTime << " "
+                 << single / exportTime << endl;
+        }
+    } catch (GenError &err) {
+        cout << "Error: " << err.show() << endl;
+        return 1;
+    }
+
+    remove((baseName + ".his").c_str());
+    remove((baseName + ".drr").c_str());
+    return 0;
+}
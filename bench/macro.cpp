@@ -0,0 +1,104 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+/**
+ * Macrobenchmarks of the readhis program: each output mode is timed as
+ * a whole run of readhis (start, reading of files, processing and
+ * output to /dev/null). The file (bench_macro.his, bench_macro.drr) is
+ * created first, see bench::createFile, and removed at the end. Results
+ * are printed in the format described in Bench.h, throughput is given
+ * in bins and bytes of the histogram in the his file.
+ *
+ * Usage: bench_macro [readhis binary (./readhis)] [side of matrix (2048)]
+ *                    [repetitions (5)]
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "Bench.h"
+#include "Exceptions.h"
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+    string readhis = (argc > 1) ? argv[1] : "./readhis";
+    unsigned side = (argc > 2) ? atoi(argv[2]) : 2048;
+    unsigned reps = (argc > 3) ? atoi(argv[3]) : 5;
+    string baseName = "bench_macro";
+    string his = baseName + ".his";
+    string polygon = baseName + ".pol";
+    const unsigned nSmall = 100;
+
+    try {
+        bench::createFile(baseName, side, nSmall);
+        ofstream pol(polygon.c_str());
+        pol << "# bench polygon" << endl
+            << side / 8 << " " << side / 4 << endl
+            << side / 2 << " " << side / 8 << endl
+            << 7 * side / 8 << " " << 3 * side / 4 << endl
+            << side / 4 << " " << 7 * side / 8 << endl;
+        pol.close();
+
+        double nBin1 = bench::spectrum1D;
+        double nBin2 = double(side) * side;
+        double nAll = nBin1 + 3 * nBin2 + 1024.0 * nSmall;
+        double bytesAll = 2 * nBin1 + 6 * nBin2 + 2048.0 * nSmall;
+
+        stringstream gate;
+        gate << side / 4 << "," << 3 * side / 4 - 1;
+
+        struct Case {
+            string name;
+            string args;
+            double bins;
+            double bytes;
+        };
+        string m2 = " -i 2";
+        string m4 = " -i 3";
+        Case cases[] = {
+            {"list", " -l", nAll, 0},
+            {"list-scan", " -L", nAll, bytesAll},
+            {"text-1D", " -i 1", nBin1, 2 * nBin1},
+            {"raw-1D", " -i 1 --format raw", nBin1, 2 * nBin1},
+            {"stats-2D", m4 + " --stats", nBin2, 4 * nBin2},
+            {"text-2D-2byte", m2, nBin2, 2 * nBin2},
+            {"text-2D-4byte", m4, nBin2, 4 * nBin2},
+            {"text-2D-zero", m4 + " --zero", nBin2, 4 * nBin2},
+            {"raw-2D", m4 + " --format raw", nBin2, 4 * nBin2},
+            {"gnuplot-2D", m4 + " --format gnuplot-matrix", nBin2, 4 * nBin2},
+            {"bin-2D", m4 + " --bin 4,4", nBin2, 4 * nBin2},
+            {"gx-2D", m4 + " --gx " + gate.str(), nBin2, 4 * nBin2},
+            {"gy-2D", m4 + " --gy " + gate.str(), nBin2, 4 * nBin2},
+            {"crop-2D", m4 + " --gx " + gate.str() + " --gy " + gate.str(),
+             nBin2, 4 * nBin2},
+            {"polygon-2D", m4 + " --gx " + polygon, nBin2, 4 * nBin2},
+            {"autocrop-2D", m4 + " --autocrop", nBin2, 4 * nBin2},
+        };
+
+        cout << "# Macrobenchmarks of " << readhis << ", " << side << " x "
+             << side << " matrices" << endl;
+        bench::printHeader(cout);
+        for (const Case& c : cases) {
+            string command = readhis + c.args + " " + his +
+                             " > /dev/null 2>&1";
+            bench::run(c.name, reps, c.bins, c.bytes, [&] () {
+                if (system(command.c_str()) != 0)
+                    throw GenError("Command failed: " + command);
+            });
+        }
+    } catch (GenError &err) {
+        cout << "Error: " << err.show() << endl;
+        return 1;
+    }
+
+    remove(his.c_str());
+    remove((baseName + ".drr").c_str());
+    remove(polygon.c_str());
+    return 0;
+}
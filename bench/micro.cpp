@@ -0,0 +1,178 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+/**
+ * Microbenchmarks of the library: reading of drr and his files, loading
+ * data into histograms and operations on them, each timed in-process.
+ * The file (bench_micro.his, bench_micro.drr) is created first, see
+ * bench::createFile, and removed at the end. Results are printed in the
+ * format described in Bench.h. Throughput of operations on histograms
+ * is given in bytes of their data in memory (8 bytes per bin).
+ *
+ * Usage: bench_micro [side of matrix (2048)] [repetitions (10)]
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+#include "Bench.h"
+#include "HisDrr.h"
+#include "Histogram.h"
+#include "Polygon.h"
+#include "Exceptions.h"
+
+using namespace std;
+
+/** Returns size of file in bytes. */
+double fileSize(const string& name) {
+    struct stat st;
+    if (stat(name.c_str(), &st) != 0)
+        throw IOError("Could not stat " + name);
+    return st.st_size;
+}
+
+/** Returns polygon of n vertices inscribed in ellipse centered in the
+ * middle of side x side matrix. */
+Polygon ellipse(unsigned side, unsigned n) {
+    vector<Point> vertices;
+    for (unsigned i = 0; i < n; ++i) {
+        double phi = 2 * M_PI * i / n;
+        vertices.push_back(Point(side * (0.5 + 0.4 * cos(phi)),
+                                 side * (0.5 + 0.25 * sin(phi))));
+    }
+    return Polygon(vertices);
+}
+
+int main(int argc, char* argv[]) {
+    unsigned side = (argc > 1) ? atoi(argv[1]) : 2048;
+    unsigned reps = (argc > 2) ? atoi(argv[2]) : 10;
+    string baseName = "bench_micro";
+    string drr = baseName + ".drr";
+    string his = baseName + ".his";
+    const unsigned nSmall = 500;
+
+    try {
+        bench::createFile(baseName, side, nSmall);
+        double nBin2 = double(side) * side;
+        double nBin1 = bench::spectrum1D;
+        double nHis = nSmall + 3;
+
+        cout << "# Microbenchmarks, " << side << " x " << side
+             << " matrices, " << nHis << " histograms" << endl;
+        bench::printHeader(cout);
+
+        bench::run("loadDrr", reps, nHis, fileSize(drr), [&] () {
+            HisDrr hisDrr(drr, his);
+        });
+
+        HisDrr hisDrr(drr, his);
+        vector<unsigned> data1, data2, data4;
+        bench::run("getHistogram-2byte", reps, nBin2, 2 * nBin2, [&] () {
+            hisDrr.getHistogram(data2, bench::matrixShort);
+        });
+        bench::run("getHistogram-4byte", reps, nBin2, 4 * nBin2, [&] () {
+            hisDrr.getHistogram(data4, bench::matrixInt);
+        });
+        hisDrr.getHistogram(data1, bench::spectrum);
+
+        Histogram1D h1(0, nBin1, nBin1, "");
+        Histogram2D h2(0, side, 0, side, side, side, "");
+        bench::run("setDataRaw-1D", reps, nBin1, 8 * nBin1, [&] () {
+            h1.setDataRaw(data1);
+        });
+        bench::run("setDataRaw-2D", reps, nBin2, 8 * nBin2, [&] () {
+            h2.setDataRaw(data4);
+        });
+
+        bench::run("rebin-1D-integer", reps, nBin1, 8 * nBin1, [&] () {
+            unique_ptr<Histogram1D> r =
+                h1.rebinUnique(0, nBin1, unsigned(nBin1 / 4));
+        });
+        bench::run("rebin-1D-fraction", reps, nBin1, 8 * nBin1, [&] () {
+            unique_ptr<Histogram1D> r =
+                h1.rebinUnique(0.5, nBin1 - 0.5, unsigned(nBin1 / 3));
+        });
+        bench::run("rebin-2D-integer", reps, nBin2, 8 * nBin2, [&] () {
+            unique_ptr<Histogram2D> r =
+                h2.rebinUnique(0, side, 0, side, side / 4, side / 4);
+        });
+        bench::run("rebin-2D-fraction", reps, nBin2, 8 * nBin2, [&] () {
+            unique_ptr<Histogram2D> r =
+                h2.rebinUnique(0, side, 0, side, side / 3, side / 3);
+        });
+
+        // Gates cover half of the matrix
+        double gateBins = nBin2 / 2;
+        bench::run("gateX", reps, gateBins, 8 * gateBins, [&] () {
+            unique_ptr<Histogram1D> p =
+                h2.gateXUnique(side / 4, 3 * side / 4 - 1);
+        });
+        bench::run("gateY", reps, gateBins, 8 * gateBins, [&] () {
+            unique_ptr<Histogram1D> p =
+                h2.gateYUnique(side / 4, 3 * side / 4 - 1);
+        });
+
+        // Gate on X of polygon, as in readhis --gx polygon.txt
+        Polygon polygon = ellipse(side, 64);
+        PolygonMask mask;
+        bench::run("polygon-rasterize", reps, nBin2, 0, [&] () {
+            polygon.rasterize(0, 1, 0, side, 0, 1, 0, side, mask);
+        });
+        bench::run("polygon-project", reps, nBin2, 8 * nBin2, [&] () {
+            Histogram1D proj(0, side, side, "");
+            for (unsigned y = mask.y0; y < mask.y1; ++y) {
+                unsigned r = y - mask.y0;
+                for (unsigned k = mask.rowStart[r];
+                     k < mask.rowStart[r + 1]; ++k) {
+                    long sum = 0;
+                    for (unsigned x = mask.begin[k]; x < mask.end[k]; ++x)
+                        sum += h2(x, y);
+                    proj.add(y, sum);
+                }
+            }
+        });
+        bench::run("polygon-pointIn", 1, nBin2, 8 * nBin2, [&] () {
+            Histogram1D proj(0, side, side, "");
+            for (unsigned y = 0; y < side; ++y)
+                for (unsigned x = 0; x < side; ++x)
+                    if (polygon.pointIn(h2.getX(x), h2.getY(y)))
+                        proj.add(y, h2(x, y));
+        });
+
+        bench::run("transpose-square", reps, nBin2, 8 * nBin2, [&] () {
+            h2.transpose();
+        });
+        Histogram2D hr(0, side, 0, side / 2, side, side / 2, "");
+        bench::run("transpose-rectangle", reps, nBin2 / 2, 4 * nBin2, [&] () {
+            hr.transpose();
+        });
+
+        Histogram2D other(h2);
+        bench::run("add-2D", reps, nBin2, 16 * nBin2, [&] () {
+            h2 += other;
+        });
+        bench::run("subtract-2D", reps, nBin2, 16 * nBin2, [&] () {
+            h2 -= other;
+        });
+        bench::run("multiply-2D", reps, nBin2, 8 * nBin2, [&] () {
+            Histogram2D r = h2 * 3;
+        });
+        bench::run("add-1D", reps, nBin1, 16 * nBin1, [&] () {
+            Histogram1D r = h1 + h1;
+        });
+    } catch (GenError &err) {
+        cout << "Error: " << err.show() << endl;
+        return 1;
+    }
+
+    remove(his.c_str());
+    remove(drr.c_str());
+    return 0;
+}
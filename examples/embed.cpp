@@ -0,0 +1,93 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+/**
+ * Example of using libreadhis from a program: lists histograms of a
+ * his file, then loads histogram id and prints its sum and mean. For 2D
+ * histograms the projection on Y of the gate on X from x0 to x1 is
+ * summed, and if a polygon file is given, also counts inside polygon.
+ *
+ * Usage: embed_example file.his id [x0 x1 [polygon.txt]]
+ *
+ * Build (after make install):
+ *   g++ embed.cpp $(pkg-config --cflags --libs readhis) -o embed_example
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "readhis.h"
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        cout << "Usage: " << argv[0]
+             << " file.his id [x0 x1 [polygon.txt]]" << endl;
+        return 1;
+    }
+    string fileName(argv[1]);
+    int id = atoi(argv[2]);
+    string baseName = fileName.substr(0, fileName.find_last_of("."));
+
+    try {
+        HisDrr hisDrr(baseName + ".drr", baseName + ".his");
+
+        vector<int> list;
+        hisDrr.getHisList(list);
+        cout << "# " << list.size() << " histograms:";
+        for (unsigned i = 0; i < list.size(); ++i)
+            cout << " " << list[i];
+        cout << endl;
+
+        DrrHisRecordExtended info = hisDrr.getHistogramInfo(id);
+        vector<unsigned> data;
+        hisDrr.getHistogram(data, id);
+
+        if (info.hisDim == 1) {
+            // maxc + 1: drr gives number of the last channel
+            Histogram1D h1(info.minc[0], info.maxc[0] + 1,
+                           info.scaled[0], "");
+            h1.setDataRaw(data);
+            HistogramStatistics stats = h1.statistics();
+            cout << "sum " << stats.sum << " mean " << stats.mean[0] << endl;
+        } else if (info.hisDim == 2) {
+            Histogram2D h2(info.minc[0], info.maxc[0] + 1,
+                           info.minc[1], info.maxc[1] + 1,
+                           info.scaled[0], info.scaled[1], "");
+            h2.setDataRaw(data);
+            HistogramStatistics stats = h2.statistics();
+            cout << "sum " << stats.sum << " mean " << stats.mean[0]
+                 << " " << stats.mean[1] << endl;
+
+            if (argc > 4) {
+                unique_ptr<Histogram1D> proj =
+                    h2.gateXUnique(atof(argv[3]), atof(argv[4]));
+                cout << "gate on X sum " << proj->getSum() << endl;
+            }
+
+            if (argc > 5) {
+                Polygon polygon((string(argv[5])));
+                long inside = 0;
+                for (unsigned iy = 0; iy < h2.getnBinY(); ++iy)
+                    for (unsigned ix = 0; ix < h2.getnBinX(); ++ix)
+                        if (polygon.pointIn(h2.getX(ix), h2.getY(iy)))
+                            inside += h2.get(ix, iy);
+                cout << "polygon sum " << inside << endl;
+            }
+        } else {
+            cout << "histogram of " << info.hisDim << " dimensions, "
+                 << data.size() << " channels" << endl;
+        }
+    } catch (GenError &err) {
+        cout << "Error: " << err.show() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#ifndef BINARYWRITERH
+#define BINARYWRITERH
+
+#include <iostream>
+#include <vector>
+#include "Histogram.h"
+#include "SparseHistogram.h"
+
+/**
+ * Binary output of histograms (--format), written from the histogram
+ * buffers without text formatting.
+ *
+ * Raw format (all numbers little-endian):
+ *
+ * char[4] "RHIS", uint32 dimension (1 or 2), uint32 nBinX, uint32 nBinY
+ * (1 for 1D), double xMin, xMax, yMin, yMax (0 for 1D), followed by
+ * nBinX * nBinY int64 counts, X running fastest.
+ *
+ * Projections with background subtracted (--bg, --sbg, backgrounds of
+ * gate file) carry their uncertainties: in raw format they are written
+ * as 1D histogram with nBinY = 2, the second row holding variances of
+ * the counts (int64, dN squared); in gnuplot matrix format as a second
+ * row at y = 1 holding dN.
+ *
+ * Gnuplot matrix format is the gnuplot 'binary matrix' (float32,
+ * native byte order): first row holds number of X bins and middles of
+ * X bins, each next row middle of Y bin and counts of the bins of that
+ * row. 1D histogram is written as a single row at y = 0. Use e.g.
+ * "plot 'file' binary matrix with image".
+ *
+ * Several histograms (e.g. gate file) are written one after another.
+ */
+class BinaryWriter {
+    public:
+        /** C'tor, output goes to out. */
+        BinaryWriter(std::ostream& out = std::cout);
+
+        /** Writes histogram in raw format. */
+        void raw(const Histogram1D& h1);
+        void raw(const Histogram2D& h2);
+        void raw(const SparseHistogram2D& h2);
+
+        /** Writes projection and variances of its counts in raw
+         * format. */
+        void raw(const Histogram1D& h1, const Histogram1D& variance);
+
+        /** Writes histogram in gnuplot matrix format. */
+        void matrix(const Histogram1D& h1);
+        void matrix(const Histogram2D& h2);
+        void matrix(const SparseHistogram2D& h2);
+
+        /** Writes projection and uncertainties of its counts (square
+         * roots of variance) in gnuplot matrix format. */
+        void matrix(const Histogram1D& h1, const Histogram1D& variance);
+
+    private:
+        /** Writes raw format header. */
+        void rawHeader(unsigned dim, unsigned nBinX, unsigned nBinY,
+                       double xMin, double xMax, double yMin, double yMax);
+
+        /** Writes n counts as int64 little-endian. */
+        void putCounts(const long* v, unsigned long n);
+
+        /** Writes values as uint32 or double little-endian. */
+        void putLE(unsigned v);
+        void putLE(double v);
+
+        /** Writes first row of gnuplot matrix (number of columns and
+         * their X middles). */
+        void matrixHeader(const Histogram& h);
+
+        /** Writes one row of gnuplot matrix. */
+        void matrixRow(float y, const long* v, unsigned n);
+
+        /** Writes n bytes, throws IOError on failure. */
+        void put(const void* data, unsigned long n);
+
+        /** Output stream. */
+        std::ostream& out_;
+
+        /** True on little-endian machines, data is then written
+         * without conversion. */
+        bool littleEndian_;
+
+        /** Conversion buffer. */
+        std::vector<unsigned char> bytes_;
+
+        /** Row buffer of gnuplot matrix. */
+        std::vector<float> row_;
+};
+
+#endif
@@ -8,8 +8,6 @@
 #ifndef DRRBLOCK_H
 #define DRRBLOCK_H
 
-using namespace std;
-
 /**
  * A drr file header structure. The drr files start with a header. The struct itself is of 84 bytes lenght
  * but it is followed by 44 bytes of garbage (leftovers from previous file?)
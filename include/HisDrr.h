@@ -12,7 +12,6 @@
 #include <string>
 #include <fstream>
 #include "DrrBlock.h" 
-using namespace std;
 
 /**
  * This structure is used for creating new his and drr files.
@@ -30,7 +29,21 @@ struct SimpleDrrBlock {
     short scaled[2];
 
     /** Histogram title.*/
-    string title;
+    std::string title;
+};
+
+/**
+ * Summary of histogram data, see HisDrr::scanHistograms.
+ */
+struct HisSummary {
+    /** True if all channels are zero. */
+    bool empty;
+
+    /** Number of non-zero channels. */
+    unsigned long nonZero;
+
+    /** Sum of all channels. */
+    unsigned long long sum;
 };
 
 /**
@@ -49,13 +62,14 @@ public:
      * This (bad) behaviour is forced by second and third version of c'tor where
      * file names are passed, and fstreams are opened by HisDrr, not by 
      * user. Probably it should be changed (in a future).*/
-    HisDrr(fstream* drr, fstream* his);
+    HisDrr(std::fstream* drr, std::fstream* his);
 
     /** Constructor taking file names and opening fstreams. */
-    HisDrr(const string &drr, const string &his);
+    HisDrr(const std::string &drr, const std::string &his);
 
     /** Constructor creating and opening new his and drr using definition from input file. */
-    HisDrr(const string &drr, const string &his, const string &input);
+    HisDrr(const std::string &drr, const std::string &his,
+           const std::string &input);
 
     /** Dtor, closing files and deleting memory. */
     virtual ~HisDrr() {
@@ -66,13 +80,25 @@ public:
             }
 
     /** Returns specified histogram data. */
-    virtual void getHistogram(vector<unsigned int> &rtn, int id);
+    virtual void getHistogram(std::vector<unsigned int> &rtn, int id);
+
+    /** Reads data of specified histogram directly to rtn, buffer of
+     * n channels, n must be at least the size of histogram. */
+    virtual void getHistogram(unsigned int* rtn, unsigned long n, int id);
 
     /** Returns drr data on specified histogram. */
     virtual DrrHisRecordExtended getHistogramInfo(int id) const;
 
     /** Returns histograms id's list. */
-    virtual void getHisList(vector<int> &r);
+    virtual void getHisList(std::vector<int> &r);
+
+    /** Scans data of histograms ids directly in the his file, without
+     * decoding them into vectors; summary[i] is filled for ids[i].
+     * Histograms are shared by nThreads threads, each reading the file
+     * with its own stream. */
+    virtual void scanHistograms(const std::vector<int> &ids,
+                                std::vector<HisSummary> &summary,
+                                unsigned nThreads = 1);
 
     /** Zeroes data for a given histogram. */
     virtual void zeroHistogram(int id);
@@ -84,20 +110,35 @@ public:
     virtual void setValue(const int id, unsigned pos, unsigned short value);
 
     /** Replaces histogram id values by ones given in a vector. The 4-bytes long word version.  */
-    virtual void setValue(const int id, vector<unsigned> &value);
+    virtual void setValue(const int id, std::vector<unsigned> &value);
 
     /** Replaces histogram id values by ones given in a vector. The 2-bytes long word version.  */
-    virtual void setValue(const int id, vector<unsigned short> &value);
+    virtual void setValue(const int id, std::vector<unsigned short> &value);
+
+    /** Limits number of histograms read from his files at the same time
+     * by all HisDrr objects (0 for no limit, default). */
+    static void setMaxReads(unsigned n);
 
 private:
     /** Vector holding all the histogram info read from drr file. */
-    vector<DrrHisRecordExtended> hisList;
+    std::vector<DrrHisRecordExtended> hisList;
 
     /** Pointer to drr file containing information about his structure. */
-    fstream* drrFile;
+    std::fstream* drrFile;
 
     /** Pointer to his file containg data. */
-    fstream* hisFile;
+    std::fstream* hisFile;
+
+    /** Name of his file (empty if fstreams were given by user). */
+    std::string hisName;
+
+    /** Returns index of histogram id in hisList, throws GenError if
+     * not found. */
+    unsigned findIndex(int id) const;
+
+    /** Reads data of histogram hisList[index] to rtn, buffer of n
+     * channels (see getHistogram). */
+    void readData(unsigned index, unsigned int* rtn, unsigned long n);
 
     /** Reads block of data from drr file. */
     void readBlock(drrBlock *block);
@@ -9,14 +9,31 @@
 #define HISDRRHISTO_H
 
 #include <string>
+#include <vector>
+#include <iostream>
 #include "DrrBlock.h"
 #include "HisDrr.h"
 #include "Histogram.h"
+#include "SparseHistogram.h"
+#include "Polygon.h"
 #include "Exceptions.h"
 #include "Options.h"
+#include "HisIndex.h"
 
 using namespace std;
 
+/**
+ * Gate read from a --gate-file line. If onY is true the gate is on X
+ * and projection is made on Y axis (as --gx), otherwise gate is on Y.
+ * Background holds limits of zero, one or two background windows.
+ */
+struct GateWindow {
+    bool onY;
+    double low;
+    double high;
+    vector<double> background;
+};
+
 /**
  * The main purpose of this class is to translate HisDrr data to Histogram,
  * perform operations accordinhgly to passed Options and print data to cout.
@@ -33,19 +50,35 @@ class HisDrrHisto : public HisDrr {
         /** Sets pointer to options.*/
         void setOptions(const Options* options);
 
-        /** Procceses his/drr files accordingly to Options. */
-        void process();
+        /** Sets stream for text output (including comments and error 
+         * messages), cout by default. */
+        void setOutput(std::ostream* out);
+
+        /** Sets stream for binary output formats (--format), cout by
+         * default. */
+        void setBinaryOutput(std::ostream* out);
+
+        /** Procceses his/drr files accordingly to Options. Errors are
+         * printed to the output, returns false if there was one. */
+        bool process();
         ~HisDrrHisto();
     private:
         /** Pointer to Options */
         const Options* options_;
 
-        /** Current histogram */
-        Histogram* histogram;
+        /** Stream for text output. */
+        std::ostream* out_;
+
+        /** Stream for binary output. */
+        std::ostream* binaryOutput_;
 
         /** Current histogram info*/
         DrrHisRecordExtended info;
 
+        /** Names of drr and his files (for the index). */
+        string drrName_;
+        string hisName_;
+
         /** Lists all histograms in his/drr file.
          *  more option true is more verbose output (marks histogram dimensions)
          *  and empty histograms.*/
@@ -54,24 +87,133 @@ class HisDrrHisto : public HisDrr {
         /** Prints all informations on current histogram */
         void runInfoMode();
 
+        /** Builds index file if it is missing or out of date (--index)
+         * and prints its contents. */
+        void runIndexMode();
+
+        /** Fills index with summary and statistics of all histograms. */
+        void buildIndex(HisIndex& index);
+
+        /** Prints --stats of current histogram from the index, if the
+         * index is valid and statistics of the whole histogram (no
+         * gates and binning) are requested. Returns false otherwise. */
+        bool indexStats();
+
         /** Sub part of process for 1D histograms */
         void process1D();
 
-        /** Sub part of process for 2D histograms */
+        /** Prints statistics (--stats) of dim dimensional histogram
+         * instead of its bins. FWHM is estimated from the variance
+         * assuming a single gaussian peak. */
+        void printStatistics(const HistogramStatistics& stats,
+                             unsigned short dim);
+
+        /** Prints 1D histogram to cout accordingly to options. */
+        void print1D(const Histogram1D& h1);
+
+        /** Sub part of process for 3D and 4D histograms. Gates given
+         * on any of axes, projection on one or two of the axes. */
+        void processND();
+
+        /** Sub part of process for 2D histograms. Chooses dense or
+         * sparse histogram depending on occupancy of the matrix. */
         void process2D();
 
-        /** Sub part of process2D, when gx XOR gy is used*/
-        void process2Dgate();
+        /** Sub part of process2D, selects one of the following
+         * accordingly to the gates used. H2 is Histogram2D or
+         * SparseHistogram2D. */
+        template <class H2>
+        void process2Dmode(H2* h2);
 
-        /** Sub part of process2D when --pg is used*/
-        void process2Dpolygate();
+        /** Sub part of process2D, when gx XOR gy is used*/
+        template <class H2>
+        void process2Dgate(H2* h2);
+
+        /** Sub part of process2D when --gate-file is used. Matrix is
+         * loaded once, all gates are projected in parallel threads and
+         * printed one after another (separated by two empty lines, so
+         * gnuplot can select them with 'index'). */
+        template <class H2>
+        void process2DgateFile(H2* h2);
+
+        /** Reads gates from file. Each line holds axis (x for gate on X,
+         * y for gate on Y), gate limits and optionally limits of one or
+         * two background windows e.g. 'x 266 269 272 275'. Text after
+         * '#' is a comment. */
+        void readGateFile(const string& fileName, vector<GateWindow>& gates);
+
+        /** Builds summed-area table, so each of many gates costs
+         * O(projection length).*/
+        void prepareGateFile(Histogram2D& h2);
+
+        /** Sparse matrices are gated directly. */
+        void prepareGateFile(SparseHistogram2D& h2);
+
+        /** Rebins (if requested), and prints gate projection with
+         * uncertainities calculated from variance (--gx, --gy and
+         * --gate-file output). Binary formats hold the uncertainties
+         * only if background was subtracted. */
+        void printGate(Histogram1D& proj, Histogram1D& projErr, bool gx,
+                       bool background);
+
+        /** Sub part of process2D when --pg is used. Several bananas of
+         * BAN file (filename,all or filename,id1:id2:...) are projected 
+         * in one sweep over the matrix and printed one after another
+         * (as for --gate-file). */
+        template <class H2>
+        void process2Dpolygate(H2* h2);
 
         /** Sub part of process2D when gx and gy is used */
-        void process2Dcrop();
+        template <class H2>
+        void process2Dcrop(H2* h2);
 
         /** Sub part of process2D when no gates are present */
-        void process2Dnogates();
+        template <class H2>
+        void process2Dnogates(H2* h2);
+
+        /** Sub part of process2D when no gates are present and
+         * --autocrop is used. Matrix is cropped to the box of non-empty
+         * bins (taken from the index if it is valid). */
+        template <class H2>
+        void process2Dautocrop(H2* h2);
+
+        /** Adds to proj[i] bins (x, y) of h2 within the polygon masks[i],
+         * each row interval is a contiguous range of bins. Rows are
+         * visited once, each one is gated by all masks in turn. */
+        void polygonProject(const Histogram2D& h2,
+                            const vector<PolygonMask>& masks, bool gx,
+                            vector<Histogram1D>& proj);
+
+        /** Sparse version of the above, only non-empty bins are visited.*/
+        void polygonProject(const SparseHistogram2D& h2,
+                            const vector<PolygonMask>& masks, bool gx,
+                            vector<Histogram1D>& proj);
+
+        /** Writes histogram to standard output in binary format if one
+         * is selected (--format), returns false for text output. */
+        template <class H>
+        bool printBinary(const H& h);
+
+        /** As above, for projection with variances of its counts. */
+        bool printBinary(const Histogram1D& h, const Histogram1D& variance);
+
+        /** Returns number of worker threads (--threads, or number of
+         * cores) for nTasks independent tasks, at least 1. */
+        unsigned workerThreads(unsigned nTasks) const;
+
+        /** Prints 2D histogram to cout accordingly to options. Columns
+         * of output (lines of the same X) are formatted in blocks by 
+         * worker threads. */
+        void print2D(const Histogram2D& h2);
+
+        /** Prints sparse 2D histogram, output is the same as for
+         * dense one. */
+        void print2D(const SparseHistogram2D& h2);
 };
 
 inline void HisDrrHisto::setOptions(const Options* options) { options_ = options; }
+inline void HisDrrHisto::setOutput(std::ostream* out) { out_ = out; }
+inline void HisDrrHisto::setBinaryOutput(std::ostream* out) {
+    binaryOutput_ = out;
+}
 #endif
@@ -0,0 +1,119 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#ifndef HISINDEXH
+#define HISINDEXH
+
+#include <string>
+#include <vector>
+#include "Histogram.h"
+
+/**
+ * Summary of one histogram held in the index, see HisIndex.
+ */
+struct IndexEntry {
+    /** Histogram id. */
+    int hisID;
+
+    /** Number of dimensions. */
+    unsigned short dim;
+
+    /** Number of counts. */
+    long sum;
+
+    /** Number of non-zero channels. */
+    unsigned long nonZero;
+
+    /** Smallest and largest number of counts in a channel. */
+    long min;
+    long max;
+
+    /** First and last non-zero channel along each axis (-1 if the
+     * histogram is empty). */
+    int boxLow[4];
+    int boxHigh[4];
+
+    /** Checksum (64 bit FNV-1a) of channels as stored in his file. */
+    unsigned long long checksum;
+
+    /** True if stats are given (1D and 2D histograms). */
+    bool hasStats;
+
+    /** Statistics of the whole histogram (as given by --stats). */
+    HistogramStatistics stats;
+};
+
+/**
+ * Sidecar index of his file (run.hidx next to run.his and run.drr),
+ * holding summary of each histogram, so that questions like 'is it
+ * empty' or 'what is the sum' are answered without reading the data.
+ *
+ * The index is a text file, first lines hold size and modification time
+ * of his and drr files. If any of them has changed the index is out of
+ * date and is not used.
+ */
+class HisIndex {
+    public:
+        /** C'tor, index of his file with description in drr file. */
+        HisIndex(const std::string& drr, const std::string& his);
+
+        /** Reads index file. Returns false if there is no index, it
+         * could not be read or it is out of date. */
+        bool load();
+
+        /** Writes index file (for current state of his and drr files),
+         * throws IOError on failure. */
+        void save() const;
+
+        /** Returns entry of histogram id (0 if not found). */
+        const IndexEntry* find(int id) const;
+
+        /** Adds entry (replaces entry of the same id). */
+        void add(const IndexEntry& entry);
+
+        /** Returns all entries in order of adding. */
+        const std::vector<IndexEntry>& getEntries() const;
+
+        /** Returns name of index file. */
+        const std::string& getFileName() const;
+
+        /** Fills entry (except hisID and stats) with summary of data of
+         * histogram with nBin channels along each axis, width is number
+         * of bytes per channel in his file. */
+        static void summarize(const std::vector<unsigned>& data,
+                              const std::vector<unsigned>& nBin,
+                              unsigned width, IndexEntry& entry);
+
+    private:
+        /** Size and modification time of a file. */
+        struct FileStamp {
+            unsigned long long size;
+            long long seconds;
+            long nanoseconds;
+        };
+
+        /** Gets stamp of file, returns false if file does not exist. */
+        static bool getStamp(const std::string& file, FileStamp& stamp);
+
+        /** Names of drr, his and index files. */
+        std::string drr_;
+        std::string his_;
+        std::string fileName_;
+
+        /** Entries by histogram. */
+        std::vector<IndexEntry> entries_;
+};
+
+inline const std::vector<IndexEntry>& HisIndex::getEntries() const {
+    return entries_;
+}
+
+inline const std::string& HisIndex::getFileName() const {
+    return fileName_;
+}
+
+#endif
@@ -9,6 +9,7 @@
 #define HISTOGRAM_H
 
 #include <vector>
+#include <memory>
 #include <iostream>
 #include <cstdlib>
 #include <string>
@@ -17,7 +18,32 @@
 #include "DrrBlock.h"
 #include "Exceptions.h"
 
-using namespace std;
+/**
+ * Statistics of counts in a range of bins, calculated by statistics()
+ * of histograms. Index 0 of arrays refers to X axis, 1 to Y axis (zero
+ * for 1D histograms). Positions are given in histogram coordinates
+ * (bins are represented by their middles).
+ */
+struct HistogramStatistics {
+    /** Number of counts. */
+    long sum;
+    /** Number of non-empty bins. */
+    unsigned long nonZero;
+    /** Smallest number of counts in a bin. */
+    long min;
+    /** Largest number of counts in a bin. */
+    long max;
+    /** Mean position (centroid), 0 if there are no counts. */
+    double mean[2];
+    /** Variance of position, 0 if there are no counts. */
+    double variance[2];
+    /** Low edge of the first non-empty bin (low edge of range if all
+     * bins are empty). */
+    double low[2];
+    /** High edge of the last non-empty bin (high edge of range if all
+     * bins are empty). */
+    double high[2];
+};
 
 /**
  *  General purpose base Histogram class.
@@ -29,7 +55,7 @@ class Histogram {
     public:
         /** Ctor. */
         Histogram  (double xMin,  double xMax,
-                    unsigned nBinX, string hisId);
+                    unsigned nBinX, std::string hisId);
 
         /**Number of Histogram dimensions is pure virtual.*/
         virtual unsigned short getDim() const = 0;
@@ -45,7 +71,7 @@ class Histogram {
         unsigned getnBinX() const;
 
         /** Returns hisId_ .*/
-        string gethisId() const; 
+        std::string gethisId() const; 
 
         /** Returns binWidthX_ */
         double getBinWidthX() const;
@@ -75,16 +101,16 @@ class Histogram {
         virtual long getSum () const;
 
         /** Returns raw data in form of vector. */
-        void getDataRaw (vector<long>& values) const;
+        virtual void getDataRaw (std::vector<long>& values) const;
 
         /** Sets vector of raw data to passed vector */
-        virtual void setDataRaw (const vector<long>& values);
+        virtual void setDataRaw (const std::vector<long>& values);
 
         /** Sets vector of raw data to passed vector. Casts int to long. */
-        virtual void setDataRaw (const vector<int>& values);
+        virtual void setDataRaw (const std::vector<int>& values);
         
         /** Sets vector of raw data to passed vector. Cast unsigned to long. */
-        virtual void setDataRaw (const vector<unsigned>& values);
+        virtual void setDataRaw (const std::vector<unsigned>& values);
 
         /** Sets vector of raw data to passed vector. Cast double to long 
          * using more sophisticated rounding:
@@ -93,11 +119,83 @@ class Histogram {
          * * number with floating point equal to .5 is rounded to
          *                                          nearest even integer
          * */
-        virtual void setDataRaw (const vector<double>& values);
+        virtual void setDataRaw (const std::vector<double>& values);
 
         virtual ~Histogram () {  }
 
     protected:
+        /** Copy ctor. */
+        Histogram (const Histogram&) = default;
+
+        /** Returns pointer to raw data (as getDataRaw, without a copy),
+         * valid until the histogram is changed. Made public only by
+         * classes holding dense data in values_. */
+        const long* getData () const;
+
+        /** Move ctor. Moved-from histogram may only be assigned to
+         * or destroyed. */
+        Histogram (Histogram&&) = default;
+
+        /** Copy assignment. */
+        Histogram& operator= (const Histogram&) = default;
+
+        /** Move assignment. */
+        Histogram& operator= (Histogram&&) = default;
+
+        /** Sums groups of factor adjacent elements of in (sz elements)
+         * into nOut elements of out. Element i goes to (i - offset) / factor,
+         * elements falling outside of out are added to under or over.
+         * The out array may be the same as in if offset >= 0 (new bin is
+         * never written before the old bins it is made of are read). */
+        static void sumBins (const long* in, long sz, long* out, long nOut,
+                             int factor, int offset,
+                             long& under, long& over);
+
+        /** Accumulates moments of n bins of v in a single pass: sum of
+         * counts, sums of counts times index (s1) and index squared (s2),
+         * min, max and number of non-empty bins. Index of first and last
+         * non-empty bin goes to first and last (first = n if none).
+         * Sums are added to (min and max compared with) passed values.
+         * The loop is split into four independent lanes, so it does not
+         * wait on a single chain of additions and can be vectorized. */
+        static void binMoments (const long* v, unsigned n,
+                                long& sum, double& s1, double& s2,
+                                long& min, long& max,
+                                unsigned long& nonZero,
+                                unsigned& first, unsigned& last);
+
+        /** Fills mean and variance of axis in stats from moments
+         * (in bins, about bin 0 of the range) and converts them to
+         * coordinates given low edge and bin width. */
+        static void momentsToStatistics (long sum, double s1, double s2,
+                                         double xLow, double binW,
+                                         double& mean, double& variance);
+
+        /** Called whenever values_ are replaced as a whole (setDataRaw),
+         * derived classes may drop data cached from values_. */
+        virtual void dataChanged () {  }
+
+        /** Rounds number of counts to long, as described in
+         * setDataRaw(const vector<double>&). */
+        static long roundCount (double value);
+
+        /** Returns true if ratio a / b is (within floating point precision)
+         * an integer number, which is then stored in n. */
+        static bool isIntegerRatio (double a, double b, int& n);
+
+        /** Calculates for one axis how the old bins (nOld bins of width
+         * oldW starting at oldMin) overlap with the new bins (width newW
+         * starting at newMin). Old bin i contributes weights[k] of its
+         * counts to the new bin bins[k] for k from first[i] to
+         * first[i + 1] - 1. New bin index may be negative or larger than
+         * the last bin (under- and overflow). The arithmetic follows the
+         * area-overlap method of Histogram1D::rebin. */
+        static void overlapWeights (double oldMin, double oldW, unsigned nOld,
+                                    double newMin, double newW,
+                                    std::vector<unsigned>& first,
+                                    std::vector<int>& bins,
+                                    std::vector<double>& weights);
+
         /** Lower edge of first bin. */
         double   xMin_;
 
@@ -108,7 +206,7 @@ class Histogram {
         unsigned nBinX_;
 
         /** Histogram name. */
-        string hisId_;
+        std::string hisId_;
 
         /** Any count that would to go bin lower then lowest goes here.
          * In case of 2 and more dimensions if at least in one dimension count 
@@ -124,15 +222,16 @@ class Histogram {
         double binWidthX_;
 
         /** Raw data for any number of dimensions. */
-        vector<long>   values_;
+        std::vector<long>   values_;
 };
 
 inline long     Histogram::getUnder () const { return underflow_; }
+inline const long* Histogram::getData () const { return values_.data(); }
 inline long     Histogram::getOver () const  { return overflow_; }
 inline double   Histogram::getxMin() const  { return xMin_; }
 inline double   Histogram::getxMax() const { return xMax_; }
 inline unsigned Histogram::getnBinX() const  { return nBinX_; }
-inline string   Histogram::gethisId() const { return hisId_; }
+inline std::string   Histogram::gethisId() const { return hisId_; }
 
 inline double   Histogram::getBinWidthX() const { return binWidthX_ ; }
 
@@ -153,7 +252,20 @@ class Histogram1D : public Histogram {
     public:
         /** Ctor */
         Histogram1D (double xMin,  double xMax,
-                     unsigned nBinX, string hisId);
+                     unsigned nBinX, std::string hisId);
+
+        /** Copy ctor. */
+        Histogram1D (const Histogram1D& right) = default;
+
+        /** Move ctor, takes over data of right. */
+        Histogram1D (Histogram1D&& right) = default;
+
+        /** See Histogram::getData. */
+        using Histogram::getData;
+
+        /** Changes range and number of bins, all bins, under- and
+         * overflow are set to 0. Memory already held is reused. */
+        void reset (double xMin, double xMax, unsigned nBinX);
 
         /** Overloaded pure virtual from base class. Returns 1.*/
         unsigned short getDim() const;
@@ -176,7 +288,10 @@ class Histogram1D : public Histogram {
          *  Expect +/- 1 count.
          *  Expect bad results especially when increasing number of bin
          *  when small number of counts are present (why would you increase
-         *  number of bins then anyway). */
+         *  number of bins then anyway).
+         *  If the new bin width is an integer multiple of the old one
+         *  (and bin edges are aligned) adjacent bins are simply summed,
+         *  and the number of counts is exact. */
         Histogram1D* rebin (double xMin, double xMax, unsigned nBinX) const;
 
         /** Returns rebinned histogram as above, however with the new 
@@ -187,9 +302,34 @@ class Histogram1D : public Histogram {
          */
         Histogram1D* rebin (double xMin, double xMax, double binW) const;
 
+        /** As rebin but the ownership is held by returned unique_ptr. */
+        std::unique_ptr<Histogram1D> rebinUnique (double xMin, double xMax,
+                                             unsigned nBinX) const;
+
+        /** As rebin but the ownership is held by returned unique_ptr. */
+        std::unique_ptr<Histogram1D> rebinUnique (double xMin, double xMax,
+                                             double binW) const;
+
+        /** Rebins this histogram, see rebin. For integer factors the bins
+         * are summed within the existing buffer, otherwise rebinned data
+         * is moved in, so no copy of the result is ever made. */
+        void rebinInPlace (double xMin, double xMax, unsigned nBinX);
+
+        /** "Width" version of rebinInPlace, see rebin. */
+        void rebinInPlace (double xMin, double xMax, double binW);
+
+        /** Returns statistics of bins from ix0 to ix1 (both inclusive).*/
+        HistogramStatistics statistics (unsigned ix0, unsigned ix1) const;
+
+        /** Returns statistics of the whole histogram. */
+        HistogramStatistics statistics () const;
+
         /** lhs lstogram will be overwritten by rhs. */
         virtual Histogram1D& operator=(const Histogram1D&);
 
+        /** lhs histogram takes over data of rhs. */
+        virtual Histogram1D& operator=(Histogram1D&&);
+
         /** All elements of histogram will be multiplied by right integer. */
         virtual Histogram1D& operator*=(int right); 
 
@@ -202,15 +342,24 @@ class Histogram1D : public Histogram {
         virtual Histogram1D& operator-=(const Histogram1D& right); 
 
         /** Returns histogram where all elements of histogram are multiplied by right. */
-        virtual const Histogram1D operator*(int right) const;
+        virtual Histogram1D operator*(int right) const &;
+
+        /** As above, but temporary lhs is reused for the result. */
+        virtual Histogram1D operator*(int right) &&;
 
         /** Returns histogram where all elements are sum of elements of
          * two histograms. Histogram nBinX, xMin, xMax must be the same. */
-        virtual const Histogram1D operator+(const Histogram1D& right) const; 
+        virtual Histogram1D operator+(const Histogram1D& right) const &; 
+
+        /** As above, but temporary lhs is reused for the result. */
+        virtual Histogram1D operator+(const Histogram1D& right) &&; 
 
         /** Returns histogram where all elements are difference of elements of
          * two histograms. Histogram nBinX, xMin, xMax must be the same. */
-        virtual const Histogram1D operator-(const Histogram1D& right) const; 
+        virtual Histogram1D operator-(const Histogram1D& right) const &; 
+
+        /** As above, but temporary lhs is reused for the result. */
+        virtual Histogram1D operator-(const Histogram1D& right) &&; 
 
         /** Access to elements by their index.*/
         virtual long& operator[] (unsigned ix);
@@ -223,6 +372,18 @@ class Histogram1D : public Histogram {
 
         /** Access to elements by their index.*/
         virtual long  operator() (unsigned ix) const;
+
+    private:
+        /** Projections are written directly to values_. */
+        friend class Histogram2D;
+
+        /** Fast path of rebin used when the new bin width is an exact
+         * integer multiple (factor) of the old one and the new xMin lies
+         * on an old bin edge (offset is the index of that edge).
+         * Each new bin is a plain sum of factor old bins, so the number
+         * of counts is kept exactly and no floating point is involved. */
+        Histogram1D* rebinInteger (double xMin, double xMax, unsigned nBinX,
+                                   int factor, int offset) const;
 };
 
 /** Two dimensional histogram holding 'long' per bin.*/
@@ -232,7 +393,16 @@ class Histogram2D : public Histogram {
         Histogram2D (double xMin,    double xMax,
                      double yMin,    double yMax,
                      unsigned nBinX, unsigned nBinY,
-                     string hisId);
+                     std::string hisId);
+
+        /** Copy ctor. */
+        Histogram2D (const Histogram2D& right) = default;
+
+        /** Move ctor, takes over data of right. */
+        Histogram2D (Histogram2D&& right) = default;
+
+        /** See Histogram::getData. */
+        using Histogram::getData;
 
         /** Overloaded pure virutal from base class. Returns 2.*/
         unsigned short getDim() const;
@@ -283,12 +453,84 @@ class Histogram2D : public Histogram {
         /** Return projection on X axis. @see gateX .*/
         virtual Histogram1D* gateY (double yl, double yh) const;
 
+        /** As gateX but the ownership is held by returned unique_ptr. */
+        std::unique_ptr<Histogram1D> gateXUnique (double xl, double xh) const;
+
+        /** As gateY but the ownership is held by returned unique_ptr. */
+        std::unique_ptr<Histogram1D> gateYUnique (double yl, double yh) const;
+
+        /** Writes projection into caller provided histogram, which is
+         * reset to the range and binning of the projection axis.
+         * If onY is true projection is made on Y axis with gate on X
+         * from bin containing low to bin containing high (as gateX), 
+         * otherwise projection is on X axis (as gateY). */
+        void projectInto (Histogram1D& projection, bool onY,
+                          double low, double high) const;
+
+        /** Projection with background subtraction (as projectInto,
+         * gate low to high). The background holds limits of up to two
+         * background gates (0, 2 or 4 numbers: low0, high0, low1, high1).
+         * The projection receives the gate minus the backgrounds and the
+         * variance the gate plus the backgrounds, both are reset to the
+         * projection axis. All gates are made in one pass, each gated row
+         * (gate on Y) is read once, rows (gate on X) are read once for
+         * all the strips. */
+        void projectWithBackground (Histogram1D& projection,
+                                    Histogram1D& variance, bool onY,
+                                    double low, double high,
+                                    const std::vector<double>& background)
+                                    const;
+
+        /** Builds summed-area table of the histogram. Afterwards
+         * getRectSum is O(1) and gateX, gateY cost O(projection length)
+         * regardless of the gate width. The table takes 8 bytes per bin,
+         * so it pays off when many gates are put on the same matrix.
+         * Any change of the histogram data drops the table, it must be
+         * built again if needed. */
+        void buildSummedArea ();
+
+        /** Returns true if summed-area table is built and up to date. */
+        bool hasSummedArea () const;
+
+        /** Frees memory used by summed-area table. */
+        void clearSummedArea ();
+
+        /** Returns sum of counts in bins from x0 to x1 and y0 to y1
+         * (including both). Uses summed-area table if present. */
+        long long getRectSum (unsigned x0, unsigned x1,
+                              unsigned y0, unsigned y1) const;
+
+        /** Returns statistics of bins from x0 to x1 and y0 to y1
+         * (including both), in a single pass over the rectangle.*/
+        HistogramStatistics statistics (unsigned x0, unsigned x1,
+                                        unsigned y0, unsigned y1) const;
+
+        /** Returns statistics of the whole histogram. */
+        HistogramStatistics statistics () const;
+
+        /** Returns new histogram (and ownership to it) made of bins
+         * from x0 to x1 - 1 and y0 to y1 - 1 with axes range set to
+         * given xMin, xMax, yMin and yMax. Throws ArrayError if the
+         * range is empty or out of bounds. */
+        Histogram2D* crop (unsigned x0, unsigned x1,
+                           unsigned y0, unsigned y1,
+                           double xMin, double xMax,
+                           double yMin, double yMax) const;
+
         /** 10 points for guessing what this function does.
          * Yes! It transposes the 2D histogram as if it was a matrix. 
+         * Transposition is done in place. Square matrices are swapped
+         * tile by tile (see transposeTile_), rectangular ones are permuted
+         * following the cycles of the transposition, which needs only one
+         * bit of extra memory per bin.
          */
         virtual void transpose ();
 
-        /** See Histogram1D::rebin comment */
+        /** See Histogram1D::rebin comment. Rebinning is done as two
+         * separable passes (first along X, then along Y) using overlap
+         * weights precomputed for each axis. If both new bin widths are
+         * integer multiples of the old ones the bins are block summed
+         * and counts are exact. */
         Histogram2D* rebin (double xMin, double xMax,
                             double yMin, double yMax,
                             unsigned nBinX, unsigned nBinY) const;
@@ -298,9 +540,33 @@ class Histogram2D : public Histogram {
                             double yMin, double yMax,
                             double binWX, double binWY) const;
 
+        /** As rebin but the ownership is held by returned unique_ptr. */
+        std::unique_ptr<Histogram2D> rebinUnique (double xMin, double xMax,
+                                             double yMin, double yMax,
+                                             unsigned nBinX,
+                                             unsigned nBinY) const;
+
+        /** As rebin but the ownership is held by returned unique_ptr. */
+        std::unique_ptr<Histogram2D> rebinUnique (double xMin, double xMax,
+                                             double yMin, double yMax,
+                                             double binWX, double binWY) const;
+
+        /** Rebins this histogram, see Histogram1D::rebinInPlace. */
+        void rebinInPlace (double xMin, double xMax,
+                           double yMin, double yMax,
+                           unsigned nBinX, unsigned nBinY);
+
+        /** "Width" version of rebinInPlace. */
+        void rebinInPlace (double xMin, double xMax,
+                           double yMin, double yMax,
+                           double binWX, double binWY);
+
         /** lhs lstogram will be overwritten by rhs. */
         virtual Histogram2D& operator=(const Histogram2D&);
 
+        /** lhs histogram takes over data of rhs. */
+        virtual Histogram2D& operator=(Histogram2D&&);
+
         /** All elements of histogram will be multiplied by right integer. */
         virtual Histogram2D& operator*=(int right); 
 
@@ -315,17 +581,26 @@ class Histogram2D : public Histogram {
         virtual Histogram2D& operator-=(const Histogram2D& right); 
 
         /** Returns histogram where all elements of histogram are multiplied by right. */
-        virtual const Histogram2D operator*(int right) const;
+        virtual Histogram2D operator*(int right) const &;
+
+        /** As above, but temporary lhs is reused for the result. */
+        virtual Histogram2D operator*(int right) &&;
 
         /** Returns histogram where all elements are sum of elements of
          * two histograms.
          * Histograms nBinX, nBinY, xMin, xMax, yMin and yMax must be the same. */
-        virtual const Histogram2D operator+(const Histogram2D& right) const; 
+        virtual Histogram2D operator+(const Histogram2D& right) const &; 
+
+        /** As above, but temporary lhs is reused for the result. */
+        virtual Histogram2D operator+(const Histogram2D& right) &&; 
 
         /** Returns histogram where all elements are difference of elements of
          * two histograms.
          * Histograms nBinX, nBinY, xMin, xMax, yMin and yMax must be the same. */
-        virtual const Histogram2D operator-(const Histogram2D& right) const; 
+        virtual Histogram2D operator-(const Histogram2D& right) const &; 
+
+        /** As above, but temporary lhs is reused for the result. */
+        virtual Histogram2D operator-(const Histogram2D& right) &&; 
 
         /** Access to elements by their index.*/
         virtual long& operator() (unsigned ix, unsigned iy);
@@ -334,6 +609,39 @@ class Histogram2D : public Histogram {
         virtual long  operator() (unsigned ix, unsigned iy) const;
 
     protected:
+        /** Drops summed-area table. */
+        virtual void dataChanged ();
+
+        /** Returns element (ix, iy) of summed-area table, the sum of
+         * all bins with x < ix and y < iy. */
+        long long sat (unsigned ix, unsigned iy) const;
+
+        /** Size of the square tile used by transpose. 32 x 32 longs (8 kB)
+         * makes two tiles fit in L1 cache. */
+        static const unsigned transposeTile_ = 32;
+
+        /** In place, cache blocked transposition of square matrix. */
+        void transposeSquare ();
+
+        /** In place transposition of rectangular matrix by cycle following.*/
+        void transposeCycles ();
+
+        /** Block sums values_ into out (nBinX * nBinY), see rebinInteger.
+         * The out array may be values_ itself if both offsets are >= 0
+         * and nBinX <= nBinX_. */
+        void blockSum (long* out, unsigned nBinX, unsigned nBinY,
+                       int factorX, int offsetX,
+                       int factorY, int offsetY,
+                       long& underflow, long& overflow) const;
+
+        /** Fast path of rebin for integer factors in both directions,
+         * see Histogram1D::rebinInteger. */
+        Histogram2D* rebinInteger (double xMin, double xMax,
+                                   double yMin, double yMax,
+                                   unsigned nBinX, unsigned nBinY,
+                                   int factorX, int offsetX,
+                                   int factorY, int offsetY) const;
+
         /** Lower edge of lowest bin in Y direction. */
         double   yMin_;
 
@@ -345,6 +653,13 @@ class Histogram2D : public Histogram {
     
         /** Bin width in Y direction.*/
         double binWidthY_;
+
+        /** Summed-area table, (nBinX_ + 1) * (nBinY_ + 1) cumulative sums,
+         * empty if not built. */
+        std::vector<long long> summedArea_;
+
+        /** True if summedArea_ matches values_. */
+        bool hasSummedArea_;
 };
 
 inline double   Histogram2D::getyMin() const  { return yMin_; }
@@ -360,6 +675,10 @@ inline double   Histogram2D::getYlow (unsigned iy) const {
 inline double   Histogram2D::getYhigh (unsigned iy) const {
     return ( double(iy) + 1.0 ) * binWidthY_ + yMin_;
 }
+inline bool     Histogram2D::hasSummedArea () const { return hasSummedArea_; }
+inline long long Histogram2D::sat (unsigned ix, unsigned iy) const {
+    return summedArea_[iy * (nBinX_ + 1) + ix];
+}
 
 
 #endif
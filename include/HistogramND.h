@@ -0,0 +1,160 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#ifndef HISTOGRAMND_H
+#define HISTOGRAMND_H
+
+#include <vector>
+#include <string>
+#include "Histogram.h"
+#include "Exceptions.h"
+
+/**
+ * Histogram of any number of dimensions (3 and 4 for damm cubes and
+ * hypercubes), holding 'long' per bin.
+ *
+ * Data is stored as in the his file: the first axis (X) runs fastest, the
+ * bin (i0, i1, ..., iN) is at i0 * stride(0) + i1 * stride(1) + ...
+ * with stride(0) = 1 and stride(d) = stride(d - 1) * nBin(d - 1).
+ * Axes are numbered from 0 (X, Y, Z, W).
+ *
+ * Projections take a gate (range of coordinates, both ends inclusive) on
+ * every axis and go in a single pass over the gated box only. The box
+ * is walked in runs along X, which are contiguous in memory.
+ */
+class HistogramND : public Histogram {
+    public:
+        /** Ctor. Vectors give range and number of bins for each axis,
+         * number of dimensions is equal to their size.*/
+        HistogramND (const std::vector<double>& min,
+                     const std::vector<double>& max,
+                     const std::vector<unsigned>& nBin, std::string hisId);
+
+        /** Overloaded pure virtual from base class. Returns number of
+         * axes.*/
+        unsigned short getDim() const;
+
+        /** See Histogram::getData. */
+        using Histogram::getData;
+
+        /** Returns lower edge of first bin on axis. */
+        double   getMin (unsigned axis) const;
+
+        /** Returns upper edge of last bin on axis. */
+        double   getMax (unsigned axis) const;
+
+        /** Returns number of bins on axis. */
+        unsigned getnBin (unsigned axis) const;
+
+        /** Returns bin width on axis. */
+        double   getBinWidth (unsigned axis) const;
+
+        /** Returns distance in memory between neighbouring bins on axis. */
+        unsigned long getStride (unsigned axis) const;
+
+        /** Returns middle of bin number i on axis. */
+        double   getCoord (unsigned axis, unsigned i) const;
+
+        /** Returns bin number on axis where x is located, as getiX,
+         * coordinates out of range give first or last bin. */
+        unsigned getBin (unsigned axis, double x) const;
+
+        /** Returns value of bin with indexes given by bin.*/
+        long get (const std::vector<unsigned>& bin) const;
+
+        /** Access to elements by their indexes.*/
+        long& operator() (const std::vector<unsigned>& bin);
+
+        /** Access to elements by their indexes.*/
+        long  operator() (const std::vector<unsigned>& bin) const;
+
+        /** Projects histogram on axis, counting only bins with coordinates
+         * within low[d] to high[d] on each axis d. The projection
+         * is reset to the range and binning of the axis.*/
+        void projectInto (Histogram1D& projection, unsigned axis,
+                          const std::vector<double>& low,
+                          const std::vector<double>& high) const;
+
+        /** Projects histogram on plane axisX, axisY (e.g. a double gated
+         * cube projected on 2D matrix), gates as above.
+         * The projection is replaced by a new histogram of ranges and
+         * binnings of the two axes.*/
+        void projectInto (Histogram2D& projection,
+                          unsigned axisX, unsigned axisY,
+                          const std::vector<double>& low,
+                          const std::vector<double>& high) const;
+
+        /** Returns new Histogram1D, a projection on axis.
+         * @see projectInto */
+        Histogram1D* project (unsigned axis,
+                              const std::vector<double>& low,
+                              const std::vector<double>& high) const;
+
+        /** Returns new Histogram2D, a projection on axisX, axisY plane.
+         * @see projectInto */
+        Histogram2D* project (unsigned axisX, unsigned axisY,
+                              const std::vector<double>& low,
+                              const std::vector<double>& high) const;
+
+        virtual ~HistogramND () {  }
+
+    private:
+        /** Returns index in values_ of bin, checks bounds. */
+        unsigned long index (const std::vector<unsigned>& bin) const;
+
+        /** Converts gates given in coordinates to ranges of bins
+         * (both inclusive) on each axis. */
+        void gateBins (const std::vector<double>& low,
+                       const std::vector<double>& high,
+                       std::vector<unsigned>& first,
+                       std::vector<unsigned>& last) const;
+
+        /** Kernel of projections. Adds every bin of the box first[d] to
+         * last[d] (inclusive) to out[sum over d of i[d] * outStride[d]].
+         * Zero outStride means that axis is summed up. */
+        void projectBox (const std::vector<unsigned>& first,
+                         const std::vector<unsigned>& last,
+                         const std::vector<unsigned long>& outStride,
+                         long* out) const;
+
+        /** Lower edges of axes. */
+        std::vector<double> min_;
+
+        /** Upper edges of axes. */
+        std::vector<double> max_;
+
+        /** Number of bins on axes. */
+        std::vector<unsigned> nBin_;
+
+        /** Bin widths on axes. */
+        std::vector<double> binWidth_;
+
+        /** Strides of axes in values_. */
+        std::vector<unsigned long> stride_;
+};
+
+inline unsigned short HistogramND::getDim() const { return nBin_.size(); }
+inline double   HistogramND::getMin (unsigned axis) const {
+    return min_.at(axis);
+}
+inline double   HistogramND::getMax (unsigned axis) const {
+    return max_.at(axis);
+}
+inline unsigned HistogramND::getnBin (unsigned axis) const {
+    return nBin_.at(axis);
+}
+inline double   HistogramND::getBinWidth (unsigned axis) const {
+    return binWidth_.at(axis);
+}
+inline unsigned long HistogramND::getStride (unsigned axis) const {
+    return stride_.at(axis);
+}
+inline double   HistogramND::getCoord (unsigned axis, unsigned i) const {
+    return ( double(i) + 0.5 ) * binWidth_.at(axis) + min_[axis];
+}
+
+#endif
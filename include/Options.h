@@ -10,6 +10,14 @@
 
 #include <vector>
 #include <string>
+
+/** Output formats (--format). */
+enum OutputFormat {
+    formatText,
+    formatRaw,
+    formatGnuplotMatrix
+};
+
 /**
  * Class for storing options for readhis. Options are loaded from
  * command line by readhis and applied here. The HisDrrHisto requires 
@@ -48,6 +56,30 @@ class Options {
         /** Sets info mode.*/
         void setInfoMode (bool b = true);
 
+        /** Returns true if index mode (--index) is set.*/
+        bool getIndexMode() const;
+
+        /** Sets index mode.*/
+        void setIndexMode (bool b = true);
+
+        /** Returns true if 2D output is cropped to non-empty bins.*/
+        bool getAutoCrop() const;
+
+        /** Sets cropping of 2D output to non-empty bins (--autocrop).*/
+        void setAutoCrop (bool b = true);
+
+        /** Returns true if help was requested.*/
+        bool getHelp() const;
+
+        /** Sets help request (-h, --help).*/
+        void setHelp (bool b = true);
+
+        /** Returns true if statistics mode is set.*/
+        bool getStats() const;
+
+        /** Sets statistics mode.*/
+        void setStats (bool b = true);
+
         /** Returns true if zero suppresion mode is set.*/
         bool getZeroSup() const;
 
@@ -95,6 +127,79 @@ class Options {
         /** Returns by reference vector containing Y gates.*/
         void getGateY(std::vector<unsigned>& rtn) const;
 
+        /** Returns true if gz flag is set.*/
+        bool getGz() const;
+
+        /** Sets gz flag (gate on Z axis of 3 and 4D histograms), and gate
+         * limits. Makes gates limit check. */
+        bool setGz (unsigned g0, unsigned g1, bool isGz = true);
+
+        /** Returns true if gw flag is set.*/
+        bool getGw() const;
+
+        /** Sets gw flag (gate on W axis of 4D histograms), and gate limits.
+         * Makes gates limit check. */
+        bool setGw (unsigned g0, unsigned g1, bool isGw = true);
+
+        /** Returns by reference vector containing Z gates.*/
+        void getGateZ(std::vector<unsigned>& rtn) const;
+
+        /** Returns by reference vector containing W gates.*/
+        void getGateW(std::vector<unsigned>& rtn) const;
+
+        /** Sets projection axes of 3 and 4D histograms, one or two
+         * different letters of x, y, z, w. Returns false if axes are
+         * not valid.*/
+        bool setProjection (std::string axes);
+
+        /** Returns projection axes (empty if not set). */
+        std::string getProjection() const;
+
+        /** Sets name of file with list of gates (--gate-file).*/
+        void setGateFile (std::string gateFile);
+
+        /** Returns name of file with list of gates (empty if not set).*/
+        std::string getGateFile() const;
+
+        /** Sets output format, one of text, raw or gnuplot-matrix.
+         * Returns false if name is not known.*/
+        bool setFormat (std::string format);
+
+        /** Returns output format. */
+        OutputFormat getFormat() const;
+
+        /** Sets name of file with batch commands (- for standard input).*/
+        void setBatch (std::string batchFile);
+
+        /** Returns name of file with batch commands (empty if not set).*/
+        std::string getBatch() const;
+
+        /** Sets path of server socket (--serve).*/
+        void setServe (std::string socketPath);
+
+        /** Returns path of server socket (empty if not set).*/
+        std::string getServe() const;
+
+        /** Sets pattern of output file names, %n is replaced by the
+         * name of his file (without directory and extension).*/
+        void setOutput (std::string pattern);
+
+        /** Returns pattern of output file names (empty if not set).*/
+        std::string getOutput() const;
+
+        /** Sets maximal number of histograms read at the same time
+         * (0 for no limit).*/
+        void setMaxReads (unsigned n);
+
+        /** Returns maximal number of histograms read at the same time.*/
+        unsigned getMaxReads() const;
+
+        /** Sets number of worker threads (0 for number of cores).*/
+        void setThreads (unsigned n);
+
+        /** Returns number of worker threads (0 for number of cores).*/
+        unsigned getThreads() const;
+
         /** Returns by reference vector containing background gates.*/
         void getBgGate(std::vector<unsigned>& rtn) const;
 
@@ -134,7 +239,21 @@ class Options {
 
         /** Info mode outputs detailed histogram infomation instead of data.*/
         bool isInfoMode_;
+
+        /** --index flag. Builds (if needed) and lists index file. */
+        bool isIndexMode_;
+
+        /** --autocrop flag. 2D output is cropped to non-empty bins. */
+        bool isAutoCrop_;
+
+        /** --help flag. Help is printed by the caller of parser, so
+         * batch lines and server requests can refuse it. */
+        bool isHelp_;
         
+        /** --stats flag. Statistics of the output histogram are printed 
+         * instead of its bins. */
+        bool isStats_;
+
         /** Zero suppresion flag means that for 1D histogram when number of 
          * count in a bin is 0 it will be skipped in the output.*/
         bool isZeroSup_;
@@ -149,6 +268,12 @@ class Options {
          */
         bool isGy_;
 
+        /** --gz flag. For 3 and 4D histograms, gate on Z axis. */
+        bool isGz_;
+
+        /** --gw flag. For 4D histograms, gate on W axis. */
+        bool isGw_;
+
         /** --bg flag. For --gx or --gy, sets background subtraction gate. */
         bool isBg_;
 
@@ -169,6 +294,37 @@ class Options {
         /** For --gy. Stores gates. */
         std::vector<unsigned> gy_;
 
+        /** For --gz. Stores gates. */
+        std::vector<unsigned> gz_;
+
+        /** For --gw. Stores gates. */
+        std::vector<unsigned> gw_;
+
+        /** For --gate-file. File with list of gates. */
+        std::string gateFile_;
+
+        /** For --batch. File with commands. */
+        std::string batch_;
+
+        /** For --serve. Path of server socket. */
+        std::string serve_;
+
+        /** For --output. Pattern of output file names. */
+        std::string output_;
+
+        /** For --max-reads. Maximal number of concurrent reads. */
+        unsigned maxReads_;
+
+        /** For --threads. Number of worker threads, 0 for number of
+         * cores. */
+        unsigned threads_;
+
+        /** For --format. Output format. */
+        OutputFormat format_;
+
+        /** For --proj. Projection axes. */
+        std::string projection_;
+
         /** For --bg or --sbg. Stores background gates */
         std::vector<unsigned> b_;
 
@@ -28,6 +28,24 @@ class Point {
         double y;
 };
 
+/** Polygon gate rasterized at histogram binning (see Polygon::rasterize).
+ * Bins from begin[k] to end[k] - 1 of row (Y bin) iy are inside the
+ * polygon, for k from rowStart[iy - y0] to rowStart[iy - y0 + 1] - 1.
+ * Rows from y0 to y1 - 1 are present. */
+struct PolygonMask {
+    /** First row. */
+    unsigned y0;
+    /** Row after the last one. */
+    unsigned y1;
+    /** Index of the first interval of each row, and total number
+     * of intervals at the end. */
+    std::vector<unsigned> rowStart;
+    /** First bin of interval. */
+    std::vector<unsigned> begin;
+    /** Bin after the last one of interval. */
+    std::vector<unsigned> end;
+};
+
 /** Class for polygon gates. */
 class Polygon {
     public:
@@ -48,20 +66,128 @@ class Polygon {
          * */
         Polygon(const std::string& polygonFileName);
 
-        /** C'tor polygon is created from points defined in a BAN (damm) file.*/
+        /** C'tor polygon is created from points defined in a BAN (damm) file.
+         * @see BanFile */
         Polygon(const std::string& polygonFileName, int banId);
         
-        /** Checks if given point (xp, yp) is inside polygon (returns true).*/
-        bool pointIn(double xp, double yp);
+        /** Checks if given point (xp, yp) is inside polygon (returns true).
+         * Edges and vertices are outside. Only edges crossing the
+         * horizontal slab of yp are tested (see buildIndex), so the cost
+         * is O(log n + k) for n vertices and k edges in the slab. */
+        bool pointIn(double xp, double yp) const;
+
+        /** Checks many points at once, out[i] is set to 
+         * pointIn(xs[i], ys[i]). */
+        void pointsIn(const std::vector<double>& xs,
+                      const std::vector<double>& ys,
+                      std::vector<bool>& out) const;
+
+        /** Finds bins of the histogram that are inside polygon, 
+         * bins are represented by their middles (as by Histogram::getX)
+         * and the result is identical to pointIn called for each of them.
+         * X bins are of width binWX starting at xMin, Y bins of 
+         * width binWY starting at yMin. Only bins from x0 to x1 - 1 and
+         * from y0 to y1 - 1 are taken into account.
+         *
+         * Each row is a horizontal scanline: crossings with edges are 
+         * found once per row and bins between them form intervals, so
+         * the cost is O(rows * vertices) instead of 
+         * O(rows * columns * vertices) of pointIn. */
+        void rasterize(double xMin, double binWX, unsigned x0, unsigned x1,
+                       double yMin, double binWY, unsigned y0, unsigned y1,
+                       PolygonMask& mask) const;
 
         /** Returns rectangle in which polygon is included. Rectangle edges
          * are perpendicular to X and Y axes of carthesian coordinage system. */
         bool rectangle(double& xlow, double& ylow, double& xhigh, double& yhigh);
 
     private:
+        /** Returns sorted x positions where a ray from left at height yp
+         * crosses edges, using the edge rules of pointIn. Point (xp, yp)
+         * is inside if odd number of crossings is <= xp (and it is 
+         * not a vertex).*/
+        void crossings(double yp, std::vector<double>& xs) const;
+
+        /** Builds slab index of edges, called by c'tors. Distinct y of
+         * vertices divide plane into horizontal slabs, each slab holds
+         * the (non horizontal) edges crossing it. */
+        void buildIndex();
+
+        /** Returns number of crossings <= xp of the edges in slab s
+         * with the horizontal ray at yp. */
+        unsigned countCrossings(unsigned s, double xp, double yp) const;
+
         /** Vector of Point objects setting the vertices of polygon. */
         std::vector< Point > vertices_;
+
+        /** Sorted distinct y of vertices, slab s is 
+         * (slabY_[s], slabY_[s + 1]]. */
+        std::vector<double> slabY_;
+
+        /** Edges of slab s are from slabStart_[s] to 
+         * slabStart_[s + 1] - 1. */
+        std::vector<unsigned> slabStart_;
+
+        /** Edges of slabs, start (vertex i) and end (vertex i + 1) points
+         * kept in separate arrays, so the crossing test loop 
+         * vectorizes. */
+        std::vector<double> edgeX0_;
+        std::vector<double> edgeY0_;
+        std::vector<double> edgeX1_;
+        std::vector<double> edgeY1_;
+
+        /** Sorted x of vertices at slabY_[i] are from vertexStart_[i] to
+         * vertexStart_[i + 1] - 1 of vertexX_. */
+        std::vector<unsigned> vertexStart_;
+        std::vector<double> vertexX_;
+};
+
+/** All polygons (bananas) of a BAN (damm) file, the file is parsed once.
+ * Each banana starts with a line
+ *
+ * INP hisFile hisId banId angle nPoints
+ *
+ * followed by the TIT (title) line and nPoints pairs of X Y coordinates,
+ * preceded by CXY keywords (one per line of points). Bananas of 
+ * projection angle different then 0 are not supported. */
+class BanFile {
+    public:
+        /** C'tor, reads all bananas from the file. */
+        BanFile(const std::string& banFileName);
+
+        /** Returns number of (supported) bananas. */
+        unsigned size() const;
+
+        /** Returns damm id of i-th banana, in order of the file. */
+        int getId(unsigned i) const;
+
+        /** Returns i-th banana, in order of the file. */
+        const Polygon& get(unsigned i) const;
+
+        /** Returns banana of given damm id (first one if repeated),
+         * throws GenError if there is none or it is malformed. */
+        const Polygon& find(int banId) const;
+
+    private:
+        /** Damm ids of bananas. */
+        std::vector<int> ids_;
+
+        /** Bananas, in the same order as ids_. */
+        std::vector<Polygon> polygons_;
+
+        /** Ids of bananas of angle other then 0 (skipped). */
+        std::vector<int> rotated_;
+
+        /** Ids of malformed bananas (skipped) and their errors, thrown
+         * by find only when such banana is requested. */
+        std::vector<int> badIds_;
+        std::vector<std::string> badErrors_;
 };
 
+inline unsigned BanFile::size() const { return polygons_.size(); }
+inline int BanFile::getId(unsigned i) const { return ids_.at(i); }
+inline const Polygon& BanFile::get(unsigned i) const {
+    return polygons_.at(i);
+}
 
 #endif
@@ -0,0 +1,175 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#ifndef SERVERH
+#define SERVERH
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include "HisDrrHisto.h"
+#include "Options.h"
+
+/**
+ * Resident server (--serve) answering requests sent over a Unix domain
+ * socket. His/drr files are opened on the first request and kept open.
+ *
+ * Request is a single line of options as on the command line,
+ * including the histogram file name, e.g. '-i 1734 --gx 266,269 run.his'.
+ * Response is a line 'OK n' (or 'ERROR n' if the request could not be
+ * parsed, the file opened or processing failed, then the output is
+ * the error message) followed by n bytes of output: text as
+ * printed by readhis, or data only for binary formats (--format).
+ * Many requests may be sent over one connection. Other requests are:
+ *
+ * stats - latency statistics of requests (text response),
+ * quit - closes the connection,
+ * shutdown - stops the server.
+ *
+ * Connections are watched and read by the main thread, requests are
+ * served by a pool of worker threads once a whole line is received.
+ * Requests on the same file wait for each other, different files are
+ * processed in parallel.
+ */
+class Server {
+    public:
+        /** Function parsing request arguments (args[0] is program name)
+         * into options and file name, comments and error messages are
+         * printed to cout. Returns false on error. It is never called
+         * concurrently. */
+        typedef std::function<bool (const std::vector<std::string>& args,
+                                    Options& options,
+                                    std::string& fileName)> Parser;
+
+        /** C'tor, creates socket at socketPath (stale socket is
+         * removed). Requests are served by nThreads worker threads
+         * (0 for number of cores). */
+        Server(const std::string& socketPath, unsigned nThreads,
+               Parser parser);
+
+        /** Closes and removes the socket. */
+        ~Server();
+
+        /** Serves requests until 'shutdown' request. */
+        void run();
+
+    private:
+        Server (const Server&);
+        Server& operator= (const Server&);
+
+        /** Client connection with received but not yet processed data.*/
+        struct Connection {
+            int fd;
+            std::string buffer;
+        };
+
+        /** Opened his/drr file, used by one request at a time. */
+        struct OpenFile {
+            std::mutex mutex;
+            std::unique_ptr<HisDrrHisto> hisDrr;
+        };
+
+        /** Worker thread, serves requests of connections from queue_. */
+        void worker();
+
+        /** Takes a whole line received from connection, returns false
+         * if there is none. */
+        bool readLine(Connection& connection, std::string& line);
+
+        /** Returns true if connection buffer holds a whole line. */
+        bool hasLine(const Connection& connection) const;
+
+        /** Serves one request, returns false if connection should be
+         * closed. */
+        bool serve(Connection& connection, const std::string& request);
+
+        /** Runs request, output goes to text or data (binary formats).
+         * Returns false if it could not be run or failed. */
+        bool process(const std::string& request, std::ostream& text,
+                     std::ostream& data, bool& binary);
+
+        /** Returns opened file (opens it if needed). */
+        OpenFile& openFile(const std::string& fileName);
+
+        /** Sends response header and payload. */
+        bool respond(int fd, bool ok, const std::string& payload);
+
+        /** Adds request time (in us) to statistics. */
+        void addLatency(double us, bool error);
+
+        /** Prints latency statistics. */
+        void printLatency(std::ostream& out);
+
+        /** Wakes up main thread (connection returned or shutdown). */
+        void wakeUp();
+
+        /** Path of socket. */
+        std::string socketPath_;
+
+        /** Listening socket. */
+        int listenFd_;
+
+        /** Pipe used to wake up main thread. */
+        int wakeFd_[2];
+
+        /** Number of worker threads. */
+        unsigned nThreads_;
+
+        /** Request parser. */
+        Parser parser_;
+
+        /** False when shutdown is requested. */
+        bool running_;
+
+        /** Connections with requests waiting for a worker. */
+        std::deque<Connection> queue_;
+
+        /** Connections waiting for requests (watched by main thread). */
+        std::vector<Connection> idle_;
+
+        /** Guards queue_, idle_ and running_. */
+        std::mutex queueMutex_;
+
+        /** Signals new connection in queue_ (or shutdown). */
+        std::condition_variable queueChanged_;
+
+        /** Opened files by name. */
+        std::map<std::string, std::unique_ptr<OpenFile> > files_;
+
+        /** Guards files_. */
+        std::mutex filesMutex_;
+
+        /** Parser is not reentrant (getopt). */
+        std::mutex parseMutex_;
+
+        /** Default options for opened files. */
+        Options defaultOptions_;
+
+        /** Guards latency statistics. */
+        std::mutex statsMutex_;
+
+        /** Number of requests and failed requests. */
+        unsigned long nRequests_;
+        unsigned long nErrors_;
+
+        /** Sum, sum of squares, min and max of request times (us). */
+        double sum_;
+        double sumSq_;
+        double min_;
+        double max_;
+
+        /** Times of last requests (ring buffer) for percentiles. */
+        std::vector<double> recent_;
+};
+
+#endif
@@ -0,0 +1,239 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com 
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#ifndef SPARSEHISTOGRAM_H
+#define SPARSEHISTOGRAM_H
+
+#include <vector>
+#include <memory>
+#include <string>
+#include "Histogram.h"
+#include "Exceptions.h"
+
+/**
+ * Two dimensional histogram holding only non-empty bins.
+ * Bins are stored in compressed sparse row (CSR) form: a row is a single
+ * Y bin and within a row bins are sorted by X. Memory use and the cost of
+ * gates, projections, rebinning and export scale with the number of
+ * non-empty bins, not with the matrix size, so it is much faster than
+ * Histogram2D for matrices occupied in a few percent (see preferSparse).
+ *
+ * Single bins may be read but not modified, the data is set as a whole
+ * by setDataRaw or by operations returning a new histogram.
+ */
+class SparseHistogram2D : public Histogram {
+    public:
+        /** Ctor, histogram is empty.*/
+        SparseHistogram2D (double xMin,    double xMax,
+                           double yMin,    double yMax,
+                           unsigned nBinX, unsigned nBinY,
+                           std::string hisId);
+
+        /** Ctor, creates sparse copy of dense histogram. */
+        explicit SparseHistogram2D (const Histogram2D& dense);
+
+        /** Returns true if data of nBins bins with nonZero non-empty bins
+         * is better held in a sparse histogram. */
+        static bool preferSparse (unsigned long nonZero, unsigned long nBins);
+
+        /** Largest fraction of non-empty bins for which sparse histogram
+         * is preferred. */
+        static const double maxOccupancy;
+
+        /** Overloaded pure virutal from base class. Returns 2.*/
+        unsigned short getDim() const;
+
+        /** Returns yMin_.*/
+        double   getyMin() const;
+
+        /** Returns yMax_.*/
+        double   getyMax() const;
+
+        /** Returns nBinY_.*/
+        unsigned getnBinY() const;
+
+        /** Returns binWidthY_.*/
+        double getBinWidthY() const;
+
+        /** Returns middle of bin number iy.*/
+        double getY (unsigned iy) const;
+
+        /** Returns bin number where y is located, see Histogram2D::getiY.*/
+        unsigned getiY (double y) const;
+
+        /** Returns low edge of bin number iy */
+        double getYlow (unsigned iy) const;
+
+        /** Returns high edge of bin number iy */
+        double getYhigh (unsigned iy) const;
+
+        /** Returns total number of counts in histogram */
+        virtual long getSum () const;
+
+        /** Returns number of non-empty bins. */
+        unsigned long getNonZero () const;
+
+        /** Returns fraction of non-empty bins. */
+        double getOccupancy () const;
+
+        /** Returns data expanded to dense form (iy * nBinX + ix). */
+        virtual void getDataRaw (std::vector<long>& values) const;
+
+        /** Sets data from dense vector (iy * nBinX + ix), zero bins
+         * are skipped. */
+        virtual void setDataRaw (const std::vector<long>& values);
+
+        /** See above. */
+        virtual void setDataRaw (const std::vector<int>& values);
+
+        /** See above. */
+        virtual void setDataRaw (const std::vector<unsigned>& values);
+
+        /** See above, values are rounded as in Histogram::setDataRaw. */
+        virtual void setDataRaw (const std::vector<double>& values);
+
+        /** Sets data from dense vector as setDataRaw, but non-empty bins
+         * are counted and stored in a single pass. Returns false, leaving
+         * the histogram empty, as soon as there are more of them than
+         * preferSparse allows (the data is better held in Histogram2D).*/
+        bool setDataIfSparse (const std::vector<unsigned>& values);
+
+        /** Returns value of bin (ix,iy). Binary search in the row. */
+        long get (unsigned ix, unsigned iy) const;
+
+        /** Access to elements by their index.*/
+        long operator() (unsigned ix, unsigned iy) const;
+
+        /** Index of first stored bin of row iy. */
+        unsigned long rowBegin (unsigned iy) const;
+
+        /** Index of one past the last stored bin of row iy. */
+        unsigned long rowEnd (unsigned iy) const;
+
+        /** X bin number of stored bin k. */
+        unsigned column (unsigned long k) const;
+
+        /** Number of counts in stored bin k. */
+        long count (unsigned long k) const;
+
+        /** Returns projection on Y axis gated on X axis, see
+         * Histogram2D::gateX.*/
+        Histogram1D* gateX (double xl, double xh) const;
+
+        /** Return projection on X axis. @see gateX .*/
+        Histogram1D* gateY (double yl, double yh) const;
+
+        /** See Histogram2D::statistics. Only non-empty bins are
+         * visited. */
+        HistogramStatistics statistics (unsigned x0, unsigned x1,
+                                        unsigned y0, unsigned y1) const;
+
+        /** Returns statistics of the whole histogram. */
+        HistogramStatistics statistics () const;
+
+        /** See Histogram2D::projectInto. */
+        void projectInto (Histogram1D& projection, bool onY,
+                          double low, double high) const;
+
+        /** See Histogram2D::projectWithBackground. */
+        void projectWithBackground (Histogram1D& projection,
+                                    Histogram1D& variance, bool onY,
+                                    double low, double high,
+                                    const std::vector<double>& background)
+                                    const;
+
+        /** Returns dense copy. */
+        Histogram2D toDense () const;
+
+        /** Returns part of histogram, see Histogram2D::crop. */
+        SparseHistogram2D* crop (unsigned x0, unsigned x1,
+                                 unsigned y0, unsigned y1,
+                                 double xMin, double xMax,
+                                 double yMin, double yMax) const;
+
+        /** Transposes histogram, by counting sort of the bins by X. */
+        void transpose ();
+
+        /** See Histogram2D::rebin. Integer factors are summed row by row
+         * without expanding the matrix, other factors use the area-overlap
+         * weights of Histogram::overlapWeights. */
+        SparseHistogram2D* rebin (double xMin, double xMax,
+                                  double yMin, double yMax,
+                                  unsigned nBinX, unsigned nBinY) const;
+
+        /** "Width" rebinning version, see Histogram1D::rebin comment */
+        SparseHistogram2D* rebin (double xMin, double xMax,
+                                  double yMin, double yMax,
+                                  double binWX, double binWY) const;
+
+        /** Rebins this histogram, see rebin. */
+        void rebinInPlace (double xMin, double xMax,
+                           double yMin, double yMax,
+                           unsigned nBinX, unsigned nBinY);
+
+        /** "Width" version of rebinInPlace. */
+        void rebinInPlace (double xMin, double xMax,
+                           double yMin, double yMax,
+                           double binWX, double binWY);
+
+    private:
+        /** Fills the bins from dense vector. */
+        template <class T>
+        void fill (const std::vector<T>& values);
+
+        /** Lower edge of lowest bin in Y direction. */
+        double   yMin_;
+
+        /** High edge of highest bin in Y direction. */
+        double   yMax_;
+
+        /** Number of bins in Y direction.*/
+        unsigned nBinY_;
+    
+        /** Bin width in Y direction.*/
+        double binWidthY_;
+
+        /** Index of first stored bin of each row, nBinY_ + 1 elements. */
+        std::vector<unsigned long> rowStart_;
+
+        /** X bin number of each stored bin. */
+        std::vector<unsigned> columns_;
+
+        /** Number of counts in each stored bin. */
+        std::vector<long> counts_;
+};
+
+inline double   SparseHistogram2D::getyMin() const  { return yMin_; }
+inline double   SparseHistogram2D::getyMax() const  { return yMax_; }
+inline unsigned SparseHistogram2D::getnBinY() const { return nBinY_; }
+inline double   SparseHistogram2D::getBinWidthY() const { return binWidthY_ ; }
+inline double   SparseHistogram2D::getY (unsigned iy) const {
+    return ( double(iy) + 0.5 ) * binWidthY_ + yMin_;
+}
+inline double   SparseHistogram2D::getYlow (unsigned iy) const {
+    return ( double(iy) ) * binWidthY_ + yMin_;
+}
+inline double   SparseHistogram2D::getYhigh (unsigned iy) const {
+    return ( double(iy) + 1.0 ) * binWidthY_ + yMin_;
+}
+inline unsigned long SparseHistogram2D::getNonZero () const {
+    return counts_.size();
+}
+inline unsigned long SparseHistogram2D::rowBegin (unsigned iy) const {
+    return rowStart_[iy];
+}
+inline unsigned long SparseHistogram2D::rowEnd (unsigned iy) const {
+    return rowStart_[iy + 1];
+}
+inline unsigned SparseHistogram2D::column (unsigned long k) const {
+    return columns_[k];
+}
+inline long SparseHistogram2D::count (unsigned long k) const {
+    return counts_[k];
+}
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#ifndef TEXTWRITERH
+#define TEXTWRITERH
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+
+/**
+ * Buffered text output for large exports. Numbers are formatted
+ * directly into a buffer, which is written to the stream only when full
+ * (and on flush or destruction), so there is no flush per line.
+ *
+ * Output is byte-identical to std::ostream with default flags: integers
+ * as they are, doubles as "%g" (6 significant digits). Doubles that are
+ * the closest ones to a decimal number of at most 6 significant digits
+ * (e.g. bin middles like 12.5) are formatted as integers, others go
+ * through snprintf.
+ *
+ * Nothing else should be written to the same stream while the writer
+ * holds data (use flush() first).
+ */
+class TextWriter {
+    public:
+        /** C'tor, output goes to out. */
+        TextWriter(std::ostream& out = std::cout,
+                   unsigned bufferSize = 1 << 16);
+
+        /** C'tor, output is appended to string out. */
+        TextWriter(std::string& out, unsigned bufferSize = 1 << 16);
+
+        /** Flushes remaining data. */
+        ~TextWriter();
+
+        TextWriter& operator<< (long n);
+        TextWriter& operator<< (unsigned long n);
+        TextWriter& operator<< (int n);
+        TextWriter& operator<< (unsigned n);
+        TextWriter& operator<< (double x);
+        TextWriter& operator<< (char c);
+        TextWriter& operator<< (const char* s);
+        TextWriter& operator<< (const std::string& s);
+
+        /** Writes n bytes of data (may hold any bytes, also zeros). */
+        void write(const char* data, unsigned long n);
+
+        /** Writes buffer to the stream. */
+        void flush();
+
+        /** Formats text in blocks, block i is written by format(i, writer).
+         * Blocks are formatted by nThreads threads, each into its own
+         * buffer, and written to out in order by the calling thread.
+         * At most 2 * nThreads blocks are held in memory. */
+        static void writeParallel(std::ostream& out, unsigned nBlocks,
+                      unsigned nThreads,
+                      const std::function<void (unsigned, TextWriter&)>& format);
+
+        /** Writes blocks of any length to out in order, block i is
+         * written to a stream by format(i, stream). Blocks are formatted
+         * by nThreads threads; the first unfinished block goes straight
+         * to out, others are held in chunks of chunkSize bytes, at most
+         * maxChunks per block (the thread waits for its turn then), and
+         * at most 2 * nThreads blocks are started ahead of it. */
+        static void streamParallel(std::ostream& out, unsigned nBlocks,
+                      unsigned nThreads,
+                      const std::function<void (unsigned, std::ostream&)>& format,
+                      unsigned chunkSize = 1 << 16, unsigned maxChunks = 16);
+
+    private:
+        TextWriter (const TextWriter&);
+        TextWriter& operator= (const TextWriter&);
+
+        /** Makes sure there is place for n more characters. */
+        void reserve(unsigned n);
+
+        /** Appends digits of n (no sign). */
+        void putDigits(unsigned long n);
+
+        /** Stream the buffer goes to (or 0). */
+        std::ostream* out_;
+
+        /** String the buffer goes to (or 0). */
+        std::string* str_;
+
+        /** Buffer, of size of at least bufferSize_ + 64 (a room for one
+         * number). */
+        std::vector<char> buffer_;
+
+        /** Number of characters in the buffer. */
+        unsigned used_;
+
+        /** Buffer is flushed when more then this is used. */
+        unsigned bufferSize_;
+};
+
+inline void TextWriter::reserve(unsigned n) {
+    if (used_ + n > bufferSize_)
+        flush();
+    if (n > buffer_.size())
+        buffer_.resize(n);
+}
+
+inline TextWriter& TextWriter::operator<< (char c) {
+    reserve(1);
+    buffer_[used_++] = c;
+    return *this;
+}
+
+inline TextWriter& TextWriter::operator<< (int n) {
+    return *this << long(n);
+}
+
+inline TextWriter& TextWriter::operator<< (unsigned n) {
+    return *this << (unsigned long)(n);
+}
+
+#endif
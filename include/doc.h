@@ -29,11 +29,12 @@
  *  /usr/local/bin path for system wide access.
  *
  *  Compilation was tested on Linux Fedora 16 and Arch Linux using g++ 4.6.
+ *  The code requires a C++11 compiler (e.g. g++ 4.8.1 or newer).
  *  Program depends on C++ Standard Library only, so porting to other
  *  operating systems should be easy.
  *
  * \section Usage
- *       readhis [options] file.his
+ *       readhis [options] file.his [file2.his ...]
  *
  * \section Description  
  *       Program reads his file using binary description from drr file.  
@@ -41,6 +42,8 @@
  *       and with the same base name (e.g. t1.his and t1.drr).  
  *       Result is send to standard output, use redirection   
  *       in case you want to save it to file.  
+ *       Many files (or wildcards, e.g. 'run*.his') may be given,
+ *       they are processed in parallel (see --threads, --output).
  *     
  * \section Options  
  * - Option:	--id
@@ -77,6 +80,10 @@
  *
  * 		If filename,id syntax is used, the file must be a BAN 
  * 		(damm) file, and id is a damm banana id to be used. 
+ * 		Several bananas may be given as filename,id1:id2:... or 
+ * 		filename,all (all bananas of the file), they are projected 
+ * 		in a single pass over the matrix and written one after 
+ * 		another, separated by two empty lines.
  * 
  * -	Option:	--gy AND (y0,y1 OR filename OR filename,id)
  *
@@ -87,6 +94,31 @@
  * 		As above, exept that projection is made on X axis (gate on 
  * 		Y). 
  * 
+ * -	Option:	--gz AND z0,z1
+ *
+ * 	Description: 
+ *
+ * 		For 3D and 4D histograms only. Gate on Z axis from channel
+ * 		z0 to z1 (including both). For histograms of more then 2
+ * 		dimensions --gx and --gy are also gates on X and Y axes (no
+ * 		polygons). Axes without gate are taken in full range. The
+ * 		histogram is projected on the first axis without gate, unless
+ * 		--proj is used.
+ * 
+ * -	Option:	--gw AND w0,w1
+ *
+ * 	Description: 
+ *
+ * 		For 4D histograms only. As above, gate on W axis.
+ * 
+ * -	Option:	--proj AND axes
+ *
+ * 	Description: 
+ *
+ * 		For 3D and 4D histograms only. Selects one (e.g. z) or two
+ * 		(e.g. xy) of x, y, z, w axes the gated histogram is
+ * 		projected on. Projection on two axes gives 2D output.
+ * 
  * -	Option:	--bg AND x0,x1
  *
  * 	Short: -b
@@ -108,6 +140,26 @@
  * 		above exept that gate is split into two parts x0 to x1 and 
  * 		x2 to x3. 
  * 
+ * -	Option:	--gate-file AND filename
+ *
+ * 	Description: 
+ *
+ * 		For 2D histograms only. Makes many gated projections from 
+ * 		the matrix loaded once. Each line of the file holds axis 
+ * 		(x for gate on X as --gx, y for gate on Y as --gy), gate 
+ * 		limits and optionally limits of one or two background 
+ * 		windows, e.g.:
+ *
+ * 		# axis gate background
+ *
+ * 		x 266 269 272 275
+ *
+ * 		y 100 150 90 95 160 165
+ *
+ * 		Gates are calculated in parallel and written one after 
+ * 		another, separated by two empty lines (use gnuplot 'index' 
+ * 		to select). Options --gx, --gy, --bg and --sbg are ignored.
+ * 
  * -	Option:	--bin AND (bx OR bx,by)
  *
  * 	Short: -B
@@ -138,6 +190,102 @@
  * 		Suppresses bins with zero counts in output (1D Histograms 
  * 		only) 
  * 
+ * -	Option:	--stats
+ *
+ * 	Description: 
+ *
+ * 		Instead of bins prints statistics of the histogram (or of 
+ * 		the result of gates, binning etc.): sum of counts, number 
+ * 		of non-empty bins, min and max number of counts in a bin, 
+ * 		mean (centroid), variance, FWHM estimate (of a single 
+ * 		gaussian peak) and the range of non-empty bins. For 2D 
+ * 		output these are given for X and Y axis.
+ * 
+ * -	Option:	--format AND (text OR raw OR gnuplot-matrix)
+ *
+ * 	Description: 
+ *
+ * 		Output format of 1D and 2D histograms, projections and 
+ * 		gates. Default is text. Raw is binary: 'RHIS', dimension, 
+ * 		number of X and Y bins (uint32), X and Y ranges (double), 
+ * 		then counts (int64, X running fastest), all little-endian. 
+ * 		Gnuplot-matrix is the gnuplot 'binary matrix' of float32.
+ * 		Gates with background subtracted carry uncertainties: 
+ * 		raw 1D output has then 2 Y bins, the second row holding 
+ * 		variances of counts, gnuplot-matrix a second row (y = 1) 
+ * 		holding dN.
+ * 		For binary formats comments and messages go to the standard 
+ * 		error, --every and --zero are ignored.
+ * 
+ * -	Option:	--threads AND n
+ *
+ * 	Description: 
+ *
+ * 		Number of worker threads used for --gate-file, 2D text 
+ * 		output and many his files. Default (0) is the number of 
+ * 		cores.
+ * 
+ * -	Option:	--batch AND (filename OR -)
+ *
+ * 	Description: 
+ *
+ * 		Runs many commands on the histogram file opened once. Each
+ * 		line of the file (or of the standard input if - is given) 
+ * 		holds options as on the command line, '> file' sends the
+ * 		output of the line to the file (standard output is used 
+ * 		otherwise). The histogram file name may be omitted. Empty 
+ * 		lines and lines starting with # are skipped.
+ * 
+ * -	Option:	--output AND pattern
+ *
+ * 	Description: 
+ *
+ * 		Output of each his file goes to file named after the
+ * 		pattern, %n is replaced by the name of the his file without
+ * 		directory and extension, e.g. --output out/%n_1200.txt.
+ * 		Without it outputs of many files are written to the 
+ * 		standard output one after another.
+ * 
+ * -	Option:	--max-reads AND n
+ *
+ * 	Description: 
+ *
+ * 		Maximal number of histograms read from disk at the same 
+ * 		time when many files are processed (default 4, 0 for no 
+ * 		limit).
+ * 
+ * -	Option:	--serve AND socket
+ *
+ * 	Description: 
+ *
+ * 		Runs as a server listening on the Unix domain socket. Each
+ * 		request is a line of options as on the command line, 
+ * 		including the histogram file name. Files are opened on the
+ * 		first request and kept open. The response is a line 
+ * 		'OK n' (or 'ERROR n') followed by n bytes of output (data
+ * 		only for binary formats). Request 'stats' gives latency 
+ * 		statistics, 'quit' closes the connection, 'shutdown' stops
+ * 		the server. Requests are served by --threads workers.
+ * 
+ * -	Option:	--index
+ *
+ * 	Description: 
+ *
+ * 		Does not require histogram id. Builds index file (e.g.
+ * 		run01.hidx next to run01.his) with sum, maximum, number of
+ * 		non-zero channels, box of non-zero channels, checksum and
+ * 		statistics of each histogram and lists it. The index is
+ * 		rebuilt only if his or drr file has changed. When valid it
+ * 		is used by --List, --stats (of whole histogram) and
+ * 		--autocrop instead of reading the data.
+ * 
+ * -	Option:	--autocrop
+ *
+ * 	Description: 
+ *
+ * 		For 2D histograms without gates, output is cropped to the
+ * 		box of non-empty bins.
+ * 
  * -	Option:	--info
  *
  * 	Short: -I
@@ -162,8 +310,9 @@
  * 	Description: 
  *
  * 		Does not require histogram id. As above except that 
- * 		displays number of dimensions for each histogram and marks 
- * 		empty histograms with 'E' letter next to id. 
+ * 		marks empty/non-empty histograms with 'Y/N' and shows number
+ * 		of non-zero channels and sum of each histogram. All data is
+ * 		read, histograms are shared by --threads.
  * 
  * -	Option:	--help
  *
@@ -198,6 +347,11 @@
  *
  *    $ readhis --id 1501 --bin 3 run01.his > 1501.txt
  *
+ *  - Print integral, centroid and width of the peak in the gate on
+ *    histogram 1734, without exporting the spectrum
+ *
+ *    $ readhis --id 1734 --gx 266,269 --bg 272,275 --stats run01.his
+ *
  *  - Display detailed information about 2 dimensional histogram 1734
  *
  *    $ readhis --id 1734 --info run01.his
@@ -239,6 +393,41 @@
  *
  *    $ readhis --id 1734 --gy pol.ban,1 run01.his > ban02.txt
  *
+ *  - As above but for all bananas of pol.ban at once, use gnuplot 'index'
+ *    to plot a selected one.
+ *
+ *    $ readhis --id 1734 --gy pol.ban,all run01.his > bans.txt
+ *
+ *  - Double gate on gamma-gamma-gamma cube 2100, X axis 510 to 512 and
+ *    Y axis 1172 to 1174, projection on Z axis.
+ *
+ *    $ readhis --id 2100 --gx 510,512 --gy 1172,1174 run01.his > dg.txt
+ *
+ *  - Gate on Z axis of cube 2100, projection on XY plane (2D output)
+ *
+ *    $ readhis --id 2100 --gz 1332,1334 --proj xy run01.his > xy.txt
+ *
+ *  - Matrix 1734 in gnuplot binary format, to be plotted with
+ *    gnuplot> plot 'm.bin' binary matrix with image
+ *
+ *    $ readhis --id 1734 --format gnuplot-matrix run01.his > m.bin
+ *
+ *  - Run commands listed in cmd.txt (e.g. '-i 1734 --gx 266,269 > g.txt'
+ *    in each line) on run01.his opened once.
+ *
+ *    $ readhis --batch cmd.txt run01.his
+ *
+ *  - Histogram 1200 of all runs, each to its own file
+ *
+ *    $ readhis --id 1200 --output h1200/%n.txt 'runs/*.his'
+ *
+ *  - Serve requests on socket /tmp/readhis.sock, e.g. send the line
+ *    '-i 1734 --gx 266,269 run01.his' with socat
+ *
+ *    $ readhis --serve /tmp/readhis.sock &
+ *    $ echo '-i 1734 --gx 266,269 run01.his' | 
+ *          socat - UNIX-CONNECT:/tmp/readhis.sock
+ *
  *  - List all histograms in file run02.his and run02.drr, placed in 
  *    a different directory (relative path is ../RUN02/)
  *
@@ -0,0 +1,45 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#ifndef READHISH
+#define READHISH
+
+/**
+ * Public interface of libreadhis (libreadhis.a, libreadhis.so), for
+ * programs reading his/drr files in-process instead of running readhis.
+ * Compile with the flags given by 'pkg-config --cflags --libs readhis'.
+ *
+ * HisDrr - opens his/drr pair, lists histograms (getHisList),
+ *     their description (getHistogramInfo) and data (getHistogram);
+ *     creates new files and fills them (setValue).
+ * Histogram1D, Histogram2D - histograms filled with setDataRaw, with
+ *     gates (gateX, gateY), projections, rebinning, arithmetic and
+ *     statistics.
+ * SparseHistogram2D - the same for mostly empty matrices.
+ * HistogramND - 3D and 4D histograms (gates and projections).
+ * Polygon, BanFile - polygon gates, from text or BAN (damm) files.
+ * GenError, IOError, ArrayError - exceptions thrown on errors.
+ *
+ * The names and signatures above are kept stable within one major
+ * version (READHIS_VERSION_MAJOR, also the soname of libreadhis.so).
+ * Other headers installed with them are internal to readhis.
+ *
+ * See examples/embed.cpp.
+ */
+
+#define READHIS_VERSION_MAJOR 1
+#define READHIS_VERSION_MINOR 0
+
+#include "Exceptions.h"
+#include "DrrBlock.h"
+#include "HisDrr.h"
+#include "Histogram.h"
+#include "SparseHistogram.h"
+#include "HistogramND.h"
+#include "Polygon.h"
+
+#endif
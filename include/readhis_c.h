@@ -0,0 +1,99 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#ifndef READHIS_CH
+#define READHIS_CH
+
+/**
+ * Plain C interface of libreadhis, for callers from C and from other
+ * languages (Python ctypes or cffi, see python/readhis.py).
+ *
+ * Files are used through opaque handles. Functions returning int give
+ * 0 (or a count) on success and -1 on error; functions returning
+ * pointers give NULL on error. The message of the last error of the
+ * calling thread is returned by readhis_error. A handle may be used by
+ * one thread at a time.
+ *
+ * Histogram data is either copied (and widened to 32 bits) into a
+ * buffer given by the caller (readhis_read), or accessed directly in
+ * the his file mapped into memory (readhis_map), without any copy.
+ * Channels are stored with X running fastest.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Opaque handle of opened his/drr pair. */
+typedef struct readhis_file readhis_file;
+
+/** Description of a histogram. */
+typedef struct {
+    /** Histogram id. */
+    int id;
+    /** Number of dimensions (1 to 4). */
+    int dim;
+    /** Size of channel in bytes (2 or 4). */
+    int bytes;
+    /** Number of channels along each axis (1 for unused axes). */
+    unsigned nbin[4];
+    /** First and last channel number along each axis. */
+    int minc[4];
+    int maxc[4];
+    /** Total number of channels. */
+    uint64_t size;
+    /** Title, zero terminated. */
+    char title[41];
+} readhis_info;
+
+/** Opens his file (drr file of the same base name is required). */
+readhis_file* readhis_open(const char* his);
+
+/** Creates new his and drr files with histograms defined in input
+ * file, lines 'id halfWords nBinX nBinY title' (see HisDrr). */
+readhis_file* readhis_create(const char* drr, const char* his,
+                             const char* input);
+
+/** Closes file, handle and mapped data are no longer valid. */
+void readhis_close(readhis_file* file);
+
+/** Returns message of the last error of the calling thread. */
+const char* readhis_error(void);
+
+/** Returns number of histograms. */
+int readhis_count(readhis_file* file);
+
+/** Writes up to n histogram ids to ids, returns number of histograms.*/
+int readhis_list(readhis_file* file, int* ids, int n);
+
+/** Fills description of histogram id. */
+int readhis_info_get(readhis_file* file, int id, readhis_info* info);
+
+/** Copies data of histogram id to buffer of n channels (n must be at
+ * least the size of histogram). */
+int readhis_read(readhis_file* file, int id, uint32_t* buffer, size_t n);
+
+/** Returns pointer to data of histogram id in the his file mapped into
+ * memory, channels are uint16_t or uint32_t (see readhis_info.bytes)
+ * in native (little-endian) order. Valid until readhis_close. Data
+ * written by readhis_write through the same handle may not be seen. */
+const void* readhis_map(readhis_file* file, int id);
+
+/** Replaces data of histogram id by n channels from buffer (n must be
+ * equal to the size of histogram). Values of 2 byte histograms must be
+ * below 65536. */
+int readhis_write(readhis_file* file, int id, const uint32_t* buffer,
+                  size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
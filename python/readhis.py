@@ -0,0 +1,226 @@
+#
+# Copyright Krzysztof Miernik 2012
+# k.a.miernik@gmail.com
+#
+# Distributed under GNU General Public Licence v3
+#
+
+"""Python interface of libreadhis (C API of include/readhis_c.h), using
+ctypes only. numpy is optional: if present, read() and view() return
+numpy arrays shaped (nY, nX) for 2D histograms, otherwise array.array and
+memoryview objects.
+
+The library is looked for in READHIS_LIB (full path), in the directory
+of the source tree (next to python/) and then in the system paths.
+
+    with readhis.File('run.his') as f:
+        for id in f.ids():
+            print(id, f.info(id).title, sum(f.read(id)))
+"""
+
+import array
+import ctypes
+import ctypes.util
+import os
+import weakref
+
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+
+class Info(ctypes.Structure):
+    """Description of a histogram (readhis_info)."""
+    _fields_ = [('id', ctypes.c_int),
+                ('dim', ctypes.c_int),
+                ('bytes', ctypes.c_int),
+                ('nbin', ctypes.c_uint * 4),
+                ('minc', ctypes.c_int * 4),
+                ('maxc', ctypes.c_int * 4),
+                ('size', ctypes.c_uint64),
+                ('_title', ctypes.c_char * 41)]
+
+    @property
+    def title(self):
+        return self._title.decode('latin-1').strip()
+
+    @property
+    def shape(self):
+        """Shape of data, slowest axis first (numpy order)."""
+        return tuple(reversed(self.nbin[:self.dim]))
+
+
+class Error(Exception):
+    pass
+
+
+def _load():
+    names = []
+    if 'READHIS_LIB' in os.environ:
+        names.append(os.environ['READHIS_LIB'])
+    here = os.path.dirname(os.path.abspath(__file__))
+    names.append(os.path.join(os.path.dirname(here), 'libreadhis.so'))
+    found = ctypes.util.find_library('readhis')
+    if found:
+        names.append(found)
+    for name in names:
+        try:
+            return ctypes.CDLL(name)
+        except OSError:
+            pass
+    raise Error('could not load libreadhis, set READHIS_LIB')
+
+
+_lib = _load()
+
+_handle = ctypes.c_void_p
+_lib.readhis_open.argtypes = [ctypes.c_char_p]
+_lib.readhis_open.restype = _handle
+_lib.readhis_create.argtypes = [ctypes.c_char_p] * 3
+_lib.readhis_create.restype = _handle
+_lib.readhis_close.argtypes = [_handle]
+_lib.readhis_close.restype = None
+_lib.readhis_error.argtypes = []
+_lib.readhis_error.restype = ctypes.c_char_p
+_lib.readhis_list.argtypes = [_handle, ctypes.POINTER(ctypes.c_int),
+                              ctypes.c_int]
+_lib.readhis_info_get.argtypes = [_handle, ctypes.c_int,
+                                  ctypes.POINTER(Info)]
+_lib.readhis_read.argtypes = [_handle, ctypes.c_int, ctypes.c_void_p,
+                              ctypes.c_size_t]
+_lib.readhis_map.argtypes = [_handle, ctypes.c_int]
+_lib.readhis_map.restype = ctypes.c_void_p
+_lib.readhis_write.argtypes = [_handle, ctypes.c_int, ctypes.c_void_p,
+                               ctypes.c_size_t]
+
+
+def _check(result):
+    if result is None or result == -1:
+        raise Error(_lib.readhis_error().decode())
+    return result
+
+
+def _path(name):
+    return os.fsencode(name)
+
+
+class File(object):
+    """Opened his/drr pair."""
+
+    def __init__(self, his, _handle=None):
+        if _handle is None:
+            _handle = _check(_lib.readhis_open(_path(his)))
+        self._h = _handle
+        self._info = {}
+        # Buffers of views, they keep this object (and the mapping)
+        # alive, so the handle is closed after the last one is gone
+        self._views = 0
+        self._closed = False
+
+    @classmethod
+    def create(cls, his, definitions, drr=None):
+        """Creates new files, definitions are tuples
+        (id, halfWords, nBinX, nBinY, title), nBinY is 0 for 1D.
+        Data written is readable after the file is closed and reopened.
+        """
+        if drr is None:
+            drr = os.path.splitext(his)[0] + '.drr'
+        input = os.path.splitext(his)[0] + '.input'
+        with open(input, 'w') as f:
+            for d in definitions:
+                f.write('{} {} {} {} {}\n'.format(*d))
+        try:
+            handle = _check(_lib.readhis_create(_path(drr), _path(his),
+                                                _path(input)))
+        finally:
+            os.remove(input)
+        return cls(his, handle)
+
+    def close(self):
+        """Closes file, views still in use stay valid until released."""
+        self._closed = True
+        if self._views == 0:
+            self._release()
+
+    def _viewReleased(self):
+        self._views -= 1
+        if self._closed and self._views == 0:
+            self._release()
+
+    def _release(self):
+        if self._h is not None:
+            _lib.readhis_close(self._h)
+            self._h = None
+
+    def _opened(self):
+        if self._closed:
+            raise Error('file is closed')
+        return self._h
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __del__(self):
+        self._release()
+
+    def ids(self):
+        n = _check(_lib.readhis_list(self._opened(), None, 0))
+        ids = (ctypes.c_int * n)()
+        _check(_lib.readhis_list(self._opened(), ids, n))
+        return list(ids)
+
+    def info(self, id):
+        if id not in self._info:
+            info = Info()
+            _check(_lib.readhis_info_get(self._opened(), id,
+                                         ctypes.byref(info)))
+            self._info[id] = info
+        return self._info[id]
+
+    def read(self, id):
+        """Returns copy of data as 32 bit unsigned integers."""
+        info = self.info(id)
+        if numpy is not None:
+            data = numpy.empty(info.size, dtype=numpy.uint32)
+            pointer = data.ctypes.data
+        else:
+            data = array.array('I', bytes(4 * info.size))
+            pointer = data.buffer_info()[0]
+        _check(_lib.readhis_read(self._opened(), id, pointer, info.size))
+        if numpy is not None:
+            return data.reshape(info.shape)
+        return data
+
+    def view(self, id):
+        """Returns read-only data mapped from the his file, without
+        copy (2 or 4 byte integers as in file). The view keeps the file
+        mapped as long as it exists, also after close()."""
+        info = self.info(id)
+        pointer = _check(_lib.readhis_map(self._opened(), id))
+        buffer = (ctypes.c_char * (info.size * info.bytes)).from_address(
+            pointer)
+        buffer._file = self
+        self._views += 1
+        weakref.finalize(buffer, self._viewReleased)
+        code = 'H' if info.bytes == 2 else 'I'
+        if numpy is not None:
+            data = numpy.frombuffer(buffer, dtype=numpy.dtype(code))
+            data.flags.writeable = False
+            return data.reshape(info.shape)
+        return memoryview(buffer).cast('B').cast(code).toreadonly()
+
+    def write(self, id, data):
+        """Replaces data of histogram (sequence of size channels)."""
+        info = self.info(id)
+        if numpy is not None:
+            buffer = numpy.ascontiguousarray(data, dtype=numpy.uint32)
+            pointer = buffer.ctypes.data
+            n = buffer.size
+        else:
+            buffer = array.array('I', data)
+            pointer, n = buffer.buffer_info()
+        _check(_lib.readhis_write(self._opened(), id, pointer, n))
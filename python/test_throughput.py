@@ -0,0 +1,115 @@
+#
+# Copyright Krzysztof Miernik 2012
+# k.a.miernik@gmail.com
+#
+# Distributed under GNU General Public Licence v3
+#
+
+"""Checks the Python interface against the readhis program and compares
+throughput of getting histogram data as text output of readhis, as copy
+(File.read) and as mapped view (File.view).
+
+Usage: python3 test_throughput.py [path/to/readhis] [nBin of 2D side]
+
+Results are printed one per line as 'method seconds MB/s' (MB of
+channel data, 4 bytes per channel), e.g. for plotting or comparing runs.
+"""
+
+import os
+import random
+import subprocess
+import sys
+import tempfile
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import readhis
+
+
+def text_data(program, his, id):
+    """Returns channel counts of 1D histogram id from readhis output."""
+    out = subprocess.run([program, '--id', str(id), his],
+                         stdout=subprocess.PIPE, check=True).stdout
+    return [int(line.split()[1]) for line in out.decode().splitlines()
+            if line and not line.startswith('#')]
+
+
+def text_sums(program, his):
+    """Returns sums of histograms given by readhis -L."""
+    out = subprocess.run([program, '-L', his],
+                         stdout=subprocess.PIPE, check=True).stdout
+    sums = {}
+    for line in out.decode().splitlines():
+        if line and not line.startswith('#'):
+            fields = line.split()
+            sums[int(fields[0])] = int(fields[4])
+    return sums
+
+
+def best(f, repeat=5):
+    """Returns shortest time of repeat calls of f."""
+    times = []
+    for i in range(repeat):
+        start = time.perf_counter()
+        f()
+        times.append(time.perf_counter() - start)
+    return min(times)
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    program = sys.argv[1] if len(sys.argv) > 1 else \
+        os.path.join(os.path.dirname(here), 'readhis')
+    side = int(sys.argv[2]) if len(sys.argv) > 2 else 1024
+
+    random.seed(2012)
+    spectrum = [random.randrange(0, 1000) for i in range(4096)]
+    matrix = [random.randrange(0, 100000) if random.random() < 0.1 else 0
+              for i in range(side * side)]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        his = os.path.join(tmp, 'test.his')
+        with readhis.File.create(his, [(1, 1, 4096, 0, 'spectrum'),
+                                       (2, 2, side, side, 'matrix')]) as f:
+            f.write(1, spectrum)
+            f.write(2, matrix)
+
+        with readhis.File(his) as f:
+            assert f.ids() == [1, 2]
+            info = f.info(2)
+            assert (info.dim, info.bytes) == (2, 4)
+            assert info.shape == (side, side)
+            assert f.info(1).title == 'spectrum'
+
+            for id, data in ((1, spectrum), (2, matrix)):
+                assert list(f.read(id).ravel()
+                            if readhis.numpy else f.read(id)) == data
+                assert list(f.view(id).ravel()
+                            if readhis.numpy else f.view(id)) == data
+            assert text_data(program, his, 1) == spectrum
+            assert text_sums(program, his) == {1: sum(spectrum),
+                                               2: sum(matrix)}
+
+            try:
+                f.info(3)
+                assert False, 'missing histogram accepted'
+            except readhis.Error:
+                pass
+
+            megabytes = 4 * side * side / 1e6
+            results = [
+                ('text', best(lambda: subprocess.run(
+                    [program, '--id', '2', his],
+                    stdout=subprocess.PIPE, check=True), 3)),
+                ('read', best(lambda: f.read(2))),
+                ('view', best(lambda: f.view(2))),
+                ('view+sum', best(lambda: sum(f.view(2)))),
+            ]
+        for method, seconds in results:
+            print('{} {:.6f} {:.1f}'.format(method, seconds,
+                                            megabytes / seconds))
+    print('OK')
+
+
+if __name__ == '__main__':
+    main()
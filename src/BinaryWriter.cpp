@@ -0,0 +1,166 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <stdint.h>
+#include "BinaryWriter.h"
+#include "Exceptions.h"
+
+BinaryWriter::BinaryWriter(std::ostream& out) : out_(out) {
+    uint16_t one = 1;
+    unsigned char first;
+    std::memcpy(&first, &one, 1);
+    littleEndian_ = (first == 1);
+}
+
+void BinaryWriter::put(const void* data, unsigned long n) {
+    out_.write(static_cast<const char*>(data), n);
+    if (!out_.good())
+        throw IOError("BinaryWriter: write failed");
+}
+
+void BinaryWriter::putLE(unsigned v) {
+    unsigned char b[4];
+    uint32_t u = v;
+    for (unsigned i = 0; i < 4; ++i)
+        b[i] = (u >> (8 * i)) & 0xff;
+    put(b, 4);
+}
+
+void BinaryWriter::putLE(double v) {
+    uint64_t u;
+    std::memcpy(&u, &v, 8);
+    unsigned char b[8];
+    for (unsigned i = 0; i < 8; ++i)
+        b[i] = (u >> (8 * i)) & 0xff;
+    put(b, 8);
+}
+
+void BinaryWriter::putCounts(const long* v, unsigned long n) {
+    if (littleEndian_ && sizeof(long) == 8) {
+        put(v, n * 8);
+        return;
+    }
+
+    // Converted in blocks
+    const unsigned long block = 4096;
+    bytes_.resize(block * 8);
+    for (unsigned long i = 0; i < n; i += block) {
+        unsigned long m = (n - i < block) ? n - i : block;
+        for (unsigned long k = 0; k < m; ++k) {
+            uint64_t u = int64_t(v[i + k]);
+            for (unsigned b = 0; b < 8; ++b)
+                bytes_[k * 8 + b] = (u >> (8 * b)) & 0xff;
+        }
+        put(&bytes_[0], m * 8);
+    }
+}
+
+void BinaryWriter::rawHeader(unsigned dim, unsigned nBinX, unsigned nBinY,
+                             double xMin, double xMax,
+                             double yMin, double yMax) {
+    put("RHIS", 4);
+    putLE(dim);
+    putLE(nBinX);
+    putLE(nBinY);
+    putLE(xMin);
+    putLE(xMax);
+    putLE(yMin);
+    putLE(yMax);
+}
+
+void BinaryWriter::raw(const Histogram1D& h1) {
+    rawHeader(1, h1.getnBinX(), 1, h1.getxMin(), h1.getxMax(), 0, 0);
+    putCounts(h1.getData(), h1.getnBinX());
+}
+
+void BinaryWriter::raw(const Histogram1D& h1, const Histogram1D& variance) {
+    rawHeader(1, h1.getnBinX(), 2, h1.getxMin(), h1.getxMax(), 0, 0);
+    putCounts(h1.getData(), h1.getnBinX());
+    putCounts(variance.getData(), variance.getnBinX());
+}
+
+void BinaryWriter::raw(const Histogram2D& h2) {
+    rawHeader(2, h2.getnBinX(), h2.getnBinY(), h2.getxMin(), h2.getxMax(),
+              h2.getyMin(), h2.getyMax());
+    putCounts(h2.getData(),
+              (unsigned long)h2.getnBinX() * h2.getnBinY());
+}
+
+void BinaryWriter::raw(const SparseHistogram2D& h2) {
+    unsigned szX = h2.getnBinX();
+    unsigned szY = h2.getnBinY();
+    rawHeader(2, szX, szY, h2.getxMin(), h2.getxMax(),
+              h2.getyMin(), h2.getyMax());
+
+    // Rows are expanded one at a time
+    std::vector<long> row(szX);
+    for (unsigned y = 0; y < szY; ++y) {
+        std::fill(row.begin(), row.end(), 0);
+        for (unsigned long k = h2.rowBegin(y); k < h2.rowEnd(y); ++k)
+            row[h2.column(k)] = h2.count(k);
+        putCounts(row.data(), szX);
+    }
+}
+
+void BinaryWriter::matrixHeader(const Histogram& h) {
+    unsigned szX = h.getnBinX();
+    row_.resize(szX + 1);
+    row_[0] = float(szX);
+    for (unsigned x = 0; x < szX; ++x)
+        row_[x + 1] = float(h.getX(x));
+    put(row_.data(), row_.size() * sizeof(float));
+}
+
+void BinaryWriter::matrixRow(float y, const long* v, unsigned n) {
+    row_.resize(n + 1);
+    row_[0] = y;
+    for (unsigned x = 0; x < n; ++x)
+        row_[x + 1] = float(v[x]);
+    put(row_.data(), row_.size() * sizeof(float));
+}
+
+void BinaryWriter::matrix(const Histogram1D& h1) {
+    matrixHeader(h1);
+    matrixRow(0, h1.getData(), h1.getnBinX());
+}
+
+void BinaryWriter::matrix(const Histogram1D& h1,
+                          const Histogram1D& variance) {
+    matrixHeader(h1);
+    matrixRow(0, h1.getData(), h1.getnBinX());
+    unsigned szX = variance.getnBinX();
+    row_.resize(szX + 1);
+    row_[0] = 1;
+    for (unsigned x = 0; x < szX; ++x)
+        row_[x + 1] = float(std::sqrt(double(variance[x])));
+    put(row_.data(), row_.size() * sizeof(float));
+}
+
+void BinaryWriter::matrix(const Histogram2D& h2) {
+    unsigned szX = h2.getnBinX();
+    unsigned szY = h2.getnBinY();
+    matrixHeader(h2);
+    const long* v = h2.getData();
+    for (unsigned y = 0; y < szY; ++y)
+        matrixRow(float(h2.getY(y)), v + (unsigned long)y * szX, szX);
+}
+
+void BinaryWriter::matrix(const SparseHistogram2D& h2) {
+    unsigned szX = h2.getnBinX();
+    unsigned szY = h2.getnBinY();
+    matrixHeader(h2);
+    std::vector<long> row(szX);
+    for (unsigned y = 0; y < szY; ++y) {
+        std::fill(row.begin(), row.end(), 0);
+        for (unsigned long k = h2.rowBegin(y); k < h2.rowEnd(y); ++k)
+            row[h2.column(k)] = h2.count(k);
+        matrixRow(float(h2.getY(y)), row.data(), szX);
+    }
+}
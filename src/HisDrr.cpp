@@ -11,6 +11,12 @@
 #include <cstdlib>
 #include <sstream>
 #include <ctime>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <stdint.h>
 #include "HisDrr.h"
 #include "DrrBlock.h"
 #include "Exceptions.h"
@@ -18,6 +24,38 @@
 
 using namespace std;
 
+namespace {
+    /** Limit of concurrent reads (see HisDrr::setMaxReads). */
+    unsigned maxReads = 0;
+    unsigned nReads = 0;
+    mutex readMutex;
+    condition_variable readDone;
+
+    /** Holds one of the allowed concurrent reads while in scope. */
+    class ReadSlot {
+        public:
+            ReadSlot() {
+                unique_lock<mutex> lock(readMutex);
+                readDone.wait(lock, [] () {
+                    return maxReads == 0 || nReads < maxReads;
+                });
+                ++nReads;
+            }
+
+            ~ReadSlot() {
+                lock_guard<mutex> lock(readMutex);
+                --nReads;
+                readDone.notify_one();
+            }
+    };
+}
+
+void HisDrr::setMaxReads(unsigned n) {
+    lock_guard<mutex> lock(readMutex);
+    maxReads = n;
+    readDone.notify_all();
+}
+
 HisDrr::HisDrr(fstream* drr, fstream* his) {
     /* test of size of int and short
      * Potential portability issue.
@@ -70,6 +108,7 @@ HisDrr::HisDrr(const string &drr, const string &his) {
     }
 
     hisFile = new fstream(his.c_str(), fstream::binary | fstream::in | fstream::out);
+    hisName = his;
     if (!hisFile->good()) {
         stringstream err;
         err << "HisDrr:3: Could not open file " << his;
@@ -134,6 +173,7 @@ HisDrr::HisDrr(const string &drr, const string &his, const string &input) {
 
     drrFile = new fstream(drr.c_str(), fstream::binary | fstream::in | fstream::out | fstream::trunc);
     hisFile = new fstream(his.c_str(), fstream::binary | fstream::in | fstream::out | fstream::trunc);
+    hisName = his;
 
     if (!drrFile->good()) {
         stringstream err;
@@ -153,7 +193,7 @@ HisDrr::HisDrr(const string &drr, const string &his, const string &input) {
 
     // Using information from drrData drr header is created
     DrrHeader head;
-    int totLength;
+    int totLength = 0;
     for (unsigned int i = 0; i < drrData.size(); ++i) 
         totLength += (drrData[i].scaled[0]+drrData[i].scaled[1])*drrData[i].halfWords; 
     // Magic words (whatever they do...)
@@ -347,71 +387,76 @@ void HisDrr::loadDrr() {
 }
 
 void HisDrr::getHistogram(vector<unsigned int> &rtn, int id) {
-    // First we search if histogram id exists
-    int index = -1;
-    for (unsigned int i = 0; i < hisList.size(); ++i)
-        if (hisList[i].hisID == id) {
-            index = i;
-            break;
-        }
-    if (index < 0) {
-        stringstream err;
-        err << "HisDrr:12: Could not find spectrum id = " << id << " in drr file";
-        string msg = err.str();
-        throw GenError(msg);
-    }
-   
+    unsigned index = findIndex(id);
+
     // Return vector (see swap at the end)
     vector<unsigned int> r;
-
     if (hisFile->good()) {
-        // Set position of pointer in file to the beginning
-        hisFile->seekg(0, ios::beg);
-        // We jump to location specified by offset (given in units of 2 bytes)
-        hisFile->seekg(hisList[index].offset*2);
-        // Lenght of data is equal to product of all histogram dimensions lengths
-        unsigned int length = 1;
+        unsigned long length = 1;
         for (int i = 0; i < hisList[index].hisDim; ++i)
             length = length * hisList[index].scaled[i];
-        
-        // Since we know now the length of data, we can reserve space
-        // for vector avoiding unecessary data movement in memory
-        r.reserve(length);
-
-        // New version with direct read to array + assign to vector
-        //
-        // We read whole dataset to a array of calculated before length
-        // Then the array is assigned to a return vector
-        // Array is deleted
-        // Is approx. 4 times faster then old version
-        //
-        // We have to check if size (halfWords) of data matches used data type
-        // for array.
-        // This could be potential issue with portability
-        
-        if (hisList[index].halfWords * 2 == sizeof(unsigned short)) {
+        r.resize(length);
+        readData(index, r.data(), length);
+    }
+    rtn.swap(r);
+}
 
-            unsigned short* u = new unsigned short[length];
-            hisFile->read((char*)u, length * hisList[index].halfWords * 2);
-            r.assign(u, u + length);
-            delete []u;
+void HisDrr::getHistogram(unsigned int* rtn, unsigned long n, int id) {
+    readData(findIndex(id), rtn, n);
+}
 
-        } else if (hisList[index].halfWords * 2 == sizeof(unsigned int))  {
+void HisDrr::readData(unsigned index, unsigned int* rtn, unsigned long n) {
+    int id = hisList[index].hisID;
 
-            unsigned int* u = new unsigned int[length];
-            hisFile->read((char*)u, length * hisList[index].halfWords * 2);
-            r.assign(u, u + length);
-            delete []u;
+    // Lenght of data is equal to product of all histogram dimensions lengths
+    unsigned long length = 1;
+    for (int i = 0; i < hisList[index].hisDim; ++i)
+        length = length * hisList[index].scaled[i];
+    if (n < length) {
+        stringstream err;
+        err << "HisDrr:29: Buffer of " << n << " channels is too small for"
+            << " histogram id " << id << " of " << length << " channels";
+        string msg = err.str();
+        throw GenError(msg);
+    }
 
-        } else {
-            stringstream err;
-            err << "HisDrr:13: Histograms with channel size " << hisList[index].halfWords*2
-                << " bytes long are not supported ";
-            string msg = err.str();
-            throw GenError(msg);
+    unsigned width = hisList[index].halfWords * 2;
+    if (width != sizeof(unsigned short) && width != sizeof(unsigned int)) {
+        stringstream err;
+        err << "HisDrr:13: Histograms with channel size " << width
+            << " bytes long are not supported ";
+        string msg = err.str();
+        throw GenError(msg);
+    }
+
+    ReadSlot slot;
+    // Set position of pointer in file to the beginning
+    hisFile->seekg(0, ios::beg);
+    // We jump to location specified by offset (given in units of 2 bytes)
+    hisFile->seekg(streamoff(hisList[index].offset) * 2);
+
+    // Data is read directly to rtn; 2 byte channels are read to its
+    // upper half and widened in place going forward, channel i is
+    // written only after all channels it overlaps are read
+    unsigned char* bytes = reinterpret_cast<unsigned char*>(rtn);
+    unsigned long skip = (width == sizeof(unsigned short)) ? 2 * length : 0;
+    hisFile->read((char*)bytes + skip, length * width);
+    if (!hisFile->good()) {
+        hisFile->clear();
+        stringstream err;
+        err << "HisDrr:30: Could not read data of histogram id " << id
+            << " from his file";
+        string msg = err.str();
+        throw IOError(msg);
+    }
+
+    if (width == sizeof(unsigned short)) {
+        for (unsigned long i = 0; i < length; ++i) {
+            unsigned short v;
+            memcpy(&v, bytes + skip + i * 2, sizeof(v));
+            rtn[i] = v;
         }
     }
-    rtn.swap(r);
 }
 
 DrrHisRecordExtended HisDrr::getHistogramInfo(int id) const {
@@ -438,6 +483,150 @@ void HisDrr::getHisList(vector<int> &r) {
         r.push_back(hisList[i].hisID);
 }
 
+unsigned HisDrr::findIndex(int id) const {
+    for (unsigned int i = 0; i < hisList.size(); ++i)
+        if (hisList[i].hisID == id)
+            return i;
+    stringstream err;
+    err << "HisDrr:27: Could not find spectrum id = " << id << " in drr file";
+    string msg = err.str();
+    throw GenError(msg);
+}
+
+namespace {
+    /** Size of block of his file read at once by scanData (bytes). */
+    const unsigned long scanBlock = 1 << 20;
+
+    /** Adds n channels of type T (from buffer) to summary. Channels
+     * are copied out of the char buffer (memcpy), not read through a
+     * cast pointer, which would break aliasing rules. */
+    template <typename T>
+    void addChannels(const char* buffer, unsigned long n, HisSummary& s) {
+        for (unsigned long i = 0; i < n; ++i) {
+            T v;
+            memcpy(&v, buffer + i * sizeof(T), sizeof(T));
+            if (v != 0) {
+                ++s.nonZero;
+                s.sum += v;
+            }
+        }
+    }
+
+    /** Returns true if any of n bytes of buffer is not zero. The bytes
+     * are OR-reduced as 64 bit words (n is rounded up to whole words,
+     * buffer must be padded with zeros). */
+    bool anyNonZero(const char* buffer, unsigned long n) {
+        unsigned long nWords = (n + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        uint64_t any = 0;
+        for (unsigned long i = 0; i < nWords; ++i) {
+            uint64_t word;
+            memcpy(&word, buffer + i * sizeof(uint64_t), sizeof(word));
+            any |= word;
+        }
+        return any != 0;
+    }
+
+    /** Scans n channels of width bytes starting at offset of his file.
+     * Blocks are first checked for non-zero bytes, so the channels of
+     * empty blocks are not looked at. */
+    void scanData(istream& his, streamoff offset, unsigned long n,
+                  unsigned width, HisSummary& s) {
+        s.empty = true;
+        s.nonZero = 0;
+        s.sum = 0;
+
+        // Padded to whole 64 bit words for anyNonZero
+        vector<char> buffer(scanBlock + sizeof(uint64_t));
+        his.clear();
+        his.seekg(offset);
+
+        unsigned long left = n * width;
+        while (left > 0) {
+            unsigned long bytes = min(left, scanBlock);
+            memset(&buffer[bytes], 0, sizeof(uint64_t));
+            his.read(&buffer[0], bytes);
+            if ((unsigned long)(his.gcount()) != bytes) {
+                stringstream err;
+                err << "HisDrr:26: Could not read data from his file at "
+                    << offset;
+                string msg = err.str();
+                throw IOError(msg);
+            }
+            left -= bytes;
+
+            if (!anyNonZero(&buffer[0], bytes))
+                continue;
+
+            s.empty = false;
+            if (width == sizeof(unsigned short))
+                addChannels<unsigned short>(&buffer[0], bytes / width, s);
+            else
+                addChannels<unsigned int>(&buffer[0], bytes / width, s);
+        }
+    }
+}
+
+void HisDrr::scanHistograms(const vector<int> &ids,
+                            vector<HisSummary> &summary, unsigned nThreads) {
+    unsigned nIds = ids.size();
+    vector<unsigned> index(nIds);
+    for (unsigned i = 0; i < nIds; ++i) {
+        index[i] = findIndex(ids[i]);
+        unsigned width = hisList[index[i]].halfWords * 2;
+        if (width != sizeof(unsigned short) && 
+            width != sizeof(unsigned int)) {
+            stringstream err;
+            err << "HisDrr:28: Histograms with channel size " << width
+                << " bytes long are not supported ";
+            string msg = err.str();
+            throw GenError(msg);
+        }
+    }
+    summary.resize(nIds);
+
+    // Without file name (user given streams) only the own stream may
+    // be used
+    if (hisName.empty())
+        nThreads = 1;
+    nThreads = max(1u, min(nThreads, nIds));
+
+    vector<string> errors(nIds);
+    atomic<unsigned> next(0);
+    auto worker = [&] (istream& his) {
+        for (unsigned i = next++; i < nIds; i = next++) {
+            const DrrHisRecordExtended& h = hisList[index[i]];
+            unsigned long length = 1;
+            for (int d = 0; d < h.hisDim; ++d)
+                length *= h.scaled[d];
+            try {
+                ReadSlot slot;
+                scanData(his, streamoff(h.offset) * 2, length,
+                         h.halfWords * 2, summary[i]);
+            } catch (GenError &err) {
+                errors[i] = err.show();
+            }
+        }
+    };
+
+    if (nThreads == 1) {
+        worker(*hisFile);
+    } else {
+        vector<thread> threads;
+        for (unsigned t = 0; t < nThreads; ++t) {
+            threads.push_back(thread([&] () {
+                ifstream his(hisName.c_str(), ios::in | ios::binary);
+                worker(his);
+            }));
+        }
+        for (unsigned t = 0; t < threads.size(); ++t)
+            threads[t].join();
+    }
+
+    for (unsigned i = 0; i < nIds; ++i)
+        if (!errors[i].empty())
+            throw GenError(errors[i]);
+}
+
 void HisDrr::zeroHistogram(int id) {
     // First we search if histogram id exists
     int index = -1;
@@ -458,7 +647,7 @@ void HisDrr::zeroHistogram(int id) {
         // Set position of pointer in file to the beginning
         hisFile->seekg(0, ios::beg);
         // We jump to location specified by offset (given in units of 2 bytes)
-        hisFile->seekp(hisList[index].offset*2);
+        hisFile->seekp(streamoff(hisList[index].offset) * 2);
         // Lenght of data is equal to product of all histogram dimensions lengths
         unsigned int length = 1;
         for (int i = 0; i < hisList[index].hisDim; ++i)
@@ -502,7 +691,7 @@ void HisDrr::setValue(const int id, unsigned pos, unsigned value){
         // Set position of pointer in file to the beginning
         hisFile->seekg(0, ios::beg);
         // We jump to location specified by offset (given in units of 2 bytes) plus i
-        hisFile->seekp(hisList[index].offset*2 + pos*hisList[index].halfWords*2);
+        hisFile->seekp(streamoff(hisList[index].offset) * 2 + streamoff(pos) * hisList[index].halfWords * 2);
         // Lenght of data is equal to product of all histogram dimensions lengths
         unsigned int length = 1;
         for (int i = 0; i < hisList[index].hisDim; ++i)
@@ -546,7 +735,7 @@ void HisDrr::setValue(const int id, unsigned pos, unsigned short value){
         // Set position of pointer in file to the beginning
         hisFile->seekg(0, ios::beg);
         // We jump to location specified by offset (given in units of 2 bytes) plus i
-        hisFile->seekp(hisList[index].offset*2 + pos*hisList[index].halfWords*2);
+        hisFile->seekp(streamoff(hisList[index].offset) * 2 + streamoff(pos) * hisList[index].halfWords * 2);
         // Lenght of data is equal to product of all histogram dimensions lengths
         unsigned int length = 1;
         for (int i = 0; i < hisList[index].hisDim; ++i)
@@ -588,7 +777,7 @@ void HisDrr::setValue(const int id, vector<unsigned> &value){
         // Set position of pointer in file to the beginning
         hisFile->seekg(0, ios::beg);
         // We jump to location specified by offset (given in units of 2 bytes) plus pos
-        hisFile->seekp(hisList[index].offset*2);
+        hisFile->seekp(streamoff(hisList[index].offset) * 2);
         // Lenght of data is equal to product of all histogram dimensions lengths
         unsigned int length = 1;
         for (int i = 0; i < hisList[index].hisDim; ++i)
@@ -642,7 +831,7 @@ void HisDrr::setValue(const int id, vector<unsigned short> &value){
         // Set position of pointer in file to the beginning
         hisFile->seekg(0, ios::beg);
         // We jump to location specified by offset (given in units of 2 bytes) plus pos
-        hisFile->seekp(hisList[index].offset*2);
+        hisFile->seekp(streamoff(hisList[index].offset) * 2);
         // Lenght of data is equal to product of all histogram dimensions lengths
         unsigned int length = 1;
         for (int i = 0; i < hisList[index].hisDim; ++i)
@@ -8,13 +8,25 @@
 #include <string> 
 #include <cmath> 
 #include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <exception>
+#include <system_error>
 #include "DrrBlock.h"
 #include "HisDrr.h"
 #include "Histogram.h"
+#include "SparseHistogram.h"
+#include "HistogramND.h"
 #include "Exceptions.h"
 #include "Options.h"
 #include "HisDrrHisto.h"
 #include "Polygon.h"
+#include "TextWriter.h"
+#include "BinaryWriter.h"
 #include "Debug.h"
 
 using namespace std;
@@ -23,104 +35,270 @@ HisDrrHisto::HisDrrHisto(const string drr, const string his,
                          const Options* options)
                         : HisDrr(drr, his) {
     options_ = options;
+    drrName_ = drr;
+    hisName_ = his;
+    out_ = &cout;
+    binaryOutput_ = &cout;
 }
 
 void HisDrrHisto::runListMode(bool more) {
     vector<int> list;
     getHisList(list);
-    cout.setf(ios::left, ios::adjustfield);
-    cout << setw (12) << "# Histogram"
+
+    // Emptiness, number of non-zero channels and sum are found by
+    // scanning the his file, histograms are shared by worker threads
+    vector<HisSummary> summary;
+    if (more) {
+        // Valid index answers without reading the data
+        HisIndex index(drrName_, hisName_);
+        bool indexed = index.load();
+        for (unsigned i = 0; indexed && i < list.size(); ++i) {
+            const IndexEntry* entry = index.find(list[i]);
+            if (entry == 0) {
+                indexed = false;
+                break;
+            }
+            HisSummary s;
+            s.empty = (entry->nonZero == 0);
+            s.nonZero = entry->nonZero;
+            s.sum = entry->sum;
+            summary.push_back(s);
+        }
+        if (!indexed) {
+            summary.clear();
+            scanHistograms(list, summary, workerThreads(list.size()));
+        }
+    }
+
+    out_->setf(ios::left, ios::adjustfield);
+    *out_ << setw (12) << "# Histogram"
          << setw (7)  << "Empty?"
-         << setw (4)  << "Dim"
-         << setw (50) << "Title"
+         << setw (4)  << "Dim";
+    if (more)
+        *out_ << setw (12) << "Non-zero"
+              << setw (16) << "Sum";
+    *out_ << setw (50) << "Title"
          << endl;
-    for (vector<int>::iterator itl = list.begin();
-            itl != list.end();
-            ++itl) {
+    for (unsigned i = 0; i < list.size(); ++i) {
         char emptiness = '?';
-        info = getHistogramInfo(*itl);
-        if (more) {
-            vector<unsigned int> d;
-            getHistogram(d, *itl);
-            bool empty = true;
-            for (vector<unsigned int>::iterator it = d.begin();
-                    it != d.end();
-                    ++it) {
-                if (*it > 0) {
-                    empty = false;
-                    break;
-                }
-            }
-            if (empty)
-                emptiness = 'Y';
-            else
-                emptiness = 'N';
-        }
+        info = getHistogramInfo(list[i]);
+        if (more)
+            emptiness = summary[i].empty ? 'Y' : 'N';
         // Removes junk characters at the end of the info.title 
         string title(info.title, sizeof(info.title) / sizeof(char));
-        cout << setw (12) << info.hisID
+        *out_ << setw (12) << info.hisID
              << setw (7)  << emptiness
-             << setw (4)  << info.hisDim
-             << setw (50) << title
+             << setw (4)  << info.hisDim;
+        if (more)
+            *out_ << setw (12) << summary[i].nonZero
+                  << setw (16) << summary[i].sum;
+        *out_ << setw (50) << title
              << endl;
     }
-    cout << endl;
-    cout.setf(ios::internal, ios::adjustfield);
+    *out_ << endl;
+    out_->setf(ios::internal, ios::adjustfield);
+}
+
+void HisDrrHisto::buildIndex(HisIndex& index) {
+    vector<int> list;
+    getHisList(list);
+    for (unsigned i = 0; i < list.size(); ++i) {
+        DrrHisRecordExtended h = getHistogramInfo(list[i]);
+        vector<unsigned> data;
+        getHistogram(data, h.hisID);
+
+        IndexEntry entry;
+        vector<unsigned> nBin;
+        for (int d = 0; d < h.hisDim; ++d)
+            nBin.push_back(h.scaled[d]);
+        HisIndex::summarize(data, nBin, h.halfWords * 2, entry);
+        entry.hisID = h.hisID;
+
+        // Statistics as calculated by process1D and process2D
+        if (h.hisDim == 1) {
+            Histogram1D h1(h.minc[0], h.maxc[0] + 1, h.scaled[0], "");
+            h1.setDataRaw(data);
+            entry.stats = h1.statistics();
+            entry.hasStats = true;
+        } else if (h.hisDim == 2) {
+            if (SparseHistogram2D::preferSparse(entry.nonZero, 
+                                                data.size())) {
+                SparseHistogram2D h2(h.minc[0], h.maxc[0] + 1,
+                                     h.minc[1], h.maxc[1] + 1,
+                                     h.scaled[0], h.scaled[1], "");
+                h2.setDataRaw(data);
+                entry.stats = h2.statistics();
+            } else {
+                Histogram2D h2(h.minc[0], h.maxc[0] + 1,
+                               h.minc[1], h.maxc[1] + 1,
+                               h.scaled[0], h.scaled[1], "");
+                h2.setDataRaw(data);
+                entry.stats = h2.statistics();
+            }
+            entry.hasStats = true;
+        }
+        index.add(entry);
+    }
+}
+
+void HisDrrHisto::runIndexMode() {
+    HisIndex index(drrName_, hisName_);
+    if (index.load()) {
+        *out_ << "# Index: " << index.getFileName() << " (up to date)" 
+              << endl;
+    } else {
+        buildIndex(index);
+        try {
+            index.save();
+            *out_ << "# Index: " << index.getFileName() << " (written)" 
+                  << endl;
+        } catch (IOError &err) {
+            *out_ << "# Index not saved: " << err.show() << endl;
+        }
+    }
+
+    out_->setf(ios::left, ios::adjustfield);
+    *out_ << setw (12) << "# Histogram"
+          << setw (4)  << "Dim"
+          << setw (12) << "Non-zero"
+          << setw (16) << "Sum"
+          << setw (12) << "Max"
+          << setw (18) << "Checksum"
+          << "Box" << endl;
+    const vector<IndexEntry>& entries = index.getEntries();
+    for (unsigned i = 0; i < entries.size(); ++i) {
+        const IndexEntry& e = entries[i];
+        stringstream checksum;
+        checksum << hex << setw(16) << setfill('0') << e.checksum;
+        *out_ << setw (12) << e.hisID
+              << setw (4)  << e.dim
+              << setw (12) << e.nonZero
+              << setw (16) << e.sum
+              << setw (12) << e.max
+              << setw (18) << checksum.str();
+        if (e.nonZero == 0)
+            *out_ << "-";
+        for (unsigned d = 0; e.nonZero > 0 && d < e.dim; ++d)
+            *out_ << (d > 0 ? "," : "") << e.boxLow[d] << ":" 
+                  << e.boxHigh[d];
+        *out_ << endl;
+    }
+    *out_ << endl;
+    out_->setf(ios::internal, ios::adjustfield);
+}
+
+bool HisDrrHisto::indexStats() {
+    if (!options_->getStats() || info.hisDim > 2 || 
+        options_->getGx() || options_->getGy() || options_->getBin() ||
+        options_->getAutoCrop() || !options_->getGateFile().empty())
+        return false;
+
+    HisIndex index(drrName_, hisName_);
+    if (!index.load())
+        return false;
+    const IndexEntry* entry = index.find(info.hisID);
+    if (entry == 0 || !entry->hasStats)
+        return false;
+    printStatistics(entry->stats, info.hisDim);
+    return true;
 }
 
 void HisDrrHisto::runInfoMode() {
-    cout << "#ID: " << info.hisID << endl;
-    cout << "#hisDim: " << info.hisDim << endl;
-    cout << "#halfWords: " << info.halfWords << endl;
+    *out_ << "#ID: " << info.hisID << endl;
+    *out_ << "#hisDim: " << info.hisDim << endl;
+    *out_ << "#halfWords: " << info.halfWords << endl;
     for (int j = 0; j < 4; ++j)
-        cout << "#params[" << j << "]: " << info.params[j] << endl;
+        *out_ << "#params[" << j << "]: " << info.params[j] << endl;
     for (int j = 0; j < 4; ++j)
-        cout << "#raw[" << j << "]: " << info.raw[j] << endl;
+        *out_ << "#raw[" << j << "]: " << info.raw[j] << endl;
     for (int j = 0; j < 4; ++j)
-        cout << "#scaled[" << j << "]: " << info.scaled[j] << endl;
+        *out_ << "#scaled[" << j << "]: " << info.scaled[j] << endl;
     for (int j = 0; j < 4; ++j)
-        cout << "#minc[" << j << "]: " << info.minc[j] << endl;
+        *out_ << "#minc[" << j << "]: " << info.minc[j] << endl;
     for (int j = 0; j < 4; ++j)
-        cout << "#maxc[" << j << "]: " << info.maxc[j] << endl;
+        *out_ << "#maxc[" << j << "]: " << info.maxc[j] << endl;
 
-    cout << "#offset: " << info.offset << endl;
-    cout << "#xlabel: " << info.xlabel << endl;
-    cout << "#ylabel: " << info.ylabel << endl;
+    *out_ << "#offset: " << info.offset << endl;
+    *out_ << "#xlabel: " << info.xlabel << endl;
+    *out_ << "#ylabel: " << info.ylabel << endl;
 
     for (int j = 0; j < 4; ++j)
-        cout << "#calcon[" << j << "]: " << info.calcon[j] << endl;
+        *out_ << "#calcon[" << j << "]: " << info.calcon[j] << endl;
 
-    cout << "#title: " << info.title << endl;
+    *out_ << "#title: " << info.title << endl;
 }
 
 void HisDrrHisto::process1D() {
     // maxc + 1 because drr has bins numbered 0 to maxc 
     // but size then is maxc+ 1
-    histogram = new Histogram1D(info.minc[0], info.maxc[0] + 1,
-                                info.scaled[0], "");
+    unique_ptr<Histogram1D> h1(new Histogram1D(info.minc[0],
+                                               info.maxc[0] + 1,
+                                               info.scaled[0], ""));
 
     vector<unsigned> data;
     data.reserve(info.scaled[0]);
     //Load data from his file
     getHistogram(data, info.hisID);
-    histogram->setDataRaw(data);
-
-    Histogram1D* h1 = dynamic_cast<Histogram1D*>(histogram);
+    h1->setDataRaw(data);
 
     if (options_->getBin()) {
-        Histogram1D* h1b;
         vector<unsigned> bin;
         options_->getBinning(bin);
         if (bin[0] > 1) {
             double binW = h1->getBinWidthX() * bin[0];
-            h1b = h1->rebin(h1->getxMin(), h1->getxMax(), binW);
-            (*h1) = (*h1b);
-            delete h1b;
+            h1->rebinInPlace(h1->getxMin(), h1->getxMax(), binW);
         } else if (bin[0] <= 0)
             throw GenError("HisDrrHisto::process1D : Wrong binning size.");
 
     }
 
+    print1D(*h1);
+}
+
+template <class H>
+bool HisDrrHisto::printBinary(const H& h) {
+    switch (options_->getFormat()) {
+        case formatRaw: {
+            BinaryWriter out(*binaryOutput_);
+            out.raw(h);
+            return true;
+        }
+        case formatGnuplotMatrix: {
+            BinaryWriter out(*binaryOutput_);
+            out.matrix(h);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+bool HisDrrHisto::printBinary(const Histogram1D& h,
+                              const Histogram1D& variance) {
+    switch (options_->getFormat()) {
+        case formatRaw: {
+            BinaryWriter out(*binaryOutput_);
+            out.raw(h, variance);
+            return true;
+        }
+        case formatGnuplotMatrix: {
+            BinaryWriter out(*binaryOutput_);
+            out.matrix(h, variance);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+void HisDrrHisto::print1D(const Histogram1D& h1) {
+    if (options_->getStats()) {
+        printStatistics(h1.statistics(), 1);
+        return;
+    }
+    if (printBinary(h1))
+        return;
+
     unsigned nth = 1;
     if (options_->getEvery()) {
         vector<unsigned> every;
@@ -128,29 +306,44 @@ void HisDrrHisto::process1D() {
         nth = every[0];
     }
     
-    cout << "#X  N  dN" << endl;
-    unsigned sz = h1->getnBinX();
+    TextWriter out(*out_);
+    out << "#X  N  dN\n";
+    unsigned sz = h1.getnBinX();
     if (options_->getZeroSup()) {
         for (unsigned i = 0; i < sz; i += nth)
-            if ((*h1)[i] != 0 )
-                cout << h1->getX(i) << " " << (*h1)[i] << " " 
-                     << sqrt( (*h1)[i] ) << endl;
+            if (h1[i] != 0 )
+                out << h1.getX(i) << ' ' << h1[i] << ' ' 
+                    << sqrt( h1[i] ) << '\n';
     } else {
         for (unsigned i = 0; i < sz; i += nth)
-            cout << h1->getX(i) << " " << (*h1)[i] 
-                 << " " << sqrt( (*h1)[i] )    << endl;
+            out << h1.getX(i) << ' ' << h1[i] 
+                << ' ' << sqrt( h1[i] ) << '\n';
     }
-    delete histogram;
 }
 
-void HisDrrHisto::process2Dgate() {
-    Histogram2D* h2 = dynamic_cast<Histogram2D*>(histogram);
-
-    // Resulting projection
-    Histogram1D* proj;
-    // Uncertainities are going to be stored in a separate histogram
-    Histogram1D* projErr;
+void HisDrrHisto::printStatistics(const HistogramStatistics& stats,
+                                  unsigned short dim) {
+    // Gaussian peak FWHM = 2 sqrt(2 ln 2) sigma
+    const double fwhmSigma = 2.0 * sqrt(2.0 * log(2.0));
+    const char* axis[2] = {"X", "Y"};
+
+    *out_ << "#sum: " << stats.sum << endl;
+    *out_ << "#nonzero: " << stats.nonZero << endl;
+    *out_ << "#min: " << stats.min << endl;
+    *out_ << "#max: " << stats.max << endl;
+    for (unsigned d = 0; d < dim; ++d) {
+        string a = (dim > 1) ? axis[d] : "";
+        *out_ << "#mean" << a << ": " << stats.mean[d] << endl;
+        *out_ << "#variance" << a << ": " << stats.variance[d] << endl;
+        *out_ << "#fwhm" << a << ": " 
+             << fwhmSigma * sqrt(stats.variance[d]) << endl;
+        *out_ << "#low" << a << ": " << stats.low[d] << endl;
+        *out_ << "#high" << a << ": " << stats.high[d] << endl;
+    }
+}
 
+template <class H2>
+void HisDrrHisto::process2Dgate(H2* h2) {
     bool gx = options_->getGx();
     bool gy = options_->getGy();
     bool bg = options_->getBg();
@@ -165,95 +358,192 @@ void HisDrrHisto::process2Dgate() {
     if (gate.size() < 2)
         throw GenError("process2D: Not enough gate points");
 
-    if (gx) {
-        proj = h2->gateX(gate[0], gate[1]);
-        projErr = h2->gateX(gate[0], gate[1]);
-    } else {
-        proj = h2->gateY(gate[0], gate[1]);
-        projErr = h2->gateY(gate[0], gate[1]);
-    }
-
+    // Background gates limits
+    vector<double> background;
     if (bg || sbg){
         //--gy/gx --bg
         vector<unsigned> bgr;
         options_->getBgGate(bgr);
-        Histogram1D* projBg;
 
         if (bgr.size() >= 2) {
-            if (gx)
-                projBg = h2->gateX(bgr[0], bgr[1]);
-            else
-                projBg = h2->gateY(bgr[0], bgr[1]);
-
-            *proj -= *projBg;
-            *projErr += *projBg;
+            background.push_back(bgr[0]);
+            background.push_back(bgr[1]);
         } else
             throw GenError("process2D: Not enough background gate points");
 
         if (sbg) {
             //--gy/gx --sbg
             if (bgr.size() >= 4) {
-                if (gx)
-                    projBg = h2->gateX(bgr[2], bgr[3]);
-                else
-                    projBg = h2->gateY(bgr[2], bgr[3]);
-
-                *proj -= *projBg;
-                *projErr += *projBg;
+                background.push_back(bgr[2]);
+                background.push_back(bgr[3]);
             } else
                 throw GenError("process2D: Not enough split background gate points");
         }
+    }
+
+    // Resulting projection and its uncertainities (variance), gate and
+    // background are projected in a single pass
+    Histogram1D proj(0.0, 1.0, 1, "");
+    Histogram1D projErr(0.0, 1.0, 1, "");
+    h2->projectWithBackground(proj, projErr, gx, gate[0], gate[1],
+                              background);
+    printGate(proj, projErr, gx, !background.empty());
+}
+
+template <class H2>
+void HisDrrHisto::process2DgateFile(H2* h2) {
+    vector<GateWindow> gates;
+    readGateFile(options_->getGateFile(), gates);
+    prepareGateFile(*h2);
+
+    unsigned nGates = gates.size();
+    vector<Histogram1D> proj(nGates, Histogram1D(0.0, 1.0, 1, ""));
+    vector<Histogram1D> projErr(nGates, Histogram1D(0.0, 1.0, 1, ""));
+    vector<exception_ptr> errors(nGates);
+
+    // Gates are independent, each thread takes the next free one. Any
+    // error is kept and rethrown here, an exception leaving a thread
+    // would terminate the program.
+    atomic<unsigned> next(0);
+    auto worker = [&] () {
+        for (unsigned i = next++; i < nGates; i = next++) {
+            try {
+                h2->projectWithBackground(proj[i], projErr[i], gates[i].onY,
+                                          gates[i].low, gates[i].high,
+                                          gates[i].background);
+            } catch (...) {
+                errors[i] = current_exception();
+            }
+        }
+    };
+
+    // If a thread cannot be started the gates are taken by the others
+    unsigned nThreads = workerThreads(nGates);
+    vector<thread> threads;
+    threads.reserve(nThreads);
+    try {
+        for (unsigned t = 1; t < nThreads; ++t)
+            threads.push_back(thread(worker));
+    } catch (system_error&) {
+    }
+    worker();
+    for (unsigned t = 0; t < threads.size(); ++t)
+        threads[t].join();
+
+    for (unsigned i = 0; i < nGates; ++i) {
+        if (errors[i])
+            rethrow_exception(errors[i]);
+
+        if (i > 0)
+            *out_ << endl << endl;
+        *out_ << "# Gate " << i + 1 << ": on " << (gates[i].onY ? "X" : "Y")
+             << " from " << gates[i].low << " to " << gates[i].high;
+        for (unsigned b = 0; b < gates[i].background.size(); b += 2)
+            *out_ << (b == 0 ? ", background " : " and ")
+                 << gates[i].background[b] << " to "
+                 << gates[i].background[b + 1];
+        *out_ << endl;
+        printGate(proj[i], projErr[i], gates[i].onY,
+                  !gates[i].background.empty());
+    }
+}
 
-        delete projBg;
+void HisDrrHisto::readGateFile(const string& fileName,
+                               vector<GateWindow>& gates) {
+    ifstream gateFile(fileName.c_str());
+    if (!gateFile.good())
+        throw IOError("HisDrrHisto::readGateFile: Could not open file " +
+                      fileName);
+
+    string line;
+    unsigned lineNumber = 0;
+    while (getline(gateFile, line)) {
+        ++lineNumber;
+        size_t comment = line.find('#');
+        if (comment != string::npos)
+            line = line.substr(0, comment);
+
+        istringstream ss(line);
+        string axis;
+        if (!(ss >> axis))
+            continue;
+
+        stringstream err;
+        err << "HisDrrHisto::readGateFile: " << fileName 
+            << " line " << lineNumber << ": ";
+
+        GateWindow gate;
+        if (axis == "x")
+            gate.onY = true;
+        else if (axis == "y")
+            gate.onY = false;
+        else
+            throw GenError(err.str() + "axis must be x or y");
+
+        vector<double> limits;
+        double limit;
+        while (ss >> limit)
+            limits.push_back(limit);
+        if (!ss.eof())
+            throw GenError(err.str() + "wrong number format");
+        if (limits.size() != 2 && limits.size() != 4 && limits.size() != 6)
+            throw GenError(err.str() + 
+                           "gate and up to two background windows required");
+        for (unsigned i = 0; i < limits.size(); i += 2)
+            if (limits[i] > limits[i + 1])
+                throw GenError(err.str() + "window low limit is above high");
+
+        gate.low = limits[0];
+        gate.high = limits[1];
+        gate.background.assign(limits.begin() + 2, limits.end());
+        gates.push_back(gate);
     }
 
-    if (options_->getBin()) {
-        // proj binned
-        Histogram1D* projBin;
-        Histogram1D* projErrBin;
+    if (gates.empty())
+        throw GenError("HisDrrHisto::readGateFile: no gates in " + fileName);
+}
 
+void HisDrrHisto::prepareGateFile(Histogram2D& h2) {
+    h2.buildSummedArea();
+}
+
+void HisDrrHisto::prepareGateFile(SparseHistogram2D& h2) {
+}
+
+void HisDrrHisto::printGate(Histogram1D& proj, Histogram1D& projErr,
+                            bool gx, bool background) {
+    if (options_->getBin()) {
         vector<unsigned> bin;
         options_->getBinning(bin);
         if (gx && bin[1] > 1) {
-            double binW = proj->getBinWidthX() * bin[1];
-
-            projBin = proj->rebin(proj->getxMin(),
-                                  proj->getxMax(),
-                                  binW);
-            projErrBin = projErr->rebin(projErr->getxMin(),
-                                        projErr->getxMax(), 
-                                        binW);
-            (*proj) = (*projBin);
-            (*projErr) = (*projErrBin);
-            
-            delete projBin;
-            delete projErrBin;
+            double binW = proj.getBinWidthX() * bin[1];
+            proj.rebinInPlace(proj.getxMin(), proj.getxMax(), binW);
+            projErr.rebinInPlace(projErr.getxMin(), projErr.getxMax(), binW);
         } else if (gx && bin[1] <= 0)
             throw GenError("HisDrrHisto::process1D : Wrong binning size.");
 
-        if (gy && bin[0] > 1) {
-            double binW = proj->getBinWidthX() * bin[0];
-            projBin = proj->rebin(proj->getxMin(),
-                                  proj->getxMax(), 
-                                  binW);
-            projErrBin = projErr->rebin(projErr->getxMin(),
-                                        projErr->getxMax(), 
-                                        binW);
-            (*proj) = (*projBin);
-            (*projErr) = (*projErrBin);
-            
-            delete projBin;
-            delete projErrBin;
-        } else if (gy && bin[0] <= 0)
+        if (!gx && bin[0] > 1) {
+            double binW = proj.getBinWidthX() * bin[0];
+            proj.rebinInPlace(proj.getxMin(), proj.getxMax(), binW);
+            projErr.rebinInPlace(projErr.getxMin(), projErr.getxMax(), binW);
+        } else if (!gx && bin[0] <= 0)
             throw GenError("HisDrrHisto::process1D : Wrong binning size.");
 
     }
 
-    unsigned sz = proj->getnBinX();
+    if (options_->getStats()) {
+        printStatistics(proj.statistics(), 1);
+        return;
+    }
+    unsigned sz = proj.getnBinX();
     //We assume here that 0 counts came from l = 1 Poisson distribution
     for (unsigned i = 0; i < sz; ++i)
-        if ((*projErr)[i] == 0)
-            (*projErr)[i] = 1;
+        if (projErr[i] == 0)
+            projErr[i] = 1;
+
+    // Without background uncertainties follow from counts
+    if (background ? printBinary(proj, projErr) : printBinary(proj))
+        return;
 
     unsigned nth = 1;
     if (options_->getEvery()) {
@@ -265,32 +555,113 @@ void HisDrrHisto::process2Dgate() {
             nth = every[1];
     }
 
-    cout << "#X  N  dN" << endl;
+    TextWriter out(*out_);
+    out << "#X  N  dN\n";
     for (unsigned i = 0; i < sz; i += nth)
-        cout << proj->getX(i) << " " << (*proj)[i] << " " << sqrt((*projErr)[i]) << endl;
+        out << proj.getX(i) << ' ' << proj[i] << ' ' << sqrt(projErr[i]) << '\n';
+}
 
-    delete projErr;
-    delete proj;
+/** Returns range of rows (y0 to y1 - 1) covered by any of masks. */
+static void maskRows(const vector<PolygonMask>& masks,
+                     unsigned& y0, unsigned& y1) {
+    y0 = 0;
+    y1 = 0;
+    for (unsigned b = 0; b < masks.size(); ++b) {
+        if (masks[b].y0 >= masks[b].y1)
+            continue;
+        if (y0 >= y1 || masks[b].y0 < y0)
+            y0 = masks[b].y0;
+        if (masks[b].y1 > y1)
+            y1 = masks[b].y1;
+    }
+}
 
+void HisDrrHisto::polygonProject(const Histogram2D& h2,
+                                 const vector<PolygonMask>& masks, bool gx,
+                                 vector<Histogram1D>& proj) {
+    unsigned y0, y1;
+    maskRows(masks, y0, y1);
+    for (unsigned y = y0; y < y1; ++y) {
+        for (unsigned b = 0; b < masks.size(); ++b) {
+            const PolygonMask& mask = masks[b];
+            if (y < mask.y0 || y >= mask.y1)
+                continue;
+            unsigned r = y - mask.y0;
+            for (unsigned k = mask.rowStart[r]; k < mask.rowStart[r + 1]; ++k) {
+                if (gx) {
+                    long sum = 0;
+                    for (unsigned x = mask.begin[k]; x < mask.end[k]; ++x)
+                        sum += h2(x, y);
+                    proj[b].add(y, sum);
+                } else {
+                    for (unsigned x = mask.begin[k]; x < mask.end[k]; ++x)
+                        proj[b].add(x, h2(x, y));
+                }
+            }
+        }
+    }
 }
 
-void HisDrrHisto::process2Dpolygate() {
-    // Polygon gate
-    Histogram2D* h2 = dynamic_cast<Histogram2D*>(histogram);
+void HisDrrHisto::polygonProject(const SparseHistogram2D& h2,
+                                 const vector<PolygonMask>& masks, bool gx,
+                                 vector<Histogram1D>& proj) {
+    // Only non-empty bins are visited, empty ones would add nothing
+    unsigned y0, y1;
+    maskRows(masks, y0, y1);
+    for (unsigned y = y0; y < y1; ++y) {
+        for (unsigned b = 0; b < masks.size(); ++b) {
+            const PolygonMask& mask = masks[b];
+            if (y < mask.y0 || y >= mask.y1)
+                continue;
+            unsigned r = y - mask.y0;
+            unsigned long kh = h2.rowBegin(y);
+            unsigned long khEnd = h2.rowEnd(y);
+            for (unsigned k = mask.rowStart[r]; k < mask.rowStart[r + 1]; ++k) {
+                while (kh < khEnd && h2.column(kh) < mask.begin[k])
+                    ++kh;
+                for (; kh < khEnd && h2.column(kh) < mask.end[k]; ++kh) {
+                    if (gx)
+                        proj[b].add(y, h2.count(kh));
+                    else
+                        proj[b].add(h2.column(kh), h2.count(kh));
+                }
+            }
+        }
+    }
+}
 
+template <class H2>
+void HisDrrHisto::process2Dpolygate(H2* h2) {
+    // Polygon gate
     bool gx = options_->getGx();
 
-    Polygon* polgate;
+    vector<Polygon> polygons;
+    vector<int> banIds;
 
     string polFile = options_->getPolygon();
     int coma = polFile.find_last_of(",");
     if (coma != (int)string::npos ) {
         string file = polFile.substr(0, coma);
         string id = polFile.substr(coma + 1);
-        cout << "# BAN file " << file << " ban id " << id << endl;
-        polgate = new Polygon(file, atoi(id.c_str()));
+        *out_ << "# BAN file " << file << " ban id " << id << endl;
+        BanFile bans(file);
+        if (id == "all") {
+            for (unsigned i = 0; i < bans.size(); ++i) {
+                banIds.push_back(bans.getId(i));
+                polygons.push_back(bans.get(i));
+            }
+        } else {
+            istringstream ids(id);
+            string one;
+            while (getline(ids, one, ':')) {
+                banIds.push_back(atoi(one.c_str()));
+                polygons.push_back(bans.find(banIds.back()));
+            }
+        }
+        if (polygons.empty())
+            throw GenError("No bananas selected from BAN file");
     } else {
-        polgate = new Polygon(polFile);
+        polygons.push_back(Polygon(polFile));
     }
 
     unsigned szX = h2->getnBinX();
@@ -308,26 +679,26 @@ void HisDrrHisto::process2Dpolygate() {
         max = h2->getxMax();
         pSz = szX;
     }
-    Histogram1D* proj = new Histogram1D(min, max, pSz, "");
 
-    double xlow, ylow, xhigh, yhigh;
-    polgate->rectangle(xlow, ylow, xhigh, yhigh);
-
-    // getiX and getiY safely return 0 or xmax if out of histogram range
-    unsigned xmin = h2->getiX(xlow);
-    unsigned xmax = h2->getiX(xhigh);
-    unsigned ymin = h2->getiY(ylow);
-    unsigned ymax = h2->getiY(yhigh);
-
-    for (unsigned x = xmin; x < xmax; ++x)
-    for (unsigned y = ymin; y < ymax; ++y) {
-        if (polgate->pointIn(h2->getX(x), h2->getY(y)) ) {
-            if (gx)
-                proj->add(y, (*h2)(x,y));
-            else
-                proj->add(x, (*h2)(x,y));
-        }
+    // Polygons are rasterized once, then only bins inside are visited
+    unsigned nPol = polygons.size();
+    vector<PolygonMask> masks(nPol);
+    for (unsigned i = 0; i < nPol; ++i) {
+        double xlow, ylow, xhigh, yhigh;
+        polygons[i].rectangle(xlow, ylow, xhigh, yhigh);
+
+        // getiX and getiY safely return 0 or xmax if out of histogram range
+        unsigned xmin = h2->getiX(xlow);
+        unsigned xmax = h2->getiX(xhigh);
+        unsigned ymin = h2->getiY(ylow);
+        unsigned ymax = h2->getiY(yhigh);
+
+        polygons[i].rasterize(h2->getxMin(), h2->getBinWidthX(), xmin, xmax,
+                              h2->getyMin(), h2->getBinWidthY(), ymin, ymax,
+                              masks[i]);
     }
+    vector<Histogram1D> proj(nPol, Histogram1D(min, max, pSz, ""));
+    polygonProject(*h2, masks, gx, proj);
 
     unsigned nth = 1;
     if (options_->getEvery()) {
@@ -339,23 +710,35 @@ void HisDrrHisto::process2Dpolygate() {
             nth = every[1];
     }
     
-    cout << "#X  N  dN" << endl;
-    for (unsigned i = 0; i < pSz; i += nth) {
-        cout << proj->getX(i) << " " << (*proj)[i];
-        if ((*proj)[i] == 0)
-            cout << " " << 1 << endl;
-        else
-            cout << " " << sqrt((*proj)[i]) << endl;
+    for (unsigned b = 0; b < nPol; ++b) {
+        if (nPol > 1) {
+            if (b > 0)
+                *out_ << endl << endl;
+            *out_ << "# Banana " << banIds[b] << endl;
+        }
+
+        if (options_->getStats()) {
+            printStatistics(proj[b].statistics(), 1);
+            continue;
+        }
+        if (printBinary(proj[b]))
+            continue;
+
+        TextWriter out(*out_);
+        out << "#X  N  dN\n";
+        for (unsigned i = 0; i < pSz; i += nth) {
+            out << proj[b].getX(i) << ' ' << proj[b][i];
+            if (proj[b][i] == 0)
+                out << ' ' << 1 << '\n';
+            else
+                out << ' ' << sqrt(proj[b][i]) << '\n';
+        }
     }
-                
-    delete proj;
-    delete polgate;
 }
 
-void HisDrrHisto::process2Dcrop() {
+template <class H2>
+void HisDrrHisto::process2Dcrop(H2* h2) {
     // Double gate case
-    Histogram2D* h2 = dynamic_cast<Histogram2D*>(histogram);
-
     vector<unsigned> gateX;
     vector<unsigned> gateY;
     options_->getGateX(gateX);
@@ -363,29 +746,11 @@ void HisDrrHisto::process2Dcrop() {
     if (gateX.size() < 2 || gateY.size() < 2)
         throw GenError("process2D: Not enough gate points");
 
-    unsigned nbinX = gateX[1] - gateX[0];
-    unsigned nbinY = gateY[1] - gateY[0];
-    
-    Histogram2D* h2crop = new Histogram2D(gateX[0], gateX[1],
-                                            gateY[0], gateY[1],
-                                            nbinX, nbinY,
-                                            "");
-
-    unsigned newX = 0;
-    for (unsigned x = gateX[0]; x < gateX[1]; ++x) {
-        unsigned newY = 0;
-        for (unsigned y = gateY[0]; y < gateY[1]; ++y) {
-            (*h2crop)(newX, newY) = (*h2)(x, y);
-            ++newY;
-        }
-        ++newX;
-    }
-
-    (*h2) =(*h2crop);
-    delete h2crop;
+    unique_ptr<H2> h2crop(h2->crop(gateX[0], gateX[1], gateY[0], gateY[1],
+                                   gateX[0], gateX[1], gateY[0], gateY[1]));
+    (*h2) = std::move(*h2crop);
 
     if (options_->getBin()) {
-        Histogram2D* h2b;
         vector<unsigned> bin;
         options_->getBinning(bin);
 
@@ -393,53 +758,22 @@ void HisDrrHisto::process2Dcrop() {
                 (bin[0] > 0  && bin[1] > 0 )      ) {
             double binWX = h2->getBinWidthX() * bin[0];
             double binWY = h2->getBinWidthY() * bin[1];
-            h2b = h2->rebin(h2->getxMin(), h2->getxMax(), 
-                               h2->getyMin(), h2->getyMax(), 
-                               binWX, binWY);
-            (*h2) = (*h2b);
-            delete h2b;
+            h2->rebinInPlace(h2->getxMin(), h2->getxMax(), 
+                             h2->getyMin(), h2->getyMax(), 
+                             binWX, binWY);
         } else
             throw GenError("HisDrrHisto::process2D : Wrong binning size.");
     }
 
-    unsigned szX = h2->getnBinX();
-    unsigned szY = h2->getnBinY();
-    
-    unsigned nXth = 1;
-    unsigned nYth = 1;
-    if (options_->getEvery()) {
-        vector<unsigned> every;
-        options_->getEveryN(every);
-        nXth = every[0];
-        nYth = every[1];
-    }
-    
-
-    cout << "#X  Y  N" << endl;
-    //Zero suppresion for 2d histo breaks file for gnuplot pm3d map
-    if (options_->getZeroSup()) {
-        for (unsigned x = 0; x < szX; x += nXth) 
-            for (unsigned y = 0; y < szY; y += nYth)
-                if ((*h2)(x,y) != 0 )
-                    cout << h2->getX(x) << " " << h2->getY(y)  
-                            << " " << (*h2)(x,y) << endl;
-    } else {
-        for (unsigned x = 0; x < szX; x += nXth) {
-            for (unsigned y = 0; y < szY; y += nYth)
-                cout << h2->getX(x) << " " << h2->getY(y)  
-                    << " " << (*h2)(x,y) << endl;
-            cout << endl;
-        }
-    }
+    print2D(*h2);
 }
 
-void HisDrrHisto::process2Dnogates() {
+template <class H2>
+void HisDrrHisto::process2Dnogates(H2* h2) {
     // No gates case
-    Histogram2D* h2 = dynamic_cast<Histogram2D*>(histogram);
     
     // Rebinning (if applicable)
     if (options_->getBin()) {
-        Histogram2D* h2b;
         vector<unsigned> bin;
         options_->getBinning(bin);
 
@@ -447,17 +781,77 @@ void HisDrrHisto::process2Dnogates() {
                 (bin[0] > 0  && bin[1] > 0 )      ) {
             double binWX = h2->getBinWidthX() * bin[0];
             double binWY = h2->getBinWidthY() * bin[1];
-            h2b = h2->rebin(h2->getxMin(), h2->getxMax(), 
-                               h2->getyMin(), h2->getyMax(), 
-                               binWX, binWY);
-            (*h2) = (*h2b);
-            delete h2b;
+            h2->rebinInPlace(h2->getxMin(), h2->getxMax(), 
+                             h2->getyMin(), h2->getyMax(), 
+                             binWX, binWY);
         } else
             throw GenError("HisDrrHisto::process2D : Wrong binning size.");
     }
 
-    unsigned szX = h2->getnBinX();
-    unsigned szY = h2->getnBinY();
+    print2D(*h2);
+}
+
+template <class H2>
+void HisDrrHisto::process2Dautocrop(H2* h2) {
+    // Box of non-empty bins: x0, x1, y0, y1 (inclusive)
+    long box[4] = {-1, -1, -1, -1};
+    HisIndex index(drrName_, hisName_);
+    const IndexEntry* entry = index.load() ? index.find(info.hisID) : 0;
+    if (entry != 0) {
+        box[0] = entry->boxLow[0];
+        box[1] = entry->boxHigh[0];
+        box[2] = entry->boxLow[1];
+        box[3] = entry->boxHigh[1];
+    } else {
+        // Edges of the first and last non-empty bins
+        HistogramStatistics stats = h2->statistics();
+        if (stats.nonZero > 0) {
+            double bw[2] = {h2->getBinWidthX(), h2->getBinWidthY()};
+            double low[2] = {h2->getxMin(), h2->getyMin()};
+            for (unsigned d = 0; d < 2; ++d) {
+                box[2 * d] = lround((stats.low[d] - low[d]) / bw[d]);
+                box[2 * d + 1] = lround((stats.high[d] - low[d]) / bw[d]) - 1;
+            }
+        }
+    }
+
+    if (box[0] >= 0) {
+        double bwX = h2->getBinWidthX();
+        double bwY = h2->getBinWidthY();
+        double x0 = h2->getxMin();
+        double y0 = h2->getyMin();
+        unique_ptr<H2> h2crop(h2->crop(box[0], box[1] + 1, box[2], box[3] + 1,
+                                       x0 + box[0] * bwX,
+                                       x0 + (box[1] + 1) * bwX,
+                                       y0 + box[2] * bwY,
+                                       y0 + (box[3] + 1) * bwY));
+        (*h2) = std::move(*h2crop);
+        *out_ << "# Crop: X bins " << box[0] << " to " << box[1]
+              << ", Y bins " << box[2] << " to " << box[3] << endl;
+    }
+    process2Dnogates(h2);
+}
+
+/** Number of lines of 2D text output in one block (see print2D). */
+static const unsigned linesPerBlock = 1 << 16;
+
+unsigned HisDrrHisto::workerThreads(unsigned nTasks) const {
+    unsigned n = options_->getThreads();
+    if (n == 0)
+        n = thread::hardware_concurrency();
+    return max(1u, min(n, nTasks));
+}
+
+void HisDrrHisto::print2D(const Histogram2D& h2) {
+    if (options_->getStats()) {
+        printStatistics(h2.statistics(), 2);
+        return;
+    }
+    if (printBinary(h2))
+        return;
+
+    unsigned szX = h2.getnBinX();
+    unsigned szY = h2.getnBinY();
 
     unsigned nXth = 1;
     unsigned nYth = 1;
@@ -468,59 +862,247 @@ void HisDrrHisto::process2Dnogates() {
         nYth = every[1];
     }
     
-    cout << "#X  Y  N" << endl;
-    //Zero suppresion for 2d histo breaks file for gnuplot pm3d map
-    //But might be useful anyway 
-    if (options_->getZeroSup()) {
-        for (unsigned x = 0; x < szX; x += nXth) 
-            for (unsigned y = 0; y < szY; y += nYth)
-                if ((*h2)(x,y) != 0 )
-                    cout << h2->getX(x) << " " << h2->getY(y)  
-                            << " " << (*h2)(x,y) << endl;
-    } else {
-        for (unsigned x = 0; x < szX; x += nXth) {
-            for (unsigned y = 0; y < szY; y += nYth)
-                cout << h2->getX(x) << " " << h2->getY(y)  
-                    << " " << (*h2)(x,y) << endl;
-            cout << endl;
+    unsigned nColumns = (szX + nXth - 1) / nXth;
+    unsigned nLines = (szY + nYth - 1) / nYth;
+    unsigned blockColumns = max(1u, linesPerBlock / max(1u, nLines));
+    unsigned nBlocks = (nColumns + blockColumns - 1) / blockColumns;
+    bool zeroSup = options_->getZeroSup();
+
+    *out_ << "#X  Y  N" << endl;
+    TextWriter::writeParallel(*out_, nBlocks, workerThreads(nBlocks),
+                              [&] (unsigned block, TextWriter& out) {
+        unsigned x0 = block * blockColumns * nXth;
+        unsigned x1 = min(szX, (block + 1) * blockColumns * nXth);
+        //Zero suppresion for 2d histo breaks file for gnuplot pm3d map
+        //But might be useful anyway 
+        if (zeroSup) {
+            for (unsigned x = x0; x < x1; x += nXth) 
+                for (unsigned y = 0; y < szY; y += nYth)
+                    if (h2(x,y) != 0 )
+                        out << h2.getX(x) << ' ' << h2.getY(y)  
+                            << ' ' << h2(x,y) << '\n';
+        } else {
+            for (unsigned x = x0; x < x1; x += nXth) {
+                for (unsigned y = 0; y < szY; y += nYth)
+                    out << h2.getX(x) << ' ' << h2.getY(y)  
+                        << ' ' << h2(x,y) << '\n';
+                out << '\n';
+            }
         }
-    }
+    });
 }
 
-void HisDrrHisto::process2D() {
-    histogram = new Histogram2D(info.minc[0], info.maxc[0] + 1,
-                                info.minc[1], info.maxc[1] + 1, 
-                                info.scaled[0], info.scaled[1],
-                                "");
+void HisDrrHisto::print2D(const SparseHistogram2D& h2) {
+    if (options_->getStats()) {
+        printStatistics(h2.statistics(), 2);
+        return;
+    }
+    if (printBinary(h2))
+        return;
 
-    vector<unsigned> data;
-    data.reserve( info.scaled[0] * info.scaled[1]);
+    unsigned szX = h2.getnBinX();
+    unsigned szY = h2.getnBinY();
 
-    //Load data from his file
-    getHistogram(data, info.hisID);
-    histogram->setDataRaw(data);
+    unsigned nXth = 1;
+    unsigned nYth = 1;
+    if (options_->getEvery()) {
+        vector<unsigned> every;
+        options_->getEveryN(every);
+        nXth = every[0];
+        nYth = every[1];
+    }
+
+    // Output goes column by column (X outer loop), transposed
+    // histogram has columns stored as rows
+    SparseHistogram2D t(h2);
+    t.transpose();
+
+    unsigned nColumns = (szX + nXth - 1) / nXth;
+    unsigned nLines = (szY + nYth - 1) / nYth;
+    unsigned blockColumns = max(1u, linesPerBlock / max(1u, nLines));
+    unsigned nBlocks = (nColumns + blockColumns - 1) / blockColumns;
+    bool zeroSup = options_->getZeroSup();
+
+    *out_ << "#X  Y  N" << endl;
+    TextWriter::writeParallel(*out_, nBlocks, workerThreads(nBlocks),
+                              [&] (unsigned block, TextWriter& out) {
+        unsigned x0 = block * blockColumns * nXth;
+        unsigned x1 = min(szX, (block + 1) * blockColumns * nXth);
+        if (zeroSup) {
+            for (unsigned x = x0; x < x1; x += nXth) 
+                for (unsigned long k = t.rowBegin(x); k < t.rowEnd(x); ++k) {
+                    unsigned y = t.column(k);
+                    if (y % nYth == 0)
+                        out << h2.getX(x) << ' ' << h2.getY(y)  
+                            << ' ' << t.count(k) << '\n';
+                }
+        } else {
+            for (unsigned x = x0; x < x1; x += nXth) {
+                unsigned long k = t.rowBegin(x);
+                unsigned long kEnd = t.rowEnd(x);
+                for (unsigned y = 0; y < szY; y += nYth) {
+                    while (k < kEnd && t.column(k) < y)
+                        ++k;
+                    long n = 0;
+                    if (k < kEnd && t.column(k) == y)
+                        n = t.count(k);
+                    out << h2.getX(x) << ' ' << h2.getY(y)  
+                        << ' ' << n << '\n';
+                }
+                out << '\n';
+            }
+        }
+    });
+}
 
+template <class H2>
+void HisDrrHisto::process2Dmode(H2* h2) {
     bool gx = options_->getGx();
     bool gy = options_->getGy();
     bool pg = options_->getPg();
 
-    if ( (gx || gy) && !pg && !(gx && gy) ){
-        process2Dgate();
+    if (!options_->getGateFile().empty()) {
+        process2DgateFile(h2);
+    } else if ( (gx || gy) && !pg && !(gx && gy) ){
+        process2Dgate(h2);
     } else if ( (gx || gy) && pg && !(gx && gy)) {
-        process2Dpolygate();
+        process2Dpolygate(h2);
     } else if (gx && gy) {
-        process2Dcrop();
+        process2Dcrop(h2);
+    } else if (options_->getAutoCrop()) {
+        process2Dautocrop(h2);
     } else {
-        process2Dnogates();
+        process2Dnogates(h2);
     }
+}
 
-    delete histogram;
+void HisDrrHisto::process2D() {
+    vector<unsigned> data;
+    data.reserve( info.scaled[0] * info.scaled[1]);
+
+    //Load data from his file
+    getHistogram(data, info.hisID);
+
+    // Mostly empty matrices are held in sparse form, bins are counted
+    // while the sparse histogram is filled
+    unique_ptr<SparseHistogram2D> sparse(new SparseHistogram2D(
+                                    info.minc[0], info.maxc[0] + 1,
+                                    info.minc[1], info.maxc[1] + 1, 
+                                    info.scaled[0], info.scaled[1],
+                                    ""));
+    if (sparse->setDataIfSparse(data)) {
+        process2Dmode(sparse.get());
+    } else {
+        sparse.reset();
+        unique_ptr<Histogram2D> h2(new Histogram2D(
+                                    info.minc[0], info.maxc[0] + 1,
+                                    info.minc[1], info.maxc[1] + 1, 
+                                    info.scaled[0], info.scaled[1],
+                                    ""));
+        h2->setDataRaw(data);
+        process2Dmode(h2.get());
+    }
+}
+
+void HisDrrHisto::processND() {
+    unsigned dim = info.hisDim;
+    if (dim > 4)
+        throw GenError("Histograms of more then 4 dimensions are not supported.");
+
+    if (options_->getPg())
+        throw GenError("HisDrrHisto::processND: polygon gates are supported for 2D histograms only");
+    if (options_->getBg() || options_->getSBg())
+        throw GenError("HisDrrHisto::processND: background gates are supported for 2D histograms only");
+
+    // maxc + 1, see process1D
+    vector<double> min;
+    vector<double> max;
+    vector<unsigned> nBin;
+    for (unsigned d = 0; d < dim; ++d) {
+        min.push_back(info.minc[d]);
+        max.push_back(info.maxc[d] + 1);
+        nBin.push_back(info.scaled[d]);
+    }
+    unique_ptr<HistogramND> hn(new HistogramND(min, max, nBin, ""));
+
+    vector<unsigned> data;
+    getHistogram(data, info.hisID);
+    hn->setDataRaw(data);
+
+    // Axes without gate are taken in full range
+    vector<double> low(min);
+    vector<double> high(max);
+    vector<bool> gated(dim, false);
+    vector<unsigned> gate;
+    for (unsigned d = 0; d < 4; ++d) {
+        gate.clear();
+        if (d == 0 && options_->getGx())
+            options_->getGateX(gate);
+        else if (d == 1 && options_->getGy())
+            options_->getGateY(gate);
+        else if (d == 2 && options_->getGz())
+            options_->getGateZ(gate);
+        else if (d == 3 && options_->getGw())
+            options_->getGateW(gate);
+
+        if (gate.size() < 2)
+            continue;
+        if (d >= dim)
+            throw GenError("HisDrrHisto::processND: gate on axis not present in histogram");
+        low[d] = gate[0];
+        high[d] = gate[1];
+        gated[d] = true;
+    }
+
+    // Projection axes, by default first axis without gate
+    vector<unsigned> axes;
+    string proj = options_->getProjection();
+    for (unsigned i = 0; i < proj.size(); ++i)
+        axes.push_back(string("xyzw").find(proj[i]));
+    if (axes.empty()) {
+        for (unsigned d = 0; d < dim; ++d)
+            if (!gated[d]) {
+                axes.push_back(d);
+                break;
+            }
+        if (axes.empty())
+            throw GenError("HisDrrHisto::processND: all axes are gated, use --proj to select projection");
+    }
+    for (unsigned i = 0; i < axes.size(); ++i)
+        if (axes[i] >= dim)
+            throw GenError("HisDrrHisto::processND: projection on axis not present in histogram");
+
+    vector<unsigned> bin;
+    options_->getBinning(bin);
+
+    if (axes.size() == 1) {
+        Histogram1D h1(0.0, 1.0, 1, "");
+        hn->projectInto(h1, axes[0], low, high);
+        if (options_->getBin() && bin[0] > 1) {
+            double binW = h1.getBinWidthX() * bin[0];
+            h1.rebinInPlace(h1.getxMin(), h1.getxMax(), binW);
+        }
+        print1D(h1);
+    } else {
+        Histogram2D h2(0.0, 1.0, 0.0, 1.0, 1, 1, "");
+        hn->projectInto(h2, axes[0], axes[1], low, high);
+        if (options_->getBin()) {
+            double binWX = h2.getBinWidthX() * bin[0];
+            double binWY = h2.getBinWidthY() * bin[1];
+            h2.rebinInPlace(h2.getxMin(), h2.getxMax(), 
+                            h2.getyMin(), h2.getyMax(), 
+                            binWX, binWY);
+        }
+        print2D(h2);
+    }
 }
 
-void HisDrrHisto::process() {
+bool HisDrrHisto::process() {
 
     try {
-        if ( options_->getListMode() )
+        if (options_->getIndexMode())
+            runIndexMode();
+        else if ( options_->getListMode() )
             runListMode(false);
         else if (options_->getListModeZ())
             runListMode(true);
@@ -534,18 +1116,28 @@ void HisDrrHisto::process() {
 
             if (options_->getInfoMode()) { 
                 runInfoMode();
+            } else if (indexStats()) {
+                // Answered from the index
+            } else if (!options_->getGateFile().empty() && 
+                       info.hisDim != 2) {
+                throw GenError("--gate-file is supported for 2D histograms only.");
             } else if (info.hisDim == 1) {
                 process1D();
             } else if (info.hisDim == 2) {
                 process2D();
             } else {
-                throw GenError("Only 1 and 2 dimensional histograms are supported.");
+                processND();
             }
         }
     } catch (GenError &err) {
-        cout << "Error: " << err.show() << endl;
-        cout << "Run readhis --help for more information" << endl;
+        *out_ << "Error: " << err.show() << endl;
+        *out_ << "Run readhis --help for more information" << endl;
+        return false;
+    } catch (std::exception &err) {
+        *out_ << "Error: " << err.what() << endl;
+        return false;
     }
+    return true;
 }
 
 HisDrrHisto::~HisDrrHisto() {
@@ -0,0 +1,200 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <sys/stat.h>
+#include "HisIndex.h"
+#include "Exceptions.h"
+
+using namespace std;
+
+/** First line of index file, changed when the format changes. */
+static const string indexVersion = "# readhis index 1";
+
+HisIndex::HisIndex(const string& drr, const string& his)
+                  : drr_(drr), his_(his) {
+    unsigned dot = his.find_last_of(".");
+    fileName_ = his.substr(0, dot) + ".hidx";
+}
+
+bool HisIndex::getStamp(const string& file, FileStamp& stamp) {
+    struct stat st;
+    if (stat(file.c_str(), &st) != 0)
+        return false;
+    stamp.size = st.st_size;
+    stamp.seconds = st.st_mtim.tv_sec;
+    stamp.nanoseconds = st.st_mtim.tv_nsec;
+    return true;
+}
+
+bool HisIndex::load() {
+    entries_.clear();
+    ifstream in(fileName_.c_str());
+    if (!in.good())
+        return false;
+
+    string line;
+    getline(in, line);
+    if (line != indexVersion)
+        return false;
+
+    // Files must be the same as when the index was written
+    const string* files[2] = {&his_, &drr_};
+    for (unsigned f = 0; f < 2; ++f) {
+        FileStamp now;
+        FileStamp then;
+        string name;
+        if (!getStamp(*files[f], now))
+            return false;
+        if (!(in >> name >> then.size >> then.seconds >> then.nanoseconds))
+            return false;
+        if (now.size != then.size || now.seconds != then.seconds ||
+            now.nanoseconds != then.nanoseconds)
+            return false;
+    }
+
+    unsigned nEntries;
+    if (!(in >> line >> nEntries) || line != "histograms")
+        return false;
+
+    for (unsigned i = 0; i < nEntries; ++i) {
+        IndexEntry e;
+        in >> e.hisID >> e.dim >> e.sum >> e.nonZero >> e.min >> e.max
+           >> hex >> e.checksum >> dec;
+        for (unsigned d = 0; d < 4; ++d)
+            in >> e.boxLow[d] >> e.boxHigh[d];
+        in >> e.hasStats >> e.stats.sum >> e.stats.nonZero
+           >> e.stats.min >> e.stats.max;
+        for (unsigned d = 0; d < 2; ++d)
+            in >> e.stats.mean[d] >> e.stats.variance[d]
+               >> e.stats.low[d] >> e.stats.high[d];
+        if (in.fail()) {
+            entries_.clear();
+            return false;
+        }
+        entries_.push_back(e);
+    }
+    return true;
+}
+
+void HisIndex::save() const {
+    FileStamp stamps[2];
+    const string* files[2] = {&his_, &drr_};
+    for (unsigned f = 0; f < 2; ++f)
+        if (!getStamp(*files[f], stamps[f]))
+            throw IOError("HisIndex: could not stat " + *files[f]);
+
+    // Written aside and renamed, so readers never see a partial index
+    string tmpName = fileName_ + ".tmp";
+    ofstream out(tmpName.c_str());
+    if (!out.good())
+        throw IOError("HisIndex: could not write " + tmpName);
+
+    out << indexVersion << endl;
+    const char* labels[2] = {"his", "drr"};
+    for (unsigned f = 0; f < 2; ++f)
+        out << labels[f] << " " << stamps[f].size << " "
+            << stamps[f].seconds << " " << stamps[f].nanoseconds << endl;
+    out << "histograms " << entries_.size() << endl;
+
+    // Doubles with 17 digits are read back exactly
+    out << setprecision(17);
+    for (unsigned i = 0; i < entries_.size(); ++i) {
+        const IndexEntry& e = entries_[i];
+        out << e.hisID << " " << e.dim << " " << e.sum << " "
+            << e.nonZero << " " << e.min << " " << e.max << " "
+            << hex << e.checksum << dec;
+        for (unsigned d = 0; d < 4; ++d)
+            out << " " << e.boxLow[d] << " " << e.boxHigh[d];
+        out << " " << e.hasStats << " " << e.stats.sum << " "
+            << e.stats.nonZero << " " << e.stats.min << " " << e.stats.max;
+        for (unsigned d = 0; d < 2; ++d)
+            out << " " << e.stats.mean[d] << " " << e.stats.variance[d]
+                << " " << e.stats.low[d] << " " << e.stats.high[d];
+        out << endl;
+    }
+    out.close();
+    if (out.fail() || rename(tmpName.c_str(), fileName_.c_str()) != 0) {
+        remove(tmpName.c_str());
+        throw IOError("HisIndex: could not write " + fileName_);
+    }
+}
+
+const IndexEntry* HisIndex::find(int id) const {
+    for (unsigned i = 0; i < entries_.size(); ++i)
+        if (entries_[i].hisID == id)
+            return &entries_[i];
+    return 0;
+}
+
+void HisIndex::add(const IndexEntry& entry) {
+    for (unsigned i = 0; i < entries_.size(); ++i) {
+        if (entries_[i].hisID == entry.hisID) {
+            entries_[i] = entry;
+            return;
+        }
+    }
+    entries_.push_back(entry);
+}
+
+void HisIndex::summarize(const vector<unsigned>& data,
+                         const vector<unsigned>& nBin,
+                         unsigned width, IndexEntry& entry) {
+    const unsigned long long fnvOffset = 14695981039346656037ull;
+    const unsigned long long fnvPrime = 1099511628211ull;
+
+    entry.dim = nBin.size();
+    entry.sum = 0;
+    entry.nonZero = 0;
+    entry.min = 0;
+    entry.max = 0;
+    entry.checksum = fnvOffset;
+    entry.hasStats = false;
+    entry.stats = HistogramStatistics();
+    for (unsigned d = 0; d < 4; ++d) {
+        entry.boxLow[d] = -1;
+        entry.boxHigh[d] = -1;
+    }
+
+    unsigned dim = nBin.size();
+    vector<unsigned> position(dim, 0);
+    for (unsigned long i = 0; i < data.size(); ++i) {
+        unsigned v = data[i];
+        // Channel bytes as stored in his file (little-endian)
+        for (unsigned b = 0; b < width; ++b) {
+            entry.checksum ^= (v >> (8 * b)) & 0xff;
+            entry.checksum *= fnvPrime;
+        }
+
+        if (i == 0 || long(v) < entry.min)
+            entry.min = v;
+        if (i == 0 || long(v) > entry.max)
+            entry.max = v;
+
+        if (v != 0) {
+            ++entry.nonZero;
+            entry.sum += v;
+            for (unsigned d = 0; d < dim; ++d) {
+                int p = position[d];
+                if (entry.boxLow[d] < 0 || p < entry.boxLow[d])
+                    entry.boxLow[d] = p;
+                if (p > entry.boxHigh[d])
+                    entry.boxHigh[d] = p;
+            }
+        }
+
+        // X runs fastest
+        for (unsigned d = 0; d < dim; ++d) {
+            if (++position[d] < nBin[d])
+                break;
+            position[d] = 0;
+        }
+    }
+}
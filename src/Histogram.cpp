@@ -6,11 +6,15 @@
  */
 
 #include <cmath>
+#include <algorithm>
+#include <climits>
 #include <string>
 #include <vector>
 #include "Histogram.h"
 #include "Exceptions.h"
 
+using namespace std;
+
 //
 //****************************************************  class  Histogram
 //
@@ -35,6 +39,188 @@ unsigned Histogram::getiX (double x) const {
         return nBinX_ - 1;
 }
 
+long Histogram::roundCount (double value) {
+    // Proper rounding:
+    // if number ends with 5 it's rounded to nearest even
+    // e.g 1.5 -> 2
+    //     2.5 -> 2
+    //     3.5 -> 4
+    //e.g 1.5 + 0.5 = 2.0
+    //e.g 2.5 + 0.5 = 3.0
+    double val = value + 0.5;
+    double ip;
+    double fp;
+    fp = modf(val, &ip);
+    // 2 % 2 = 0 so 1.5 stays as 2.0 and goes to int=2
+    // 3 % 2 = 1 so 2.5 is now 2.9 and goes to int=2
+    if (fp == 0.0 && int(ip) % 2 == 1)
+            val -= 0.1;
+
+    return static_cast<long>(val);
+}
+
+bool Histogram::isIntegerRatio (double a, double b, int& n) {
+    if (b == 0)
+        return false;
+    double r = a / b;
+    double ri = floor(r + 0.5);
+    if (fabs(r - ri) > 1.0e-9 * max(1.0, fabs(r)))
+        return false;
+    n = int(ri);
+    return true;
+}
+
+void Histogram::overlapWeights (double oldMin, double oldW, unsigned nOld,
+                                double newMin, double newW,
+                                vector<unsigned>& first,
+                                vector<int>& bins,
+                                vector<double>& weights) {
+    first.clear();
+    bins.clear();
+    weights.clear();
+    first.reserve(nOld + 1);
+    // Each old bin overlaps with at least 2 points (one new bin)
+    bins.reserve(nOld + unsigned(nOld * oldW / newW) + 1);
+    weights.reserve(bins.capacity());
+
+    for (unsigned i = 0; i < nOld; ++i) {
+        first.push_back(bins.size());
+        double low = double(i) * oldW + oldMin;
+        double high = (double(i) + 1.0) * oldW + oldMin;
+
+        // floor, so that parts below newMin are counted as underflow
+        int b0 = int(floor((low - newMin) / newW));
+        int b1 = int(floor((high - newMin) / newW));
+
+        // Auxillary points low, bin0_high, ..., high
+        double p0 = low;
+        for (int b = b0; b < b1; ++b) {
+            double p1 = (b + 1) * newW + newMin;
+            bins.push_back(b);
+            weights.push_back((p1 - p0) / oldW);
+            p0 = p1;
+        }
+        bins.push_back(b1);
+        weights.push_back((high - p0) / oldW);
+    }
+    first.push_back(bins.size());
+}
+
+void Histogram::sumBins (const long* in, long sz, long* out, long nOut,
+                         int factor, int offset,
+                         long& under, long& over) {
+    long i = 0;
+    for (; i < sz && i < offset; ++i)
+        under += in[i];
+
+    // Next new bin to be written, bins without any old bin are zeroed
+    long next = 0;
+    while (i < sz) {
+        long ix = (i - offset) / factor;
+        if (ix >= nOut)
+            break;
+        long end = offset + (ix + 1) * factor;
+        if (end > sz)
+            end = sz;
+        long sum = 0;
+        for (; i < end; ++i)
+            sum += in[i];
+        for (; next < ix; ++next)
+            out[next] = 0;
+        out[ix] = sum;
+        next = ix + 1;
+    }
+
+    for (; i < sz; ++i)
+        over += in[i];
+
+    for (; next < nOut; ++next)
+        out[next] = 0;
+}
+
+void Histogram::binMoments (const long* v, unsigned n,
+                            long& sum, double& s1, double& s2,
+                            long& minCount, long& maxCount,
+                            unsigned long& nonZero,
+                            unsigned& first, unsigned& last) {
+    // Leading and trailing empty bins are skipped, they only
+    // change the min and max
+    unsigned lo = 0;
+    while (lo < n && v[lo] == 0)
+        ++lo;
+    first = lo;
+    if (lo == n) {
+        minCount = min(minCount, 0L);
+        maxCount = max(maxCount, 0L);
+        return;
+    }
+    unsigned hi = n - 1;
+    while (v[hi] == 0)
+        --hi;
+    last = hi;
+    if (lo > 0 || hi < n - 1) {
+        minCount = min(minCount, 0L);
+        maxCount = max(maxCount, 0L);
+    }
+
+    long sumL[4] = {0, 0, 0, 0};
+    double s1L[4] = {0, 0, 0, 0};
+    double s2L[4] = {0, 0, 0, 0};
+    long minL[4] = {v[lo], v[lo], v[lo], v[lo]};
+    long maxL[4] = {v[lo], v[lo], v[lo], v[lo]};
+    unsigned long nzL[4] = {0, 0, 0, 0};
+
+    unsigned i = lo;
+    for (; i + 4 <= hi + 1; i += 4) {
+        for (unsigned k = 0; k < 4; ++k) {
+            long c = v[i + k];
+            double x = double(i + k);
+            sumL[k] += c;
+            s1L[k] += c * x;
+            s2L[k] += c * x * x;
+            minL[k] = c < minL[k] ? c : minL[k];
+            maxL[k] = c > maxL[k] ? c : maxL[k];
+            nzL[k] += (c != 0);
+        }
+    }
+    for (; i <= hi; ++i) {
+        long c = v[i];
+        double x = double(i);
+        sumL[0] += c;
+        s1L[0] += c * x;
+        s2L[0] += c * x * x;
+        minL[0] = c < minL[0] ? c : minL[0];
+        maxL[0] = c > maxL[0] ? c : maxL[0];
+        nzL[0] += (c != 0);
+    }
+
+    for (unsigned k = 0; k < 4; ++k) {
+        sum += sumL[k];
+        s1 += s1L[k];
+        s2 += s2L[k];
+        minCount = min(minCount, minL[k]);
+        maxCount = max(maxCount, maxL[k]);
+        nonZero += nzL[k];
+    }
+}
+
+void Histogram::momentsToStatistics (long sum, double s1, double s2,
+                                     double xLow, double binW,
+                                     double& mean, double& variance) {
+    if (sum == 0) {
+        mean = 0;
+        variance = 0;
+        return;
+    }
+    double m = s1 / double(sum);
+    double v = s2 / double(sum) - m * m;
+    // Rounding errors for a single non-empty bin
+    if (v < 0)
+        v = 0;
+    mean = xLow + (m + 0.5) * binW;
+    variance = v * binW * binW;
+}
+
 long Histogram::getSum () const {
     long sum = 0;
     unsigned sz = values_.size();
@@ -64,6 +250,8 @@ void Histogram::setDataRaw (const vector<long>& values) {
 
     for (; i < sz; ++i)
         values_[i] = 0;
+
+    dataChanged();
 }
 
 void Histogram::setDataRaw (const vector<int>& values) {
@@ -77,6 +265,8 @@ void Histogram::setDataRaw (const vector<int>& values) {
 
     for (; i < sz; ++i)
         values_[i] = 0;
+
+    dataChanged();
 }
 
 void Histogram::setDataRaw (const vector<unsigned>& values) {
@@ -90,6 +280,8 @@ void Histogram::setDataRaw (const vector<unsigned>& values) {
 
     for (; i < sz; ++i)
         values_[i] = 0;
+
+    dataChanged();
 }
 
 void Histogram::setDataRaw (const vector<double>& values) {
@@ -98,28 +290,13 @@ void Histogram::setDataRaw (const vector<double>& values) {
 
     unsigned i = 0;
 
-    // Proper rounding:
-    // if number ends with 5 it's rounded to nearest even
-    // e.g 1.5 -> 2
-    //     2.5 -> 2
-    //     3.5 -> 4
-    for (; i < szLow; ++i) {
-        //e.g 1.5 + 0.5 = 2.0
-        //e.g 2.5 + 0.5 = 3.0
-        double val = values[i] + 0.5;
-        double ip;
-        double fp;
-        fp = modf(val, &ip);
-        // 2 % 2 = 0 so 1.5 stays as 2.0 and goes to int=2
-        // 3 % 2 = 1 so 2.5 is now 2.9 and goes to int=2
-        if (fp == 0.0 && int(ip) % 2 == 1)
-                val -= 0.1;
-        
-        values_[i] = static_cast<long>(val);
-    }
+    for (; i < szLow; ++i)
+        values_[i] = roundCount(values[i]);
 
     for (; i < sz; ++i)
         values_[i] = 0;
+
+    dataChanged();
 }
     
 //
@@ -136,6 +313,50 @@ unsigned short Histogram1D::getDim() const {
     return 1;
 }
 
+HistogramStatistics Histogram1D::statistics (unsigned ix0,
+                                             unsigned ix1) const {
+    if (ix0 > ix1 || ix1 >= nBinX_)
+        throw ArrayError("Histogram1D::statistics: Matrix subscript out of bounds");
+
+    HistogramStatistics stats = HistogramStatistics();
+    stats.min = LONG_MAX;
+    stats.max = LONG_MIN;
+
+    unsigned n = ix1 - ix0 + 1;
+    double s1 = 0;
+    double s2 = 0;
+    unsigned first = 0;
+    unsigned last = 0;
+    binMoments(&values_[ix0], n, stats.sum, s1, s2, stats.min, stats.max,
+               stats.nonZero, first, last);
+    momentsToStatistics(stats.sum, s1, s2, getXlow(ix0), binWidthX_,
+                        stats.mean[0], stats.variance[0]);
+    if (first < n) {
+        stats.low[0] = getXlow(ix0 + first);
+        stats.high[0] = getXhigh(ix0 + last);
+    } else {
+        stats.low[0] = getXlow(ix0);
+        stats.high[0] = getXhigh(ix1);
+    }
+    return stats;
+}
+
+HistogramStatistics Histogram1D::statistics () const {
+    return statistics(0, nBinX_ - 1);
+}
+
+void Histogram1D::reset (double xMin, double xMax, unsigned nBinX) {
+    if (nBinX < 1)
+        throw GenError("Histogram1D::reset: number of bins cannot be less then 1");
+    xMin_ = xMin;
+    xMax_ = xMax;
+    nBinX_ = nBinX;
+    binWidthX_ = (xMax - xMin) / double(nBinX);
+    underflow_ = 0;
+    overflow_ = 0;
+    values_.assign(nBinX, 0);
+}
+
 void Histogram1D::add (double x, long n /* = 1*/) {
     unsigned ix = 0;
     if ( x > xMin_ ) {
@@ -172,6 +393,21 @@ Histogram1D* Histogram1D::rebin (double xMin, double xMax,
 
     double binW = (xMax - xMin) / double(nBinX);   
 
+    // Integer factor and aligned edges, new bins are sums of old ones
+    int factor = 0;
+    int offset = 0;
+    if (isIntegerRatio(binW, binWidthX_, factor) && factor >= 1 &&
+        isIntegerRatio(xMin - xMin_, binWidthX_, offset))
+        return rebinInteger(xMin, xMax, nBinX, factor, offset);
+
+    // Each new bin gets number of counts proportional to area
+    // of old bin fitting into the new one, see overlapWeights
+    vector<unsigned> first;
+    vector<int> bins;
+    vector<double> weights;
+    overlapWeights(xMin_, binWidthX_, nBinX_, xMin, binW,
+                   first, bins, weights);
+
     double underflow = 0.0;
     double overflow = 0.0;
     unsigned sz = values_.size();
@@ -179,33 +415,9 @@ Histogram1D* Histogram1D::rebin (double xMin, double xMax,
     values.resize(nBinX, 0.0);
     
     for (unsigned i = 0; i < sz; i++) {
-        // We find low and high edge of old bin
-        // we find which new bins it goes
-        // each new bin will get number of counts proportional
-        // to area of old bin fitting into new one
-        
-        // Auxillary points to calculate area per new bin:
-        // xlow, bin0_high, bin1_high, ..., xhigh
-        // each bin gets
-        // bin0 -> (bin0h - xlow) / dx, 
-        // bin1 -> (bin1h - bin0h) / dx,
-        // ...
-        
-        // auxillary points
-        vector<double> p;
-        p.push_back(getXlow(i));
-
-        int b0 = (getXlow(i) - xMin) / binW;
-        int b1 = (getXhigh(i) - xMin) / binW;
-        for (int b = b0; b < b1; ++b)
-            p.push_back( (b + 1) * binW + xMin );
-
-        p.push_back(getXhigh(i));
-
-        // p contains at least two points (xlow, xhigh)
-        for (unsigned j = 0; j < p.size() - 1; ++j) {
-            double area = (p[j+1] - p[j]) / binWidthX_ * get(i);
-            int ix = b0 + j;
+        for (unsigned k = first[i]; k < first[i + 1]; ++k) {
+            double area = weights[k] * values_[i];
+            int ix = bins[k];
             if (ix < 0)
                 underflow += area;
             else if (ix > (int)(nBinX - 1))
@@ -223,6 +435,20 @@ Histogram1D* Histogram1D::rebin (double xMin, double xMax,
     return rebinned;
 }
 
+Histogram1D* Histogram1D::rebinInteger (double xMin, double xMax,
+                                        unsigned nBinX,
+                                        int factor, int offset) const {
+    Histogram1D* rebinned = new Histogram1D(xMin, xMax, nBinX, "");
+
+    long underflow = 0;
+    long overflow = 0;
+    sumBins(&values_[0], values_.size(), &rebinned->values_[0], nBinX,
+            factor, offset, underflow, overflow);
+
+    rebinned->underflow_ = underflow;
+    rebinned->overflow_ = overflow;
+    return rebinned;
+}
 
 Histogram1D* Histogram1D::rebin (double xMin, double xMax,
                                  double binW) const {
@@ -235,6 +461,58 @@ Histogram1D* Histogram1D::rebin (double xMin, double xMax,
     return rebin(xMin, xMax, nBinX);
 }
 
+unique_ptr<Histogram1D> Histogram1D::rebinUnique (double xMin, double xMax,
+                                                  unsigned nBinX) const {
+    return unique_ptr<Histogram1D>(rebin(xMin, xMax, nBinX));
+}
+
+unique_ptr<Histogram1D> Histogram1D::rebinUnique (double xMin, double xMax,
+                                                  double binW) const {
+    return unique_ptr<Histogram1D>(rebin(xMin, xMax, binW));
+}
+
+void Histogram1D::rebinInPlace (double xMin, double xMax, unsigned nBinX) {
+    if (nBinX < 1 )
+        throw GenError("Histogram1D::rebinInPlace: number of bins cannot be less then 1");
+
+    double binW = (xMax - xMin) / double(nBinX);   
+    int factor = 0;
+    int offset = 0;
+    if (isIntegerRatio(binW, binWidthX_, factor) && factor >= 1 &&
+        isIntegerRatio(xMin - xMin_, binWidthX_, offset) && offset >= 0) {
+        long sz = values_.size();
+        if (nBinX > sz)
+            values_.resize(nBinX, 0);
+
+        long underflow = 0;
+        long overflow = 0;
+        sumBins(&values_[0], sz, &values_[0], nBinX,
+                factor, offset, underflow, overflow);
+        values_.resize(nBinX);
+
+        xMin_ = xMin;
+        xMax_ = xMax;
+        nBinX_ = nBinX;
+        binWidthX_ = binW;
+        underflow_ = underflow;
+        overflow_ = overflow;
+        dataChanged();
+    } else {
+        unique_ptr<Histogram1D> rebinned = rebinUnique(xMin, xMax, nBinX);
+        rebinned->hisId_ = hisId_;
+        *this = std::move(*rebinned);
+    }
+}
+
+void Histogram1D::rebinInPlace (double xMin, double xMax, double binW) {
+    if (binW <= 0 )
+        throw GenError("Histogram1D::rebinInPlace: bin width must be greater then 0");
+
+    unsigned nBinX = unsigned((xMax - xMin) / binW) + 1;
+    xMax = xMin + nBinX * binW;
+    rebinInPlace(xMin, xMax, nBinX);
+}
+
 Histogram1D& Histogram1D::operator=(const Histogram1D& right){
     // Self assigment test
     if (this == &right)
@@ -250,6 +528,14 @@ Histogram1D& Histogram1D::operator=(const Histogram1D& right){
     return *this;
 }
 
+Histogram1D& Histogram1D::operator=(Histogram1D&& right){
+    if (this == &right)
+        return *this;
+
+    Histogram::operator=(std::move(right));
+    return *this;
+}
+
 Histogram1D& Histogram1D::operator*=(int right) {
     unsigned sz = this->values_.size();
     for (unsigned i = 0; i < sz; ++i)
@@ -285,21 +571,39 @@ Histogram1D& Histogram1D::operator-=(const Histogram1D& right) {
     }
 }
 
-const Histogram1D Histogram1D::operator*(int right) const {
-    Histogram1D result = *this;
+Histogram1D Histogram1D::operator*(int right) const & {
+    Histogram1D result(*this);
     result *= right;
     return result;
 }
 
+Histogram1D Histogram1D::operator*(int right) && {
+    Histogram1D result(std::move(*this));
+    result *= right;
+    return result;
+}
 
-const Histogram1D Histogram1D::operator+(const Histogram1D& right) const {
-    Histogram1D result = *this;
+
+Histogram1D Histogram1D::operator+(const Histogram1D& right) const & {
+    Histogram1D result(*this);
     result += right;
     return result;
 }
 
-const Histogram1D Histogram1D::operator-(const Histogram1D& right) const {
-    Histogram1D result = *this;
+Histogram1D Histogram1D::operator+(const Histogram1D& right) && {
+    Histogram1D result(std::move(*this));
+    result += right;
+    return result;
+}
+
+Histogram1D Histogram1D::operator-(const Histogram1D& right) const & {
+    Histogram1D result(*this);
+    result -= right;
+    return result;
+}
+
+Histogram1D Histogram1D::operator-(const Histogram1D& right) && {
+    Histogram1D result(std::move(*this));
     result -= right;
     return result;
 }
@@ -341,7 +645,8 @@ Histogram2D::Histogram2D (double xMin,    double xMax,
                           unsigned nBinX, unsigned nBinY,
                           string hisId)
                         : Histogram(xMin, xMax, nBinX, hisId),
-                          yMin_(yMin), yMax_(yMax), nBinY_(nBinY) { 
+                          yMin_(yMin), yMax_(yMax), nBinY_(nBinY),
+                          hasSummedArea_(false) { 
     values_.resize( (nBinX_ ) * (nBinY_ ), 0);
     binWidthY_ = (yMax_ - yMin_) / double(nBinY_) ;
 }
@@ -350,7 +655,12 @@ unsigned short Histogram2D::getDim() const {
     return 2;
 }
 
+void Histogram2D::dataChanged () {
+    hasSummedArea_ = false;
+}
+
 void Histogram2D::add (double x, double y, long n /* = 1*/) {
+    hasSummedArea_ = false;
     unsigned ix = static_cast<unsigned>( (x - xMin_) / getBinWidthX() );
     unsigned iy = static_cast<unsigned>( (y - yMin_) / getBinWidthY() );
     
@@ -368,6 +678,7 @@ long Histogram2D::get (unsigned ix, unsigned iy) const {
 }
 
 void Histogram2D::set (unsigned ix, unsigned iy, long value) {
+    hasSummedArea_ = false;
     if (ix < nBinX_  && iy < nBinY_ )
         values_[iy * nBinX_ + ix] = value;
     else
@@ -384,60 +695,346 @@ unsigned Histogram2D::getiY (double y) const {
 }
 
 Histogram1D* Histogram2D::gateX (double xl, double xh) const {
-    
-    vector<long> result;
-    result.resize(nBinY_, 0);
+    Histogram1D* gate = new Histogram1D(yMin_, yMax_, nBinY_, "");
+    projectInto(*gate, true, xl, xh);
+    return gate;
+}
 
-    unsigned x0 = getiX(xl);
-    unsigned x1 = getiX(xh);
+Histogram1D* Histogram2D::gateY (double yl, double yh) const {
+    Histogram1D* gate = new Histogram1D(xMin_, xMax_, nBinX_, "");
+    projectInto(*gate, false, yl, yh);
+    return gate;
+}
 
-    for (unsigned ix = x0; ix < x1 + 1; ++ix) 
-        for (unsigned iy = 0; iy < nBinY_ ; ++iy) 
-            result[iy] += values_[iy * nBinX_  + ix];
+unique_ptr<Histogram1D> Histogram2D::gateXUnique (double xl, double xh) const {
+    return unique_ptr<Histogram1D>(gateX(xl, xh));
+}
 
-    Histogram1D* gate = new Histogram1D(yMin_, yMax_, nBinY_, "");
-    gate->setDataRaw(result);
-    return gate;
+unique_ptr<Histogram1D> Histogram2D::gateYUnique (double yl, double yh) const {
+    return unique_ptr<Histogram1D>(gateY(yl, yh));
+}
 
+void Histogram2D::projectInto (Histogram1D& projection, bool onY,
+                               double low, double high) const {
+    if (onY) {
+        projection.reset(yMin_, yMax_, nBinY_);
+        long* result = &projection.values_[0];
+
+        unsigned x0 = getiX(low);
+        unsigned x1 = getiX(high);
+
+        if (hasSummedArea_) {
+            for (unsigned iy = 0; iy < nBinY_ ; ++iy) 
+                result[iy] = sat(x1 + 1, iy + 1) - sat(x0, iy + 1)
+                           - sat(x1 + 1, iy) + sat(x0, iy);
+        } else {
+            for (unsigned iy = 0; iy < nBinY_ ; ++iy) {
+                const long* row = &values_[iy * nBinX_];
+                long sum = 0;
+                for (unsigned ix = x0; ix < x1 + 1; ++ix) 
+                    sum += row[ix];
+                result[iy] = sum;
+            }
+        }
+    } else {
+        projection.reset(xMin_, xMax_, nBinX_);
+        long* result = &projection.values_[0];
+
+        unsigned y0 = getiY(low);
+        unsigned y1 = getiY(high);
+
+        if (hasSummedArea_) {
+            for (unsigned ix = 0; ix < nBinX_ ; ++ix) 
+                result[ix] = sat(ix + 1, y1 + 1) - sat(ix, y1 + 1)
+                           - sat(ix + 1, y0) + sat(ix, y0);
+        } else {
+            for (unsigned iy = y0; iy < y1 + 1; ++iy) {
+                const long* row = &values_[iy * nBinX_];
+                for (unsigned ix = 0; ix < nBinX_ ; ++ix) 
+                    result[ix] += row[ix];
+            }
+        }
+    }
 }
 
-Histogram1D* Histogram2D::gateY (double yl, double yh) const {
+void Histogram2D::projectWithBackground (Histogram1D& projection,
+                                         Histogram1D& variance, bool onY,
+                                         double low, double high,
+                                 const vector<double>& background) const {
+    unsigned nBg = background.size() / 2;
+    if (background.size() % 2 != 0 || nBg > 2)
+        throw GenError("Histogram2D::projectWithBackground: 0, 2 or 4 background limits required");
+
+    // Gate 0 is the peak, others are background
+    unsigned first[3];
+    unsigned last[3];
+    first[0] = onY ? getiX(low) : getiY(low);
+    last[0] = onY ? getiX(high) : getiY(high);
+    for (unsigned g = 1; g <= nBg; ++g) {
+        double bl = background[2 * g - 2];
+        double bh = background[2 * g - 1];
+        first[g] = onY ? getiX(bl) : getiY(bl);
+        last[g] = onY ? getiX(bh) : getiY(bh);
+    }
 
-    vector<long> result;
-    result.resize(nBinX_, 0);
+    if (onY) {
+        projection.reset(yMin_, yMax_, nBinY_);
+        variance.reset(yMin_, yMax_, nBinY_);
+        long* result = &projection.values_[0];
+        long* err = &variance.values_[0];
+
+        for (unsigned iy = 0; iy < nBinY_ ; ++iy) {
+            const long* row = &values_[iy * nBinX_];
+            long sum[3] = {0, 0, 0};
+            for (unsigned g = 0; g <= nBg; ++g) {
+                if (hasSummedArea_) {
+                    sum[g] = sat(last[g] + 1, iy + 1) - sat(first[g], iy + 1)
+                           - sat(last[g] + 1, iy) + sat(first[g], iy);
+                } else {
+                    for (unsigned ix = first[g]; ix < last[g] + 1; ++ix) 
+                        sum[g] += row[ix];
+                }
+            }
+            result[iy] = sum[0] - sum[1] - sum[2];
+            err[iy] = sum[0] + sum[1] + sum[2];
+        }
+    } else {
+        projection.reset(xMin_, xMax_, nBinX_);
+        variance.reset(xMin_, xMax_, nBinX_);
+        long* result = &projection.values_[0];
+        long* err = &variance.values_[0];
+
+        if (hasSummedArea_) {
+            for (unsigned ix = 0; ix < nBinX_ ; ++ix) {
+                long sum[3] = {0, 0, 0};
+                for (unsigned g = 0; g <= nBg; ++g)
+                    sum[g] = sat(ix + 1, last[g] + 1) - sat(ix, last[g] + 1)
+                           - sat(ix + 1, first[g]) + sat(ix, first[g]);
+                result[ix] = sum[0] - sum[1] - sum[2];
+                err[ix] = sum[0] + sum[1] + sum[2];
+            }
+            return;
+        }
 
-    unsigned y0 = getiY(yl);
-    unsigned y1 = getiY(yh);
+        unsigned y0 = first[0];
+        unsigned y1 = last[0];
+        for (unsigned g = 1; g <= nBg; ++g) {
+            y0 = min(y0, first[g]);
+            y1 = max(y1, last[g]);
+        }
 
-    for (unsigned iy = y0; iy < y1 + 1; ++iy) 
-        for (unsigned ix = 0; ix < nBinX_ ; ++ix) 
-            result[ix] += values_[iy * nBinX_  + ix];
+        // Each row is added with weight depending on the gates it
+        // belongs to (gates may overlap)
+        for (unsigned iy = y0; iy < y1 + 1; ++iy) {
+            long peak = (iy >= first[0] && iy <= last[0]) ? 1 : 0;
+            long bg = 0;
+            for (unsigned g = 1; g <= nBg; ++g)
+                if (iy >= first[g] && iy <= last[g])
+                    ++bg;
+            if (peak == 0 && bg == 0)
+                continue;
+
+            const long* row = &values_[iy * nBinX_];
+            long wResult = peak - bg;
+            long wErr = peak + bg;
+            for (unsigned ix = 0; ix < nBinX_ ; ++ix) {
+                result[ix] += wResult * row[ix];
+                err[ix] += wErr * row[ix];
+            }
+        }
+    }
+}
 
-    Histogram1D* gate = new Histogram1D(xMin_, xMax_, nBinX_, "");
-    gate->setDataRaw(result);
-    return gate;
+void Histogram2D::buildSummedArea () {
+    unsigned w = nBinX_ + 1;
+    summedArea_.assign(w * (nBinY_ + 1), 0);
+
+    // Row y + 1 of the table is row y plus cumulative sum of the bins
+    for (unsigned iy = 0; iy < nBinY_; ++iy) {
+        const long* in = &values_[iy * nBinX_];
+        const long long* above = &summedArea_[iy * w];
+        long long* out = &summedArea_[(iy + 1) * w];
+        long long rowSum = 0;
+        for (unsigned ix = 0; ix < nBinX_; ++ix) {
+            rowSum += in[ix];
+            out[ix + 1] = above[ix + 1] + rowSum;
+        }
+    }
+    hasSummedArea_ = true;
 }
 
-void Histogram2D::transpose () {
-    vector<long> transposed;
-    transposed.reserve(values_.size());
+void Histogram2D::clearSummedArea () {
+    vector<long long>().swap(summedArea_);
+    hasSummedArea_ = false;
+}
+
+HistogramStatistics Histogram2D::statistics (unsigned x0, unsigned x1,
+                                             unsigned y0, unsigned y1) const {
+    if (x0 > x1 || x1 >= nBinX_ || y0 > y1 || y1 >= nBinY_)
+        throw ArrayError("Histogram2D::statistics: Matrix subscript out of bounds");
+
+    HistogramStatistics stats = HistogramStatistics();
+    stats.min = LONG_MAX;
+    stats.max = LONG_MIN;
+
+    // X moments are summed over rows, Y moments come from row sums
+    unsigned n = x1 - x0 + 1;
+    double sx1 = 0;
+    double sx2 = 0;
+    double sy1 = 0;
+    double sy2 = 0;
+    unsigned firstX = n;
+    unsigned lastX = 0;
+    unsigned firstY = y1 + 1;
+    unsigned lastY = 0;
+    for (unsigned iy = y0; iy <= y1; ++iy) {
+        long rowSum = 0;
+        unsigned first = 0;
+        unsigned last = 0;
+        binMoments(&values_[iy * nBinX_ + x0], n, rowSum, sx1, sx2,
+                   stats.min, stats.max, stats.nonZero, first, last);
+        if (first < n) {
+            firstX = min(firstX, first);
+            lastX = max(lastX, last);
+            if (firstY > y1)
+                firstY = iy;
+            lastY = iy;
+        }
+        double y = double(iy - y0);
+        stats.sum += rowSum;
+        sy1 += rowSum * y;
+        sy2 += rowSum * y * y;
+    }
 
-    for (unsigned x = 0; x < nBinX_; ++x)
-        for (unsigned y = 0; y < nBinY_; ++y)
-            transposed.push_back((*this)(x,y));
+    momentsToStatistics(stats.sum, sx1, sx2, getXlow(x0), binWidthX_,
+                        stats.mean[0], stats.variance[0]);
+    momentsToStatistics(stats.sum, sy1, sy2, getYlow(y0), binWidthY_,
+                        stats.mean[1], stats.variance[1]);
+    if (firstX < n) {
+        stats.low[0] = getXlow(x0 + firstX);
+        stats.high[0] = getXhigh(x0 + lastX);
+        stats.low[1] = getYlow(firstY);
+        stats.high[1] = getYhigh(lastY);
+    } else {
+        stats.low[0] = getXlow(x0);
+        stats.high[0] = getXhigh(x1);
+        stats.low[1] = getYlow(y0);
+        stats.high[1] = getYhigh(y1);
+    }
+    return stats;
+}
+
+HistogramStatistics Histogram2D::statistics () const {
+    return statistics(0, nBinX_ - 1, 0, nBinY_ - 1);
+}
+
+long long Histogram2D::getRectSum (unsigned x0, unsigned x1,
+                                   unsigned y0, unsigned y1) const {
+    if (x0 > x1 || y0 > y1 || x1 >= nBinX_ || y1 >= nBinY_)
+        throw ArrayError("Histogram2D::getRectSum: Matrix subscript out of bounds");
+
+    if (hasSummedArea_)
+        return sat(x1 + 1, y1 + 1) - sat(x0, y1 + 1)
+             - sat(x1 + 1, y0) + sat(x0, y0);
+
+    long long sum = 0;
+    for (unsigned iy = y0; iy <= y1; ++iy)
+        for (unsigned ix = x0; ix <= x1; ++ix)
+            sum += values_[iy * nBinX_ + ix];
+    return sum;
+}
+
+Histogram2D* Histogram2D::crop (unsigned x0, unsigned x1,
+                                unsigned y0, unsigned y1,
+                                double xMin, double xMax,
+                                double yMin, double yMax) const {
+    if (x1 > nBinX_ || y1 > nBinY_)
+        throw ArrayError("Histogram2D::crop: Matrix subscript out of bounds");
+    if (x0 >= x1 || y0 >= y1)
+        throw ArrayError("Histogram2D::crop: Empty range");
+
+    unsigned nx = x1 - x0;
+    Histogram2D* cropped = new Histogram2D(xMin, xMax, yMin, yMax,
+                                           nx, y1 - y0, "");
+    long* out = &cropped->values_[0];
+    for (unsigned y = y0; y < y1; ++y) {
+        const long* in = &values_[y * nBinX_ + x0];
+        for (unsigned x = 0; x < nx; ++x)
+            out[x] = in[x];
+        out += nx;
+    }
+    return cropped;
+}
+
+void Histogram2D::transpose () {
+    hasSummedArea_ = false;
+    if (nBinX_ == nBinY_)
+        transposeSquare();
+    else
+        transposeCycles();
 
-    values_.swap(transposed);
     double   yMin = yMin_;
     double   yMax = yMax_;
     unsigned nBinY = nBinY_;
+    double   binWidthY = binWidthY_;
 
     yMin_ = xMin_;
     yMax_ = xMax_;
     nBinY_ = nBinX_;
+    binWidthY_ = binWidthX_;
 
     xMin_ = yMin;
     xMax_ = yMax;
     nBinX_ = nBinY;
+    binWidthX_ = binWidthY;
+}
+
+void Histogram2D::transposeSquare () {
+    unsigned n = nBinX_;
+    long* a = &values_[0];
+
+    for (unsigned bi = 0; bi < n; bi += transposeTile_) {
+        unsigned ei = min(bi + transposeTile_, n);
+
+        // Diagonal tile, swap elements above diagonal with those below
+        for (unsigned i = bi; i < ei; ++i)
+            for (unsigned j = i + 1; j < ei; ++j)
+                swap(a[i * n + j], a[j * n + i]);
+
+        // Off diagonal tiles (bi, bj) and (bj, bi) are swapped
+        // with each other
+        for (unsigned bj = ei; bj < n; bj += transposeTile_) {
+            unsigned ej = min(bj + transposeTile_, n);
+            for (unsigned i = bi; i < ei; ++i)
+                for (unsigned j = bj; j < ej; ++j)
+                    swap(a[i * n + j], a[j * n + i]);
+        }
+    }
+}
+
+void Histogram2D::transposeCycles () {
+    // Element at position p = y * nBinX_ + x goes to x * nBinY_ + y.
+    // First and last elements never move.
+    unsigned long n = values_.size();
+    if (n < 3)
+        return;
+    unsigned long nx = nBinX_;
+    unsigned long ny = nBinY_;
+
+    vector<bool> moved(n, false);
+    for (unsigned long start = 1; start < n - 1; ++start) {
+        if (moved[start])
+            continue;
+
+        long carry = values_[start];
+        unsigned long p = start;
+        do {
+            unsigned long next = (p % nx) * ny + p / nx;
+            swap(carry, values_[next]);
+            moved[next] = true;
+            p = next;
+        } while (p != start);
+    }
 }
 
 Histogram2D* Histogram2D::rebin ( double xMin, double xMax,
@@ -451,48 +1048,73 @@ Histogram2D* Histogram2D::rebin ( double xMin, double xMax,
     double binWX = (xMax - xMin) / double(nBinX);   
     double binWY = (yMax - yMin) / double(nBinY);   
 
+    int factorX = 0;
+    int factorY = 0;
+    int offsetX = 0;
+    int offsetY = 0;
+    if (isIntegerRatio(binWX, binWidthX_, factorX) && factorX >= 1 &&
+        isIntegerRatio(binWY, binWidthY_, factorY) && factorY >= 1 &&
+        isIntegerRatio(xMin - xMin_, binWidthX_, offsetX) &&
+        isIntegerRatio(yMin - yMin_, binWidthY_, offsetY))
+        return rebinInteger(xMin, xMax, yMin, yMax, nBinX, nBinY,
+                            factorX, offsetX, factorY, offsetY);
+
+    // Area of intersection of old and new bins is a product of
+    // the overlaps in X and Y, so the weights are calculated once per axis
+    vector<unsigned> firstX, firstY;
+    vector<int> binsX, binsY;
+    vector<double> wX, wY;
+    overlapWeights(xMin_, binWidthX_, nBinX_, xMin, binWX, firstX, binsX, wX);
+    overlapWeights(yMin_, binWidthY_, nBinY_, yMin, binWY, firstY, binsY, wY);
+
     double underflow = 0;
     double overflow = 0;
 
-    unsigned sz = values_.size();
     vector<double> values;
     values.resize(nBinX * nBinY, 0.0);
-    
-    for (unsigned i = 0; i < sz; ++i) {
-        vector<double> px;
-        vector<double> py;
-        unsigned x = i % nBinX_;
-        unsigned y = i / nBinX_;
-
-        px.push_back(getXlow(x));
-        py.push_back(getYlow(y));
-
-        int bx0 = (getXlow(x) - xMin) / binWX;
-        int by0 = (getYlow(y) - yMin) / binWY;
-        int bx1 = (getXhigh(x) - xMin) / binWX;
-        int by1 = (getYhigh(y) - yMin) / binWY;
-        for (int b = bx0; b < bx1; ++b)
-            px.push_back( (b + 1) * binWX + xMin );
-
-        for (int b = by0; b < by1; ++b)
-            py.push_back( (b + 1) * binWY + yMin );
-
-        px.push_back(getXhigh(x));
-        py.push_back(getYhigh(y));
-
-        for (unsigned j = 0; j < px.size() - 1; ++j) {
-            for (unsigned k = 0; k < py.size() - 1; ++k) {
-                double area = (px[j+1] - px[j]) / binWidthX_ 
-                            * (py[k+1] - py[k]) / binWidthY_ * values_[i];
-                
-                int ix = bx0 + j;
-                int iy = by0 + k;
-                if (ix < 0 || iy < 0)
-                    underflow += area;
-                else if (ix > (int)(nBinX - 1) || iy > (int)(nBinY - 1))
-                    overflow += area;
+
+    // One old row rebinned along X. Element 0 collects parts going
+    // below the new X range, element nBinX + 1 the parts above it.
+    vector<double> row(nBinX + 2, 0.0);
+
+    for (unsigned y = 0; y < nBinY_; ++y) {
+        // First pass: along X
+        for (unsigned ix = 0; ix < nBinX + 2; ++ix)
+            row[ix] = 0.0;
+
+        const long* in = &values_[y * nBinX_];
+        for (unsigned x = 0; x < nBinX_; ++x) {
+            if (in[x] == 0)
+                continue;
+            double v = double(in[x]);
+            for (unsigned k = firstX[x]; k < firstX[x + 1]; ++k) {
+                int ix = binsX[k];
+                if (ix < 0)
+                    row[0] += wX[k] * v;
+                else if (ix > (int)(nBinX - 1))
+                    row[nBinX + 1] += wX[k] * v;
                 else
-                    values[iy * (nBinX ) + ix] += area;
+                    row[ix + 1] += wX[k] * v;
+            }
+        }
+
+        // Second pass: along Y
+        for (unsigned k = firstY[y]; k < firstY[y + 1]; ++k) {
+            int iy = binsY[k];
+            double w = wY[k];
+            if (iy < 0) {
+                for (unsigned ix = 0; ix < nBinX + 2; ++ix)
+                    underflow += w * row[ix];
+            } else if (iy > (int)(nBinY - 1)) {
+                underflow += w * row[0];
+                for (unsigned ix = 1; ix < nBinX + 2; ++ix)
+                    overflow += w * row[ix];
+            } else {
+                underflow += w * row[0];
+                overflow += w * row[nBinX + 1];
+                double* out = &values[iy * nBinX];
+                for (unsigned ix = 0; ix < nBinX; ++ix)
+                    out[ix] += w * row[ix + 1];
             }
         }
     }
@@ -500,11 +1122,83 @@ Histogram2D* Histogram2D::rebin ( double xMin, double xMax,
     Histogram2D* rebinned = new Histogram2D(xMin, xMax, yMin, yMax, nBinX, nBinY, "");
     rebinned->setDataRaw(values);
     rebinned->underflow_ = underflow;
-    rebinned->overflow_ = overflow_;
+    rebinned->overflow_ = overflow;
 
     return rebinned;
 }
 
+Histogram2D* Histogram2D::rebinInteger (double xMin, double xMax,
+                                        double yMin, double yMax,
+                                        unsigned nBinX, unsigned nBinY,
+                                        int factorX, int offsetX,
+                                        int factorY, int offsetY) const {
+    Histogram2D* rebinned = new Histogram2D(xMin, xMax, yMin, yMax, nBinX, nBinY, "");
+
+    long underflow = 0;
+    long overflow = 0;
+    blockSum(&rebinned->values_[0], nBinX, nBinY,
+             factorX, offsetX, factorY, offsetY, underflow, overflow);
+
+    rebinned->underflow_ = underflow;
+    rebinned->overflow_ = overflow;
+    return rebinned;
+}
+
+void Histogram2D::blockSum (long* out, unsigned nBinX, unsigned nBinY,
+                            int factorX, int offsetX,
+                            int factorY, int offsetY,
+                            long& underflow, long& overflow) const {
+    long szX = nBinX_;
+    long szY = nBinY_;
+    const long* in = &values_[0];
+
+    // Old row rebinned along X
+    vector<long> row(nBinX, 0);
+
+    // Old bins below offsetX go to underflow, as do whole rows below
+    // offsetY. Bins above new range go to overflow (unless they are
+    // already counted as underflow). New rows are written only after
+    // the old row is read, so out may be the same array as in.
+    long lastRow = -1;
+    for (long y = 0; y < szY; ++y) {
+        const long* inRow = in + y * szX;
+        long iy = (y - offsetY) / factorY;
+        if (y < offsetY || iy >= (long)nBinY) {
+            long x = 0;
+            long sum = 0;
+            for (; x < szX && x < offsetX; ++x)
+                sum += inRow[x];
+            underflow += sum;
+            sum = 0;
+            for (; x < szX; ++x)
+                sum += inRow[x];
+            if (y < offsetY)
+                underflow += sum;
+            else
+                overflow += sum;
+            continue;
+        }
+
+        sumBins(inRow, szX, &row[0], nBinX, factorX, offsetX,
+                underflow, overflow);
+
+        long* outRow = out + iy * nBinX;
+        if (iy != lastRow) {
+            for (long r = lastRow + 1; r < iy; ++r)
+                for (unsigned ix = 0; ix < nBinX; ++ix)
+                    out[r * nBinX + ix] = 0;
+            for (unsigned ix = 0; ix < nBinX; ++ix)
+                outRow[ix] = row[ix];
+            lastRow = iy;
+        } else {
+            for (unsigned ix = 0; ix < nBinX; ++ix)
+                outRow[ix] += row[ix];
+        }
+    }
+    for (long r = lastRow + 1; r < (long)nBinY; ++r)
+        for (unsigned ix = 0; ix < nBinX; ++ix)
+            out[r * nBinX + ix] = 0;
+}
 
 Histogram2D* Histogram2D::rebin ( double xMin, double xMax,
                                   double yMin, double yMax,
@@ -519,6 +1213,81 @@ Histogram2D* Histogram2D::rebin ( double xMin, double xMax,
     return rebin(xMin, xMax, yMin, yMax, nBinX, nBinY);
 }
 
+unique_ptr<Histogram2D> Histogram2D::rebinUnique (double xMin, double xMax,
+                                                  double yMin, double yMax,
+                                                  unsigned nBinX,
+                                                  unsigned nBinY) const {
+    return unique_ptr<Histogram2D>(rebin(xMin, xMax, yMin, yMax,
+                                         nBinX, nBinY));
+}
+
+unique_ptr<Histogram2D> Histogram2D::rebinUnique (double xMin, double xMax,
+                                                  double yMin, double yMax,
+                                                  double binWX,
+                                                  double binWY) const {
+    return unique_ptr<Histogram2D>(rebin(xMin, xMax, yMin, yMax,
+                                         binWX, binWY));
+}
+
+void Histogram2D::rebinInPlace (double xMin, double xMax,
+                                double yMin, double yMax,
+                                unsigned nBinX, unsigned nBinY) {
+    if (nBinX < 1 || nBinY < 1)
+        throw GenError("Histogram2D::rebinInPlace: number of bins cannot be less then 1");
+    double binWX = (xMax - xMin) / double(nBinX);   
+    double binWY = (yMax - yMin) / double(nBinY);   
+
+    int factorX = 0;
+    int factorY = 0;
+    int offsetX = 0;
+    int offsetY = 0;
+    if (isIntegerRatio(binWX, binWidthX_, factorX) && factorX >= 1 &&
+        isIntegerRatio(binWY, binWidthY_, factorY) && factorY >= 1 &&
+        isIntegerRatio(xMin - xMin_, binWidthX_, offsetX) && offsetX >= 0 &&
+        isIntegerRatio(yMin - yMin_, binWidthY_, offsetY) && offsetY >= 0 &&
+        nBinX <= nBinX_) {
+        unsigned long sz = (unsigned long)nBinX * nBinY;
+        if (sz > values_.size())
+            values_.resize(sz, 0);
+
+        long underflow = 0;
+        long overflow = 0;
+        blockSum(&values_[0], nBinX, nBinY,
+                 factorX, offsetX, factorY, offsetY, underflow, overflow);
+        values_.resize(sz);
+
+        xMin_ = xMin;
+        xMax_ = xMax;
+        nBinX_ = nBinX;
+        binWidthX_ = binWX;
+        yMin_ = yMin;
+        yMax_ = yMax;
+        nBinY_ = nBinY;
+        binWidthY_ = binWY;
+        underflow_ = underflow;
+        overflow_ = overflow;
+        dataChanged();
+    } else {
+        unique_ptr<Histogram2D> rebinned = rebinUnique(xMin, xMax, yMin, yMax,
+                                                       nBinX, nBinY);
+        rebinned->hisId_ = hisId_;
+        *this = std::move(*rebinned);
+    }
+}
+
+void Histogram2D::rebinInPlace (double xMin, double xMax,
+                                double yMin, double yMax,
+                                double binWX, double binWY) {
+    if (binWX <= 0 || binWY <= 0)
+        throw GenError("Histogram2D::rebinInPlace: bin width must be greater then 0");
+
+    unsigned nBinX = unsigned((xMax - xMin) / binWX) + 1;
+    xMax = xMin + nBinX * binWX;
+    unsigned nBinY = unsigned((yMax - yMin) / binWY) + 1;
+    yMax = yMin + nBinY * binWY;
+    rebinInPlace(xMin, xMax, yMin, yMax, nBinX, nBinY);
+}
+
 Histogram2D& Histogram2D::operator=(const Histogram2D& right){
     // Self assigment test
     if (this == &right)
@@ -536,11 +1305,30 @@ Histogram2D& Histogram2D::operator=(const Histogram2D& right){
 
     this->hisId_ = right.hisId_;
     this->values_ = right.values_;
+    this->summedArea_ = right.summedArea_;
+    this->hasSummedArea_ = right.hasSummedArea_;
+
+    return *this;
+}
+
+Histogram2D& Histogram2D::operator=(Histogram2D&& right){
+    if (this == &right)
+        return *this;
+
+    Histogram::operator=(std::move(right));
+    this->yMin_ = right.yMin_;
+    this->yMax_ = right.yMax_;
+    this->nBinY_= right.nBinY_;
+    this->binWidthY_ = right.binWidthY_;
+    this->summedArea_ = std::move(right.summedArea_);
+    this->hasSummedArea_ = right.hasSummedArea_;
+    right.hasSummedArea_ = false;
 
     return *this;
 }
 
 Histogram2D& Histogram2D::operator*=(int right) {
+    hasSummedArea_ = false;
     unsigned sz = this->values_.size();
     for (unsigned i = 0; i < sz; ++i)
         this->values_[i] *= right;
@@ -548,6 +1336,7 @@ Histogram2D& Histogram2D::operator*=(int right) {
 }
 
 Histogram2D& Histogram2D::operator+=(const Histogram2D& right) {
+    hasSummedArea_ = false;
     if (this->xMin_ == right.xMin_ &&
         this->xMax_ == right.xMax_ &&
         this->yMin_ == right.yMin_ &&
@@ -565,6 +1354,7 @@ Histogram2D& Histogram2D::operator+=(const Histogram2D& right) {
 }
 
 Histogram2D& Histogram2D::operator-=(const Histogram2D& right) {
+    hasSummedArea_ = false;
     if (this->xMin_ == right.xMin_ &&
         this->xMax_ == right.xMax_ &&
         this->yMin_ == right.yMin_ &&
@@ -581,26 +1371,46 @@ Histogram2D& Histogram2D::operator-=(const Histogram2D& right) {
     }
 }
 
-const Histogram2D Histogram2D::operator*(int right) const {
-    Histogram2D result = *this;
+Histogram2D Histogram2D::operator*(int right) const & {
+    Histogram2D result(*this);
     result *= right;
     return result;
 }
 
-const Histogram2D Histogram2D::operator+(const Histogram2D& right) const {
-    Histogram2D result = *this;
+Histogram2D Histogram2D::operator*(int right) && {
+    Histogram2D result(std::move(*this));
+    result *= right;
+    return result;
+}
+
+Histogram2D Histogram2D::operator+(const Histogram2D& right) const & {
+    Histogram2D result(*this);
+    result += right;
+    return result;
+}
+
+Histogram2D Histogram2D::operator+(const Histogram2D& right) && {
+    Histogram2D result(std::move(*this));
     result += right;
     return result;
 }
 
-const Histogram2D Histogram2D::operator-(const Histogram2D& right) const {
-    Histogram2D result = *this;
+Histogram2D Histogram2D::operator-(const Histogram2D& right) const & {
+    Histogram2D result(*this);
+    result -= right;
+    return result;
+}
+
+Histogram2D Histogram2D::operator-(const Histogram2D& right) && {
+    Histogram2D result(std::move(*this));
     result -= right;
     return result;
 }
 
 
 long& Histogram2D::operator()(unsigned ix, unsigned iy) {
+   // Reference may be used to modify the bin
+   hasSummedArea_ = false;
    if (ix < nBinX_ && iy < nBinY_ )
      return values_[iy * nBinX_  + ix];
    else
@@ -0,0 +1,191 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "HistogramND.h"
+#include "Exceptions.h"
+
+using namespace std;
+
+//
+//****************************************************  class  HistogramND
+//
+
+HistogramND::HistogramND (const vector<double>& min,
+                          const vector<double>& max,
+                          const vector<unsigned>& nBin, string hisId)
+                        : Histogram(min.at(0), max.at(0), nBin.at(0), hisId),
+                          min_(min), max_(max), nBin_(nBin) {
+    if (max.size() != nBin.size() || min.size() != nBin.size())
+        throw GenError("HistogramND(): sizes of axes definitions differ");
+
+    unsigned long size = 1;
+    for (unsigned d = 0; d < nBin_.size(); ++d) {
+        if (nBin_[d] < 1)
+            throw GenError("HistogramND(): number of bins cannot be less then 1");
+        binWidth_.push_back((max_[d] - min_[d]) / double(nBin_[d]));
+        stride_.push_back(size);
+        size *= nBin_[d];
+    }
+    values_.resize(size, 0);
+}
+
+unsigned HistogramND::getBin (unsigned axis, double x) const {
+    if (x > min_.at(axis) && x < max_[axis])
+        return (unsigned)( (x - min_[axis]) / binWidth_[axis] );
+    else if (x <= min_[axis])
+        return 0;
+    else
+        return nBin_[axis] - 1;
+}
+
+unsigned long HistogramND::index (const vector<unsigned>& bin) const {
+    if (bin.size() != nBin_.size())
+        throw ArrayError("HistogramND::index: wrong number of indexes");
+    unsigned long i = 0;
+    for (unsigned d = 0; d < nBin_.size(); ++d) {
+        if (bin[d] >= nBin_[d])
+            throw ArrayError("HistogramND::index: Matrix subscript out of bounds");
+        i += bin[d] * stride_[d];
+    }
+    return i;
+}
+
+long HistogramND::get (const vector<unsigned>& bin) const {
+    return values_[index(bin)];
+}
+
+long& HistogramND::operator() (const vector<unsigned>& bin) {
+    return values_[index(bin)];
+}
+
+long HistogramND::operator() (const vector<unsigned>& bin) const {
+    return values_[index(bin)];
+}
+
+void HistogramND::gateBins (const vector<double>& low,
+                            const vector<double>& high,
+                            vector<unsigned>& first,
+                            vector<unsigned>& last) const {
+    unsigned dim = nBin_.size();
+    if (low.size() != dim || high.size() != dim)
+        throw GenError("HistogramND::gateBins: gate is required for each axis");
+
+    first.resize(dim);
+    last.resize(dim);
+    for (unsigned d = 0; d < dim; ++d) {
+        first[d] = getBin(d, low[d]);
+        last[d] = getBin(d, high[d]);
+    }
+}
+
+void HistogramND::projectBox (const vector<unsigned>& first,
+                              const vector<unsigned>& last,
+                              const vector<unsigned long>& outStride,
+                              long* out) const {
+    unsigned dim = nBin_.size();
+    for (unsigned d = 0; d < dim; ++d)
+        if (first[d] > last[d])
+            return;
+
+    // Position of the current run (axes 1 and up), odometer-like
+    vector<unsigned> bin(first);
+    unsigned runLength = last[0] - first[0] + 1;
+    unsigned long runStride = outStride[0];
+
+    while (true) {
+        unsigned long in = first[0];
+        unsigned long o = first[0] * runStride;
+        for (unsigned d = 1; d < dim; ++d) {
+            in += bin[d] * stride_[d];
+            o += bin[d] * outStride[d];
+        }
+
+        const long* run = &values_[in];
+        if (runStride == 0) {
+            long sum = 0;
+            for (unsigned i = 0; i < runLength; ++i)
+                sum += run[i];
+            out[o] += sum;
+        } else if (runStride == 1) {
+            long* target = &out[o];
+            for (unsigned i = 0; i < runLength; ++i)
+                target[i] += run[i];
+        } else {
+            for (unsigned i = 0; i < runLength; ++i)
+                out[o + i * runStride] += run[i];
+        }
+
+        unsigned d = 1;
+        for (; d < dim; ++d) {
+            if (bin[d] < last[d]) {
+                ++bin[d];
+                break;
+            }
+            bin[d] = first[d];
+        }
+        if (d >= dim)
+            break;
+    }
+}
+
+void HistogramND::projectInto (Histogram1D& projection, unsigned axis,
+                               const vector<double>& low,
+                               const vector<double>& high) const {
+    if (axis >= nBin_.size())
+        throw GenError("HistogramND::projectInto: no such axis");
+
+    vector<unsigned> first, last;
+    gateBins(low, high, first, last);
+
+    projection.reset(min_[axis], max_[axis], nBin_[axis]);
+
+    vector<unsigned long> outStride(nBin_.size(), 0);
+    outStride[axis] = 1;
+    projectBox(first, last, outStride, &projection[0]);
+}
+
+void HistogramND::projectInto (Histogram2D& projection,
+                               unsigned axisX, unsigned axisY,
+                               const vector<double>& low,
+                               const vector<double>& high) const {
+    if (axisX >= nBin_.size() || axisY >= nBin_.size())
+        throw GenError("HistogramND::projectInto: no such axis");
+    if (axisX == axisY)
+        throw GenError("HistogramND::projectInto: projection axes must differ");
+
+    vector<unsigned> first, last;
+    gateBins(low, high, first, last);
+
+    projection = Histogram2D(min_[axisX], max_[axisX],
+                             min_[axisY], max_[axisY],
+                             nBin_[axisX], nBin_[axisY], "");
+
+    vector<unsigned long> outStride(nBin_.size(), 0);
+    outStride[axisX] = 1;
+    outStride[axisY] = nBin_[axisX];
+    projectBox(first, last, outStride, &projection(0, 0));
+}
+
+Histogram1D* HistogramND::project (unsigned axis,
+                                   const vector<double>& low,
+                                   const vector<double>& high) const {
+    unique_ptr<Histogram1D> projection(new Histogram1D(0.0, 1.0, 1, ""));
+    projectInto(*projection, axis, low, high);
+    return projection.release();
+}
+
+Histogram2D* HistogramND::project (unsigned axisX, unsigned axisY,
+                                   const vector<double>& low,
+                                   const vector<double>& high) const {
+    unique_ptr<Histogram2D> projection(new Histogram2D(0.0, 1.0, 0.0, 1.0,
+                                                       1, 1, ""));
+    projectInto(*projection, axisX, axisY, low, high);
+    return projection.release();
+}
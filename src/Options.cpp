@@ -14,15 +14,29 @@ Options::Options() {
     isListMode_ = false;
     isListModeZ_ = false;
     isInfoMode_ = false;
+    isIndexMode_ = false;
+    isAutoCrop_ = false;
+    isHelp_ = false;
+    isStats_ = false;
     isZeroSup_ = false;
     isGx_ = false;
     isGy_ = false;
+    isGz_ = false;
+    isGw_ = false;
     isBg_ = false;
     isSBg_ = false;
     isPg_ = false;
     isBin_ = false;
     isEvery_ = false;
     polygonFile_ = "";
+    projection_ = "";
+    gateFile_ = "";
+    batch_ = "";
+    serve_ = "";
+    output_ = "";
+    maxReads_ = 4;
+    format_ = formatText;
+    threads_ = 0;
     bin_.push_back(1);
     bin_.push_back(1);
     every_.push_back(1);
@@ -66,6 +80,17 @@ void Options::setListModeZ (bool b /*=true*/) {
 bool Options::getInfoMode() const { return isInfoMode_; }
 void Options::setInfoMode (bool b /*=true*/) { isInfoMode_ = b; }
 
+bool Options::getIndexMode() const { return isIndexMode_; }
+void Options::setIndexMode (bool b /*=true*/) { isIndexMode_ = b; }
+
+bool Options::getAutoCrop() const { return isAutoCrop_; }
+void Options::setAutoCrop (bool b /*=true*/) { isAutoCrop_ = b; }
+
+bool Options::getHelp() const { return isHelp_; }
+void Options::setHelp (bool b /*=true*/) { isHelp_ = b; }
+
+bool Options::getStats() const { return isStats_; }
+void Options::setStats (bool b /*=true*/) { isStats_ = b; }
 
 bool Options::getZeroSup() const { return isZeroSup_; }
 void Options::setZeroSup (bool b /*=true*/) { isZeroSup_ = b; }
@@ -98,6 +123,114 @@ bool Options::setGy (unsigned g0, unsigned g1, bool isGy /*=true*/) {
     return true;
 }
 
+bool Options::getGz() const { return isGz_; }
+bool Options::setGz (unsigned g0, unsigned g1, bool isGz /*=true*/) {
+    if (g0 > g1)
+        return false;
+    gz_.clear();
+    isGz_ = isGz;
+    if (isGz) {
+        gz_.resize(2, 0);
+        gz_[0] = g0;
+        gz_[1] = g1;
+    }
+    return true;
+}
+
+bool Options::getGw() const { return isGw_; }
+bool Options::setGw (unsigned g0, unsigned g1, bool isGw /*=true*/) {
+    if (g0 > g1)
+        return false;
+    gw_.clear();
+    isGw_ = isGw;
+    if (isGw) {
+        gw_.resize(2, 0);
+        gw_[0] = g0;
+        gw_[1] = g1;
+    }
+    return true;
+}
+
+bool Options::setProjection (std::string axes) {
+    if (axes.size() < 1 || axes.size() > 2)
+        return false;
+    for (unsigned i = 0; i < axes.size(); ++i)
+        if (std::string("xyzw").find(axes[i]) == std::string::npos)
+            return false;
+    if (axes.size() == 2 && axes[0] == axes[1])
+        return false;
+    projection_ = axes;
+    return true;
+}
+
+std::string Options::getProjection() const {
+    return projection_;
+}
+
+void Options::setGateFile (std::string gateFile) {
+    gateFile_ = gateFile;
+}
+
+std::string Options::getGateFile() const {
+    return gateFile_;
+}
+
+bool Options::setFormat (std::string format) {
+    if (format == "text")
+        format_ = formatText;
+    else if (format == "raw")
+        format_ = formatRaw;
+    else if (format == "gnuplot-matrix")
+        format_ = formatGnuplotMatrix;
+    else
+        return false;
+    return true;
+}
+
+OutputFormat Options::getFormat() const {
+    return format_;
+}
+
+void Options::setBatch (std::string batchFile) {
+    batch_ = batchFile;
+}
+
+std::string Options::getBatch() const {
+    return batch_;
+}
+
+void Options::setServe (std::string socketPath) {
+    serve_ = socketPath;
+}
+
+std::string Options::getServe() const {
+    return serve_;
+}
+
+void Options::setOutput (std::string pattern) {
+    output_ = pattern;
+}
+
+std::string Options::getOutput() const {
+    return output_;
+}
+
+void Options::setMaxReads (unsigned n) {
+    maxReads_ = n;
+}
+
+unsigned Options::getMaxReads() const {
+    return maxReads_;
+}
+
+void Options::setThreads (unsigned n) {
+    threads_ = n;
+}
+
+unsigned Options::getThreads() const {
+    return threads_;
+}
+
 bool Options::getBg() const { return isBg_; }
 bool Options::setBg (unsigned b0, unsigned b1, bool isBg /*=true*/) {
     if (b0 > b1)
@@ -186,6 +319,21 @@ void Options::getGateY(std::vector<unsigned>& rtn) const {
         rtn.push_back(gy_[i]);
 }
 
+void Options::getGateZ(std::vector<unsigned>& rtn) const {
+    rtn.clear();
+    rtn.reserve(gz_.size());
+    unsigned sz = gz_.size();
+    for (unsigned i = 0; i < sz; ++i)
+        rtn.push_back(gz_[i]);
+}
+
+void Options::getGateW(std::vector<unsigned>& rtn) const {
+    rtn.clear();
+    rtn.reserve(gw_.size());
+    unsigned sz = gw_.size();
+    for (unsigned i = 0; i < sz; ++i)
+        rtn.push_back(gw_[i]);
+}
 
 void Options::getBgGate(std::vector<unsigned>& rtn) const {
     rtn.clear();
@@ -7,6 +7,8 @@
 
 #include <sstream> 
 #include <cstdlib> 
+#include <cmath> 
+#include <algorithm> 
 #include "Polygon.h"
 #include "Exceptions.h"
 #include "Debug.h"
@@ -19,6 +21,7 @@ Polygon::Polygon(const std::vector< Point >& vertices) {
 
     for(unsigned i = 0; i < sz; ++i)
         vertices_.push_back(vertices[i]);
+    buildIndex();
 }
 
 Polygon::Polygon(const std::string& polygonFileName) {
@@ -47,142 +50,229 @@ Polygon::Polygon(const std::string& polygonFileName) {
     fInput.close();
     if (vertices_.size() < 3)
         throw GenError("Polygon must contain 3 or more vertices.");
+    buildIndex();
 }
 
-/** Loads damm BAN file. Little messy, but works. Probably should be
- * rewritten in future. Did not found good documentation on BAN file structure
- * so far.
- */
 Polygon::Polygon(const std::string& polygonFileName, int banId) {
+    BanFile bans(polygonFileName);
+    *this = bans.find(banId);
+}
+
+void Polygon::buildIndex() {
     using namespace std;
+    unsigned nEdges = vertices_.size();
 
-    ifstream banf(polygonFileName.c_str());
-    if (!banf.good()) {
-        throw IOError("Could not open BAN file.");
+    slabY_.clear();
+    for (unsigned i = 0; i < nEdges; ++i)
+        slabY_.push_back(vertices_[i].y);
+    sort(slabY_.begin(), slabY_.end());
+    slabY_.erase(unique(slabY_.begin(), slabY_.end()), slabY_.end());
+    unsigned nY = slabY_.size();
+
+    // Vertices grouped by y
+    vector< vector<double> > byY(nY);
+    for (unsigned i = 0; i < nEdges; ++i) {
+        unsigned iy = lower_bound(slabY_.begin(), slabY_.end(),
+                                  vertices_[i].y) - slabY_.begin();
+        byY[iy].push_back(vertices_[i].x);
+    }
+    vertexStart_.clear();
+    vertexX_.clear();
+    for (unsigned iy = 0; iy < nY; ++iy) {
+        vertexStart_.push_back(vertexX_.size());
+        sort(byY[iy].begin(), byY[iy].end());
+        vertexX_.insert(vertexX_.end(), byY[iy].begin(), byY[iy].end());
     }
+    vertexStart_.push_back(vertexX_.size());
 
-    string in;
-    unsigned nPoints = 0;
-    while (banf >> in) {
-        if (in.find("INP") != string::npos) {
-            // file name (SKIP)
-            banf >> in;
-
-            // his id (SKIP)
-            banf >> in;
-            
-            // Banana id 
-            banf >> in;
-            int ban = atoi(in.c_str());
-            // Check if matches given
-            if (ban != banId)
-                continue;
+    // Edge from y0 to y1 (y0 < y1, both are slab boundaries) crosses 
+    // slabs from index of y0 to index of y1 - 1. Slabs are counted 
+    // first, then filled.
+    unsigned nSlabs = (nY > 0) ? nY - 1 : 0;
+    vector<unsigned> first(nEdges, 0);
+    vector<unsigned> last(nEdges, 0);
+    vector<unsigned> count(nSlabs + 1, 0);
+    for (unsigned i = 0; i < nEdges; ++i) {
+        const Point& p0 = vertices_[i];
+        const Point& p1 = (i == nEdges - 1) ? vertices_[0] : vertices_[i + 1];
+        if (p0.y == p1.y)
+            continue;
+        double low = min(p0.y, p1.y);
+        double high = max(p0.y, p1.y);
+        first[i] = lower_bound(slabY_.begin(), slabY_.end(), low) -
+                   slabY_.begin();
+        last[i] = lower_bound(slabY_.begin(), slabY_.end(), high) -
+                  slabY_.begin();
+        for (unsigned s = first[i]; s < last[i]; ++s)
+            ++count[s];
+    }
 
-            // Projection axis in degrees
-            // Stop if it's different then 0
-            banf >> in;
-            double angle = atof(in.c_str());
-            if (angle != 0)
-                throw GenError("BAN projection axis different then 0 is not\
-                        supported.");
-
-            // Number of points
-            banf >> in;
-            nPoints = atoi(in.c_str());
-            
-            // TIT (title) string (undefined number of tokens)
-            // Probably defined lenght in bytes (40?) but no documentation
-            // found.
-            banf >> in;
-            if (in == "TIT") {
-                // Read the rest of the crap until points are present
-                // CXY is the string defining start of XY position of points
-                while (true) {
-                    banf >> in;
-                    if (in == "CXY")
-                        break;
-                }
-            } else {
-                throw GenError("Wrong BAN file format"); 
-            }
+    slabStart_.assign(nSlabs + 1, 0);
+    for (unsigned s = 0; s < nSlabs; ++s)
+        slabStart_[s + 1] = slabStart_[s] + count[s];
+    unsigned total = slabStart_[nSlabs];
+    edgeX0_.assign(total, 0);
+    edgeY0_.assign(total, 0);
+    edgeX1_.assign(total, 0);
+    edgeY1_.assign(total, 0);
 
-            unsigned count = 0;
-            while (count <= nPoints) {
-                double x;
-                double y;
-                banf >> in;
-                //Points are in pairs X Y, separated by CXY keywords every 15-th
-                //point
-                if (in != "CXY") {
-                   x = atof(in.c_str());
-                   banf >> in;
-                   y = atof(in.c_str());
-
-                   vertices_.push_back(Point(x, y));
-                }
-                ++count;
-            }
+    vector<unsigned> fill(slabStart_.begin(), slabStart_.end());
+    for (unsigned i = 0; i < nEdges; ++i) {
+        const Point& p0 = vertices_[i];
+        const Point& p1 = (i == nEdges - 1) ? vertices_[0] : vertices_[i + 1];
+        for (unsigned s = first[i]; s < last[i]; ++s) {
+            unsigned k = fill[s]++;
+            edgeX0_[k] = p0.x;
+            edgeY0_[k] = p0.y;
+            edgeX1_[k] = p1.x;
+            edgeY1_[k] = p1.y;
         }
     }
-    banf.close();
-    if (vertices_.size() < 3)
-        throw GenError("BAN Polygon must contain 3 or more vertices.");
+}
+
+unsigned Polygon::countCrossings(unsigned s, double xp, double yp) const {
+    // Intersection of edge: f(x) = (y1-y0)/(x1-x0)*(x1-x) + y0
+    // and x-ray: r(x) = yp, counted if before we reach the point.
+    // No branches, so the loop may be vectorized.
+    unsigned nIntersec = 0;
+    unsigned end = slabStart_[s + 1];
+    for (unsigned k = slabStart_[s]; k < end; ++k) {
+        double xs = (yp - edgeY0_[k]) / (edgeY1_[k] - edgeY0_[k]) *
+                    (edgeX1_[k] - edgeX0_[k]) + edgeX0_[k];
+        nIntersec += (xs <= xp);
+    }
+    return nIntersec;
 }
 
 /**
  * Ray casting algotihm for Point in polygon problem.
  * ray starts from x=0, y=yp and goes to x=xp, y=yp
+ *
+ * Edges do not belong to polygon in this implementation. For an edge
+ * from y0 to y1 (y0 < y1) the ray crosses it if y0 < yp <= y1 (so a
+ * ray going through a vertex is counted once, and horizontal edges are
+ * never crossed). All such edges lie in the slab containing yp.
  */
-bool Polygon::pointIn(double xp, double yp) {
-    unsigned nEdges = vertices_.size();
-    unsigned nIntersec = 0;
-
-    for(unsigned i = 0; i < nEdges; ++i) {
-
-        Point p0 = vertices_[i];
-        Point p1(0.0, 0.0);
-
-        if (i == nEdges - 1)
-            p1 = vertices_[0];
-        else
-            p1 = vertices_[i + 1];
-          
-        // If point is exacly at the vertex it is by definition
-        // (in this implementation) outside
-        if ( (xp == p0.x && yp == p0.y) ||
-             (xp == p0.x && yp == p0.y) )
-            return false;
-        
-        // Edges do not belong to polygon in this implementation
-        // so we may exclude case of horizontal line
-        if (p0.y == p1.y)
-            continue;
+bool Polygon::pointIn(double xp, double yp) const {
+    unsigned nY = slabY_.size();
+    unsigned iy = std::lower_bound(slabY_.begin(), slabY_.end(), yp) -
+                  slabY_.begin();
 
-        // If yp is up or down given edge it won't cross it
-        // for sure
-        // Point 0 must be included (ray may go through the vertex)
-        // Point 1 must be excluded (otherwise intersection will be
-        // counted twice (this and next edge).
-        if ( (yp <= p0.y && yp <= p1.y) ||
-             (yp > p0.y && yp > p1.y) )
-            continue;
-        
-        // Now find intersection between 
-        // edge: f(x) = (y1-y0)/(x1-x0)*(x1-x) + y0
-        // x-ray: r(x) = yp
-        
-        // x position of intersection is:
-        double xs = (yp - p0.y) / (p1.y - p0.y) * (p1.x - p0.x) + p0.x;
-        
-        // If intersection is before we reach the point
-        if (xs <= xp)
-            ++nIntersec;
-    }
+    // If point is exacly at the vertex it is by definition
+    // (in this implementation) outside
+    if (iy < nY && slabY_[iy] == yp &&
+        std::binary_search(vertexX_.begin() + vertexStart_[iy],
+                           vertexX_.begin() + vertexStart_[iy + 1], xp))
+        return false;
 
-    if (nIntersec % 2 == 0)
+    // Below or at the lowest vertex, or above the highest one
+    if (iy == 0 || iy == nY)
         return false;
+
+    // yp is in slab (slabY_[iy - 1], slabY_[iy]]
+    return countCrossings(iy - 1, xp, yp) % 2 == 1;
+}
+
+void Polygon::pointsIn(const std::vector<double>& xs,
+                       const std::vector<double>& ys,
+                       std::vector<bool>& out) const {
+    unsigned sz = xs.size();
+    if (ys.size() != sz)
+        throw GenError("Polygon::pointsIn: xs and ys sizes differ");
+    out.resize(sz);
+    for (unsigned i = 0; i < sz; ++i)
+        out[i] = pointIn(xs[i], ys[i]);
+}
+
+void Polygon::crossings(double yp, std::vector<double>& xs) const {
+    xs.clear();
+    unsigned nY = slabY_.size();
+    unsigned iy = std::lower_bound(slabY_.begin(), slabY_.end(), yp) -
+                  slabY_.begin();
+    if (iy == 0 || iy == nY)
+        return;
+
+    // Same rules and arithmetic as in pointIn
+    unsigned s = iy - 1;
+    for (unsigned k = slabStart_[s]; k < slabStart_[s + 1]; ++k)
+        xs.push_back((yp - edgeY0_[k]) / (edgeY1_[k] - edgeY0_[k]) *
+                     (edgeX1_[k] - edgeX0_[k]) + edgeX0_[k]);
+    std::sort(xs.begin(), xs.end());
+}
+
+/** Returns first bin from x0 to x1 - 1 with middle >= x (x1 if none).
+ * Bins middles are calculated as in Histogram::getX, the first guess is
+ * corrected so that rounding can not change the result. */
+static unsigned firstBinFrom(double x, double xMin, double binW,
+                             unsigned x0, unsigned x1) {
+    double guess = ceil((x - xMin) / binW - 0.5);
+    unsigned i;
+    if (!(guess > x0))
+        i = x0;
+    else if (guess >= x1)
+        i = x1;
     else
-        return true;
+        i = unsigned(guess);
+
+    while (i > x0 && (double(i - 1) + 0.5) * binW + xMin >= x)
+        --i;
+    while (i < x1 && (double(i) + 0.5) * binW + xMin < x)
+        ++i;
+    return i;
+}
+
+void Polygon::rasterize(double xMin, double binWX, unsigned x0, unsigned x1,
+                        double yMin, double binWY, unsigned y0, unsigned y1,
+                        PolygonMask& mask) const {
+    mask.y0 = y0;
+    mask.y1 = (y1 > y0) ? y1 : y0;
+    mask.rowStart.clear();
+    mask.begin.clear();
+    mask.end.clear();
+
+    std::vector<double> xs;
+    std::vector<unsigned> excluded;
+    for (unsigned iy = y0; iy < mask.y1; ++iy) {
+        mask.rowStart.push_back(mask.begin.size());
+        double yp = (double(iy) + 0.5) * binWY + yMin;
+        crossings(yp, xs);
+
+        // Vertices are outside by definition
+        excluded.clear();
+        for (unsigned v = 0; v < vertices_.size(); ++v) {
+            if (vertices_[v].y != yp)
+                continue;
+            unsigned ix = firstBinFrom(vertices_[v].x, xMin, binWX, x0, x1);
+            if (ix < x1 && (double(ix) + 0.5) * binWX + xMin == vertices_[v].x)
+                excluded.push_back(ix);
+        }
+        std::sort(excluded.begin(), excluded.end());
+
+        // Inside between crossings 2k and 2k + 1 (and after the last
+        // one if their number is odd)
+        unsigned e = 0;
+        for (unsigned k = 0; k < xs.size(); k += 2) {
+            unsigned b = firstBinFrom(xs[k], xMin, binWX, x0, x1);
+            unsigned end = x1;
+            if (k + 1 < xs.size())
+                end = firstBinFrom(xs[k + 1], xMin, binWX, x0, x1);
+            while (b < end) {
+                while (e < excluded.size() && excluded[e] < b)
+                    ++e;
+                unsigned stop = end;
+                if (e < excluded.size() && excluded[e] < end)
+                    stop = excluded[e];
+                if (b < stop) {
+                    mask.begin.push_back(b);
+                    mask.end.push_back(stop);
+                }
+                if (stop == end)
+                    break;
+                b = stop + 1;
+            }
+        }
+    }
+    mask.rowStart.push_back(mask.begin.size());
 }
 
 /** Returns rectangle perpenticular to X and Y axis where polygon is located.*/
@@ -209,3 +299,126 @@ bool Polygon::rectangle(double& xlow, double& ylow,
     return true;
 
 }
+
+//
+//****************************************************  class  BanFile
+//
+
+/** Did not found good documentation on BAN file structure so far,
+ * the format is guessed from files made by damm.
+ */
+BanFile::BanFile(const std::string& banFileName) {
+    using namespace std;
+
+    ifstream banf(banFileName.c_str());
+    if (!banf.good()) {
+        throw IOError("Could not open BAN file.");
+    }
+
+    string in;
+    // True if 'in' holds INP of the next banana, already read while
+    // looking for points of a short one
+    bool nextBanana = false;
+    while (nextBanana || banf >> in) {
+        nextBanana = false;
+        if (in.find("INP") == string::npos)
+            continue;
+
+        // file name and his id (SKIP)
+        banf >> in;
+        banf >> in;
+
+        // Banana id 
+        if (!(banf >> in))
+            break;
+        int ban = atoi(in.c_str());
+
+        // Projection axis in degrees
+        banf >> in;
+        double angle = atof(in.c_str());
+
+        // Number of points
+        banf >> in;
+        unsigned nPoints = atoi(in.c_str());
+        
+        // TIT (title) string (undefined number of tokens)
+        // Probably defined lenght in bytes (40?) but no documentation
+        // found. Rest is skipped until points are present,
+        // CXY is the string defining start of XY position of points
+        // Errors are kept per banana, so a broken one does not prevent
+        // using the others (see find)
+        banf >> in;
+        if (in != "TIT") {
+            badIds_.push_back(ban);
+            badErrors_.push_back("Wrong BAN file format");
+            continue;
+        }
+        while (banf >> in) {
+            if (in == "CXY")
+                break;
+            if (in.find("INP") != string::npos) {
+                nextBanana = true;
+                break;
+            }
+        }
+
+        // Points are in pairs X Y, lines of points start with CXY keyword
+        vector< Point > vertices;
+        while (!nextBanana && vertices.size() < nPoints && banf >> in) {
+            if (in == "CXY")
+                continue;
+            if (in.find("INP") != string::npos) {
+                nextBanana = true;
+                break;
+            }
+            double x = atof(in.c_str());
+            if (!(banf >> in))
+                break;
+            if (in.find("INP") != string::npos) {
+                nextBanana = true;
+                break;
+            }
+            double y = atof(in.c_str());
+            vertices.push_back(Point(x, y));
+        }
+        if (vertices.size() < nPoints) {
+            badIds_.push_back(ban);
+            badErrors_.push_back("Wrong BAN file format, missing points");
+            continue;
+        }
+
+        if (angle != 0) {
+            rotated_.push_back(ban);
+            continue;
+        }
+        if (vertices.size() < 3) {
+            badIds_.push_back(ban);
+            badErrors_.push_back("BAN Polygon must contain 3 or more vertices.");
+            continue;
+        }
+        ids_.push_back(ban);
+        polygons_.push_back(Polygon(vertices));
+    }
+    banf.close();
+}
+
+const Polygon& BanFile::find(int banId) const {
+    for (unsigned i = 0; i < ids_.size(); ++i)
+        if (ids_[i] == banId)
+            return polygons_[i];
+
+    std::stringstream ss;
+    for (unsigned i = 0; i < badIds_.size(); ++i)
+        if (badIds_[i] == banId) {
+            ss << badErrors_[i] << " (banana " << banId << ")";
+            throw GenError(ss.str());
+        }
+    for (unsigned i = 0; i < rotated_.size(); ++i)
+        if (rotated_[i] == banId) {
+            ss << "BAN projection axis different then 0 is not supported"
+               << " (banana " << banId << ")";
+            throw GenError(ss.str());
+        }
+    ss << "No banana " << banId << " in BAN file";
+    throw GenError(ss.str());
+}
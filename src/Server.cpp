@@ -0,0 +1,389 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "Server.h"
+#include "Exceptions.h"
+#include "Debug.h"
+
+using namespace std;
+
+/** Number of request times kept for percentiles. */
+static const unsigned recentSize = 4096;
+
+/** Longest accepted request line. */
+static const unsigned maxRequest = 1 << 16;
+
+Server::Server(const string& socketPath, unsigned nThreads, Parser parser)
+              : socketPath_(socketPath), listenFd_(-1),
+                nThreads_(nThreads), parser_(parser),
+                running_(true), nRequests_(0), nErrors_(0),
+                sum_(0), sumSq_(0), min_(0), max_(0) {
+    if (nThreads_ == 0)
+        nThreads_ = max(1u, thread::hardware_concurrency());
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+        throw IOError("Server: socket path too long " + socketPath);
+    strcpy(address.sun_path, socketPath.c_str());
+
+    // Stale socket of previous server
+    struct stat st;
+    if (stat(socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(socketPath.c_str());
+
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd_ < 0)
+        throw IOError("Server: could not create socket");
+    if (bind(listenFd_, (sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listenFd_, 64) != 0) {
+        close(listenFd_);
+        throw IOError("Server: could not bind socket " + socketPath);
+    }
+    if (pipe(wakeFd_) != 0) {
+        close(listenFd_);
+        unlink(socketPath_.c_str());
+        throw IOError("Server: could not create pipe");
+    }
+}
+
+Server::~Server() {
+    for (unsigned i = 0; i < idle_.size(); ++i)
+        close(idle_[i].fd);
+    for (unsigned i = 0; i < queue_.size(); ++i)
+        close(queue_[i].fd);
+    close(wakeFd_[0]);
+    close(wakeFd_[1]);
+    close(listenFd_);
+    unlink(socketPath_.c_str());
+}
+
+void Server::wakeUp() {
+    char c = 0;
+    if (write(wakeFd_[1], &c, 1) != 1)
+        cerr << "Server: wake up failed" << endl;
+}
+
+void Server::run() {
+    vector<thread> workers;
+    for (unsigned t = 0; t < nThreads_; ++t)
+        workers.push_back(thread(&Server::worker, this));
+
+    while (true) {
+        // Listening socket, wake up pipe and idle connections
+        vector<pollfd> fds(2);
+        fds[0].fd = listenFd_;
+        fds[0].events = POLLIN;
+        fds[1].fd = wakeFd_[0];
+        fds[1].events = POLLIN;
+        {
+            lock_guard<mutex> lock(queueMutex_);
+            if (!running_)
+                break;
+            for (unsigned i = 0; i < idle_.size(); ++i) {
+                pollfd p;
+                p.fd = idle_[i].fd;
+                p.events = POLLIN;
+                p.revents = 0;
+                fds.push_back(p);
+            }
+        }
+
+        if (poll(&fds[0], fds.size(), -1) < 0)
+            continue;
+
+        if (fds[1].revents & POLLIN) {
+            char c[64];
+            if (read(wakeFd_[0], c, sizeof(c)) < 0)
+                continue;
+        }
+
+        lock_guard<mutex> lock(queueMutex_);
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listenFd_, 0, 0);
+            if (fd >= 0) {
+                Connection connection;
+                connection.fd = fd;
+                idle_.push_back(connection);
+            }
+        }
+
+        // Data is read here, without blocking, so a client sending
+        // a request slowly does not hold a worker; connections with a
+        // whole request go to workers, closed ones are dropped
+        for (unsigned i = 2; i < fds.size(); ++i) {
+            if (fds[i].revents == 0)
+                continue;
+            for (unsigned k = 0; k < idle_.size(); ++k) {
+                if (idle_[k].fd != fds[i].fd)
+                    continue;
+                Connection& connection = idle_[k];
+                char data[4096];
+                ssize_t n = recv(connection.fd, data, sizeof(data),
+                                 MSG_DONTWAIT);
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+                              errno == EINTR))
+                    break;
+                if (n > 0)
+                    connection.buffer.append(data, n);
+                if (hasLine(connection)) {
+                    queue_.push_back(connection);
+                    idle_.erase(idle_.begin() + k);
+                } else if (n <= 0 || connection.buffer.size() > maxRequest) {
+                    close(connection.fd);
+                    idle_.erase(idle_.begin() + k);
+                }
+                break;
+            }
+        }
+        queueChanged_.notify_all();
+    }
+
+    queueChanged_.notify_all();
+    for (unsigned t = 0; t < workers.size(); ++t)
+        workers[t].join();
+}
+
+void Server::worker() {
+    while (true) {
+        Connection connection;
+        {
+            unique_lock<mutex> lock(queueMutex_);
+            queueChanged_.wait(lock, [this] () {
+                return !running_ || !queue_.empty();
+            });
+            if (!running_)
+                return;
+            connection = queue_.front();
+            queue_.pop_front();
+        }
+
+        // All requests already received are served, then connection
+        // goes back to main thread
+        bool open = true;
+        string request;
+        while (open && readLine(connection, request))
+            open = serve(connection, request);
+
+        if (!open) {
+            close(connection.fd);
+            continue;
+        }
+
+        {
+            lock_guard<mutex> lock(queueMutex_);
+            idle_.push_back(connection);
+        }
+        wakeUp();
+    }
+}
+
+bool Server::hasLine(const Connection& connection) const {
+    return connection.buffer.find('\n') != string::npos;
+}
+
+bool Server::readLine(Connection& connection, string& line) {
+    size_t end = connection.buffer.find('\n');
+    if (end == string::npos)
+        return false;
+    line = connection.buffer.substr(0, end);
+    connection.buffer.erase(0, end + 1);
+    if (!line.empty() && line[line.size() - 1] == '\r')
+        line.erase(line.size() - 1);
+    return true;
+}
+
+bool Server::respond(int fd, bool ok, const string& payload) {
+    stringstream header;
+    header << (ok ? "OK " : "ERROR ") << payload.size() << "\n";
+    string response = header.str() + payload;
+
+    size_t sent = 0;
+    while (sent < response.size()) {
+        ssize_t n = send(fd, response.data() + sent, response.size() - sent,
+                         MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+bool Server::serve(Connection& connection, const string& request) {
+    string command;
+    istringstream(request) >> command;
+    if (command == "quit")
+        return false;
+
+    if (command == "shutdown") {
+        {
+            lock_guard<mutex> lock(queueMutex_);
+            running_ = false;
+        }
+        queueChanged_.notify_all();
+        wakeUp();
+        respond(connection.fd, true, "");
+        return false;
+    }
+
+    if (command == "stats") {
+        stringstream text;
+        printLatency(text);
+        return respond(connection.fd, true, text.str());
+    }
+
+    debug::Timer start;
+    stringstream text;
+    stringstream data;
+    bool binary = false;
+    bool ok = process(request, text, data, binary);
+    debug::Timer stop;
+    addLatency(double(stop - start), !ok);
+
+    if (ok && binary)
+        return respond(connection.fd, true, data.str());
+    return respond(connection.fd, ok, text.str());
+}
+
+bool Server::process(const string& request, ostream& text, ostream& data,
+                     bool& binary) {
+    vector<string> args;
+    args.push_back("readhis");
+    istringstream iss(request);
+    string token;
+    while (iss >> token)
+        args.push_back(token);
+
+    Options options;
+    string fileName;
+    bool parsed = false;
+    {
+        lock_guard<mutex> lock(parseMutex_);
+        streambuf* coutBuffer = cout.rdbuf(text.rdbuf());
+        try {
+            parsed = parser_(args, options, fileName);
+        } catch (...) {
+            parsed = false;
+        }
+        cout.rdbuf(coutBuffer);
+    }
+    if (!parsed)
+        return false;
+    if (fileName.empty()) {
+        text << "Error: missing histogram file name" << endl;
+        return false;
+    }
+
+    binary = (options.getFormat() != formatText);
+    bool ok = false;
+    try {
+        OpenFile& file = openFile(fileName);
+        lock_guard<mutex> lock(file.mutex);
+        file.hisDrr->setOptions(&options);
+        file.hisDrr->setOutput(&text);
+        file.hisDrr->setBinaryOutput(&data);
+        // Errors of processing (bad id, gate, read error...) are
+        // printed to text
+        ok = file.hisDrr->process();
+        file.hisDrr->setOptions(&defaultOptions_);
+        file.hisDrr->setOutput(&cout);
+        file.hisDrr->setBinaryOutput(&cout);
+    } catch (GenError &err) {
+        text << "Error: " << err.show() << endl;
+    }
+    if (!ok)
+        binary = false;
+    return ok;
+}
+
+Server::OpenFile& Server::openFile(const string& fileName) {
+    lock_guard<mutex> lock(filesMutex_);
+    map<string, unique_ptr<OpenFile> >::iterator it = files_.find(fileName);
+    if (it != files_.end())
+        return *it->second;
+
+    unique_ptr<OpenFile> file(new OpenFile());
+    unsigned dot = fileName.find_last_of(".");
+    string baseName = fileName.substr(0, dot);
+    file->hisDrr.reset(new HisDrrHisto(baseName + ".drr", baseName + ".his",
+                                       &defaultOptions_));
+    OpenFile& opened = *file;
+    files_[fileName] = std::move(file);
+    return opened;
+}
+
+void Server::addLatency(double us, bool error) {
+    lock_guard<mutex> lock(statsMutex_);
+    if (nRequests_ == 0 || us < min_)
+        min_ = us;
+    if (nRequests_ == 0 || us > max_)
+        max_ = us;
+    if (recent_.size() < recentSize)
+        recent_.push_back(us);
+    else
+        recent_[nRequests_ % recentSize] = us;
+    ++nRequests_;
+    if (error)
+        ++nErrors_;
+    sum_ += us;
+    sumSq_ += us * us;
+}
+
+void Server::printLatency(ostream& out) {
+    vector<double> recent;
+    unsigned long n;
+    unsigned long nErrors;
+    double sum, sumSq, minT, maxT;
+    {
+        lock_guard<mutex> lock(statsMutex_);
+        recent = recent_;
+        n = nRequests_;
+        nErrors = nErrors_;
+        sum = sum_;
+        sumSq = sumSq_;
+        minT = min_;
+        maxT = max_;
+    }
+    unsigned nFiles;
+    {
+        lock_guard<mutex> lock(filesMutex_);
+        nFiles = files_.size();
+    }
+
+    double mean = (n > 0) ? sum / n : 0;
+    double variance = (n > 1) ? (sumSq - n * mean * mean) / (n - 1) : 0;
+    out << "#requests: " << n << endl;
+    out << "#errors: " << nErrors << endl;
+    out << "#files: " << nFiles << endl;
+    out << "#threads: " << nThreads_ << endl;
+    out << "#mean[us]: " << mean << endl;
+    out << "#stddev[us]: " << sqrt(max(0.0, variance)) << endl;
+    out << "#min[us]: " << minT << endl;
+    out << "#max[us]: " << maxT << endl;
+
+    // Percentiles of the last recentSize requests
+    sort(recent.begin(), recent.end());
+    const unsigned percent[3] = {50, 90, 99};
+    for (unsigned i = 0; i < 3; ++i) {
+        double p = 0;
+        if (!recent.empty())
+            p = recent[(recent.size() - 1) * percent[i] / 100];
+        out << "#p" << percent[i] << "[us]: " << p << endl;
+    }
+}
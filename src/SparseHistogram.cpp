@@ -0,0 +1,704 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com 
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#include <cmath>
+#include <algorithm>
+#include <deque>
+#include <climits>
+#include <string>
+#include <vector>
+#include "Histogram.h"
+#include "SparseHistogram.h"
+#include "Exceptions.h"
+
+using namespace std;
+
+// CSR costs 12 bytes per stored bin (column and count) against 8 bytes
+// per bin of the dense matrix, but the speed gain of skipping empty bins
+// is lost well before the memory break-even.
+const double SparseHistogram2D::maxOccupancy = 0.1;
+
+SparseHistogram2D::SparseHistogram2D (double xMin,    double xMax,
+                                      double yMin,    double yMax,
+                                      unsigned nBinX, unsigned nBinY,
+                                      string hisId)
+                        : Histogram(xMin, xMax, nBinX, hisId),
+                          yMin_(yMin), yMax_(yMax), nBinY_(nBinY) { 
+    if (nBinY < 1)
+        throw GenError("SparseHistogram2D(): number of bins cannot be less then 1");
+    binWidthY_ = (yMax_ - yMin_) / double(nBinY_) ;
+    rowStart_.resize(nBinY_ + 1, 0);
+}
+
+SparseHistogram2D::SparseHistogram2D (const Histogram2D& dense)
+                        : Histogram(dense.getxMin(), dense.getxMax(),
+                                    dense.getnBinX(), dense.gethisId()),
+                          yMin_(dense.getyMin()), yMax_(dense.getyMax()),
+                          nBinY_(dense.getnBinY()),
+                          binWidthY_(dense.getBinWidthY()) { 
+    underflow_ = dense.getUnder();
+    overflow_ = dense.getOver();
+    vector<long> values;
+    dense.getDataRaw(values);
+    fill(values);
+}
+
+bool SparseHistogram2D::preferSparse (unsigned long nonZero,
+                                      unsigned long nBins) {
+    return double(nonZero) <= maxOccupancy * double(nBins);
+}
+
+unsigned short SparseHistogram2D::getDim() const {
+    return 2;
+}
+
+unsigned SparseHistogram2D::getiY (double y) const { 
+    if ( y > yMin_ && y < yMax_ ) 
+        return (unsigned)( (y - yMin_) / binWidthY_ );
+    else if (y <= yMin_)
+        return 0;
+    else
+        return nBinY_ - 1;
+}
+
+long SparseHistogram2D::getSum () const {
+    long sum = 0;
+    unsigned long sz = counts_.size();
+    for (unsigned long k = 0; k < sz; ++k)
+        sum += counts_[k];
+    return sum;
+}
+
+double SparseHistogram2D::getOccupancy () const {
+    return double(counts_.size()) / (double(nBinX_) * double(nBinY_));
+}
+
+template <class T>
+void SparseHistogram2D::fill (const vector<T>& values) {
+    unsigned long sz = min((unsigned long)values.size(),
+                           (unsigned long)nBinX_ * nBinY_);
+
+    // First pass counts non-empty bins, so the memory is
+    // allocated once and exactly
+    unsigned long nonZero = 0;
+    for (unsigned long i = 0; i < sz; ++i)
+        if (values[i] != 0)
+            ++nonZero;
+
+    columns_.clear();
+    counts_.clear();
+    columns_.reserve(nonZero);
+    counts_.reserve(nonZero);
+    rowStart_.assign(nBinY_ + 1, 0);
+
+    for (unsigned iy = 0; iy < nBinY_; ++iy) {
+        rowStart_[iy] = counts_.size();
+        unsigned long begin = (unsigned long)iy * nBinX_;
+        if (begin >= sz)
+            continue;
+        unsigned long end = min(begin + nBinX_, sz);
+        const T* row = &values[begin];
+        unsigned n = end - begin;
+        for (unsigned ix = 0; ix < n; ++ix) {
+            if (row[ix] == 0)
+                continue;
+            columns_.push_back(ix);
+            counts_.push_back(static_cast<long>(row[ix]));
+        }
+    }
+    rowStart_[nBinY_] = counts_.size();
+}
+
+void SparseHistogram2D::getDataRaw (vector<long>& values) const {
+    values.assign((unsigned long)nBinX_ * nBinY_, 0);
+    for (unsigned iy = 0; iy < nBinY_; ++iy) {
+        long* row = &values[(unsigned long)iy * nBinX_];
+        for (unsigned long k = rowStart_[iy]; k < rowStart_[iy + 1]; ++k)
+            row[columns_[k]] = counts_[k];
+    }
+}
+
+void SparseHistogram2D::setDataRaw (const vector<long>& values) {
+    fill(values);
+}
+
+void SparseHistogram2D::setDataRaw (const vector<int>& values) {
+    fill(values);
+}
+
+void SparseHistogram2D::setDataRaw (const vector<unsigned>& values) {
+    fill(values);
+}
+
+void SparseHistogram2D::setDataRaw (const vector<double>& values) {
+    vector<long> rounded(values.size(), 0);
+    for (unsigned long i = 0; i < values.size(); ++i)
+        if (values[i] != 0)
+            rounded[i] = roundCount(values[i]);
+    fill(rounded);
+}
+
+bool SparseHistogram2D::setDataIfSparse (const vector<unsigned>& values) {
+    unsigned long nBins = (unsigned long)nBinX_ * nBinY_;
+    unsigned long sz = min((unsigned long)values.size(), nBins);
+    unsigned long maxNonZero = (unsigned long)(maxOccupancy * double(nBins));
+
+    columns_.clear();
+    counts_.clear();
+    rowStart_.assign(nBinY_ + 1, 0);
+
+    for (unsigned iy = 0; iy < nBinY_; ++iy) {
+        rowStart_[iy] = counts_.size();
+        unsigned long begin = (unsigned long)iy * nBinX_;
+        if (begin >= sz)
+            continue;
+        unsigned long end = min(begin + nBinX_, sz);
+        const unsigned* row = &values[begin];
+        unsigned n = end - begin;
+        for (unsigned ix = 0; ix < n; ++ix) {
+            if (row[ix] == 0)
+                continue;
+            if (counts_.size() == maxNonZero) {
+                columns_.clear();
+                counts_.clear();
+                rowStart_.assign(nBinY_ + 1, 0);
+                return false;
+            }
+            columns_.push_back(ix);
+            counts_.push_back(row[ix]);
+        }
+    }
+    rowStart_[nBinY_] = counts_.size();
+    return true;
+}
+
+long SparseHistogram2D::get (unsigned ix, unsigned iy) const {
+    if (ix >= nBinX_ || iy >= nBinY_)
+        throw ArrayError("SparseHistogram2D::get: Matrix subscript out of bounds");
+
+    vector<unsigned>::const_iterator begin = columns_.begin() + rowStart_[iy];
+    vector<unsigned>::const_iterator end = columns_.begin() + rowStart_[iy + 1];
+    vector<unsigned>::const_iterator it = lower_bound(begin, end, ix);
+    if (it != end && *it == ix)
+        return counts_[it - columns_.begin()];
+    return 0;
+}
+
+long SparseHistogram2D::operator()(unsigned ix, unsigned iy) const {
+    return get(ix, iy);
+}
+
+Histogram1D* SparseHistogram2D::gateX (double xl, double xh) const {
+    Histogram1D* gate = new Histogram1D(yMin_, yMax_, nBinY_, "");
+    projectInto(*gate, true, xl, xh);
+    return gate;
+}
+
+Histogram1D* SparseHistogram2D::gateY (double yl, double yh) const {
+    Histogram1D* gate = new Histogram1D(xMin_, xMax_, nBinX_, "");
+    projectInto(*gate, false, yl, yh);
+    return gate;
+}
+
+HistogramStatistics SparseHistogram2D::statistics (unsigned x0, unsigned x1,
+                                                   unsigned y0,
+                                                   unsigned y1) const {
+    if (x0 > x1 || x1 >= nBinX_ || y0 > y1 || y1 >= nBinY_)
+        throw ArrayError("SparseHistogram2D::statistics: Matrix subscript out of bounds");
+
+    HistogramStatistics stats = HistogramStatistics();
+    stats.min = LONG_MAX;
+    stats.max = LONG_MIN;
+
+    double sx1 = 0;
+    double sx2 = 0;
+    double sy1 = 0;
+    double sy2 = 0;
+    unsigned firstX = x1 + 1;
+    unsigned lastX = 0;
+    unsigned firstY = y1 + 1;
+    unsigned lastY = 0;
+    for (unsigned iy = y0; iy <= y1; ++iy) {
+        vector<unsigned>::const_iterator begin =
+                                columns_.begin() + rowStart_[iy];
+        vector<unsigned>::const_iterator end =
+                                columns_.begin() + rowStart_[iy + 1];
+        unsigned long k = lower_bound(begin, end, x0) - columns_.begin();
+        unsigned long kEnd = rowStart_[iy + 1];
+        long rowSum = 0;
+        for (; k < kEnd && columns_[k] <= x1; ++k) {
+            long c = counts_[k];
+            double x = double(columns_[k] - x0);
+            rowSum += c;
+            sx1 += c * x;
+            sx2 += c * x * x;
+            stats.min = min(stats.min, c);
+            stats.max = max(stats.max, c);
+            ++stats.nonZero;
+            firstX = min(firstX, columns_[k]);
+            lastX = max(lastX, columns_[k]);
+            if (firstY > y1)
+                firstY = iy;
+            lastY = iy;
+        }
+        double y = double(iy - y0);
+        stats.sum += rowSum;
+        sy1 += rowSum * y;
+        sy2 += rowSum * y * y;
+    }
+
+    // Empty bins are not stored
+    unsigned long area = (unsigned long)(x1 - x0 + 1) * (y1 - y0 + 1);
+    if (stats.nonZero < area) {
+        stats.min = min(stats.min, 0L);
+        stats.max = max(stats.max, 0L);
+    }
+
+    momentsToStatistics(stats.sum, sx1, sx2, getXlow(x0), binWidthX_,
+                        stats.mean[0], stats.variance[0]);
+    momentsToStatistics(stats.sum, sy1, sy2, getYlow(y0), binWidthY_,
+                        stats.mean[1], stats.variance[1]);
+    if (stats.nonZero > 0) {
+        stats.low[0] = getXlow(firstX);
+        stats.high[0] = getXhigh(lastX);
+        stats.low[1] = getYlow(firstY);
+        stats.high[1] = getYhigh(lastY);
+    } else {
+        stats.low[0] = getXlow(x0);
+        stats.high[0] = getXhigh(x1);
+        stats.low[1] = getYlow(y0);
+        stats.high[1] = getYhigh(y1);
+    }
+    return stats;
+}
+
+HistogramStatistics SparseHistogram2D::statistics () const {
+    return statistics(0, nBinX_ - 1, 0, nBinY_ - 1);
+}
+
+void SparseHistogram2D::projectInto (Histogram1D& projection, bool onY,
+                                     double low, double high) const {
+    if (onY) {
+        projection.reset(yMin_, yMax_, nBinY_);
+        unsigned x0 = getiX(low);
+        unsigned x1 = getiX(high);
+
+        // Gate is a range of columns in each row
+        for (unsigned iy = 0; iy < nBinY_; ++iy) {
+            vector<unsigned>::const_iterator begin =
+                                    columns_.begin() + rowStart_[iy];
+            vector<unsigned>::const_iterator end =
+                                    columns_.begin() + rowStart_[iy + 1];
+            unsigned long k = lower_bound(begin, end, x0) - columns_.begin();
+            unsigned long kEnd = rowStart_[iy + 1];
+            long sum = 0;
+            for (; k < kEnd && columns_[k] <= x1; ++k)
+                sum += counts_[k];
+            projection[iy] = sum;
+        }
+    } else {
+        projection.reset(xMin_, xMax_, nBinX_);
+        unsigned y0 = getiY(low);
+        unsigned y1 = getiY(high);
+
+        // Gate is a range of rows
+        for (unsigned long k = rowStart_[y0]; k < rowStart_[y1 + 1]; ++k)
+            projection[columns_[k]] += counts_[k];
+    }
+}
+
+void SparseHistogram2D::projectWithBackground (Histogram1D& projection,
+                                               Histogram1D& variance,
+                                               bool onY,
+                                               double low, double high,
+                                 const vector<double>& background) const {
+    unsigned nBg = background.size() / 2;
+    if (background.size() % 2 != 0 || nBg > 2)
+        throw GenError("SparseHistogram2D::projectWithBackground: 0, 2 or 4 background limits required");
+
+    unsigned first[3];
+    unsigned last[3];
+    first[0] = onY ? getiX(low) : getiY(low);
+    last[0] = onY ? getiX(high) : getiY(high);
+    for (unsigned g = 1; g <= nBg; ++g) {
+        double bl = background[2 * g - 2];
+        double bh = background[2 * g - 1];
+        first[g] = onY ? getiX(bl) : getiY(bl);
+        last[g] = onY ? getiX(bh) : getiY(bh);
+    }
+
+    if (onY) {
+        projection.reset(yMin_, yMax_, nBinY_);
+        variance.reset(yMin_, yMax_, nBinY_);
+
+        for (unsigned iy = 0; iy < nBinY_; ++iy) {
+            if (rowStart_[iy] == rowStart_[iy + 1])
+                continue;
+            vector<unsigned>::const_iterator begin =
+                                    columns_.begin() + rowStart_[iy];
+            vector<unsigned>::const_iterator end =
+                                    columns_.begin() + rowStart_[iy + 1];
+            unsigned long kEnd = rowStart_[iy + 1];
+            long sum[3] = {0, 0, 0};
+            for (unsigned g = 0; g <= nBg; ++g) {
+                unsigned long k = lower_bound(begin, end, first[g]) -
+                                  columns_.begin();
+                for (; k < kEnd && columns_[k] <= last[g]; ++k)
+                    sum[g] += counts_[k];
+            }
+            projection[iy] = sum[0] - sum[1] - sum[2];
+            variance[iy] = sum[0] + sum[1] + sum[2];
+        }
+    } else {
+        projection.reset(xMin_, xMax_, nBinX_);
+        variance.reset(xMin_, xMax_, nBinX_);
+
+        unsigned y0 = first[0];
+        unsigned y1 = last[0];
+        for (unsigned g = 1; g <= nBg; ++g) {
+            y0 = min(y0, first[g]);
+            y1 = max(y1, last[g]);
+        }
+
+        for (unsigned iy = y0; iy < y1 + 1; ++iy) {
+            long peak = (iy >= first[0] && iy <= last[0]) ? 1 : 0;
+            long bg = 0;
+            for (unsigned g = 1; g <= nBg; ++g)
+                if (iy >= first[g] && iy <= last[g])
+                    ++bg;
+            if (peak == 0 && bg == 0)
+                continue;
+
+            long wResult = peak - bg;
+            long wErr = peak + bg;
+            for (unsigned long k = rowStart_[iy]; k < rowStart_[iy + 1]; ++k) {
+                projection[columns_[k]] += wResult * counts_[k];
+                variance[columns_[k]] += wErr * counts_[k];
+            }
+        }
+    }
+}
+
+Histogram2D SparseHistogram2D::toDense () const {
+    Histogram2D dense(xMin_, xMax_, yMin_, yMax_, nBinX_, nBinY_, hisId_);
+    vector<long> values;
+    getDataRaw(values);
+    dense.setDataRaw(values);
+    return dense;
+}
+
+SparseHistogram2D* SparseHistogram2D::crop (unsigned x0, unsigned x1,
+                                            unsigned y0, unsigned y1,
+                                            double xMin, double xMax,
+                                            double yMin, double yMax) const {
+    if (x1 > nBinX_ || y1 > nBinY_)
+        throw ArrayError("SparseHistogram2D::crop: Matrix subscript out of bounds");
+    if (x0 >= x1 || y0 >= y1)
+        throw ArrayError("SparseHistogram2D::crop: Empty range");
+
+    SparseHistogram2D* cropped = new SparseHistogram2D(xMin, xMax, yMin, yMax,
+                                                       x1 - x0, y1 - y0, "");
+    for (unsigned iy = y0; iy < y1; ++iy) {
+        cropped->rowStart_[iy - y0] = cropped->counts_.size();
+        vector<unsigned>::const_iterator begin =
+                                columns_.begin() + rowStart_[iy];
+        vector<unsigned>::const_iterator end =
+                                columns_.begin() + rowStart_[iy + 1];
+        unsigned long k = lower_bound(begin, end, x0) - columns_.begin();
+        unsigned long kEnd = rowStart_[iy + 1];
+        for (; k < kEnd && columns_[k] < x1; ++k) {
+            cropped->columns_.push_back(columns_[k] - x0);
+            cropped->counts_.push_back(counts_[k]);
+        }
+    }
+    cropped->rowStart_[y1 - y0] = cropped->counts_.size();
+    return cropped;
+}
+
+void SparseHistogram2D::transpose () {
+    // Counting sort by column, rows of transposed are columns of
+    // original and are filled in the order of original rows, so they
+    // come out sorted.
+    vector<unsigned long> rowStart(nBinX_ + 1, 0);
+    unsigned long sz = counts_.size();
+    for (unsigned long k = 0; k < sz; ++k)
+        ++rowStart[columns_[k] + 1];
+    for (unsigned ix = 0; ix < nBinX_; ++ix)
+        rowStart[ix + 1] += rowStart[ix];
+
+    vector<unsigned> columns(sz);
+    vector<long> counts(sz);
+    vector<unsigned long> next(rowStart.begin(), rowStart.end() - 1);
+    for (unsigned iy = 0; iy < nBinY_; ++iy) {
+        for (unsigned long k = rowStart_[iy]; k < rowStart_[iy + 1]; ++k) {
+            unsigned long pos = next[columns_[k]]++;
+            columns[pos] = iy;
+            counts[pos] = counts_[k];
+        }
+    }
+
+    rowStart_.swap(rowStart);
+    columns_.swap(columns);
+    counts_.swap(counts);
+
+    swap(xMin_, yMin_);
+    swap(xMax_, yMax_);
+    swap(nBinX_, nBinY_);
+    swap(binWidthX_, binWidthY_);
+}
+
+SparseHistogram2D* SparseHistogram2D::rebin (double xMin, double xMax,
+                                             double yMin, double yMax,
+                                             unsigned nBinX,
+                                             unsigned nBinY) const {
+    if (nBinX < 1 || nBinY < 1)
+        throw GenError("SparseHistogram2D::rebin: number of bins cannot be less then 1");
+    double binWX = (xMax - xMin) / double(nBinX);   
+    double binWY = (yMax - yMin) / double(nBinY);   
+
+    SparseHistogram2D* rebinned = new SparseHistogram2D(xMin, xMax,
+                                                        yMin, yMax,
+                                                        nBinX, nBinY, "");
+
+    int factorX = 0;
+    int factorY = 0;
+    int offsetX = 0;
+    int offsetY = 0;
+    if (isIntegerRatio(binWX, binWidthX_, factorX) && factorX >= 1 &&
+        isIntegerRatio(binWY, binWidthY_, factorY) && factorY >= 1 &&
+        isIntegerRatio(xMin - xMin_, binWidthX_, offsetX) &&
+        isIntegerRatio(yMin - yMin_, binWidthY_, offsetY)) {
+        // Block sums. Old rows offsetY + iy * factorY ... go to new row iy,
+        // they are summed into one dense row, only the touched bins
+        // are collected and cleared afterwards.
+        long underflow = 0;
+        long overflow = 0;
+        vector<long> row(nBinX, 0);
+        vector<unsigned> touched;
+
+        long last = (long)offsetY + (long)nBinY * factorY;
+        for (long y = 0; y < (long)nBinY_; ++y) {
+            if (y >= offsetY && y < last)
+                continue;
+            // Rows outside of new Y range
+            for (unsigned long k = rowStart_[y]; k < rowStart_[y + 1]; ++k) {
+                if (y < offsetY || (long)columns_[k] < offsetX)
+                    underflow += counts_[k];
+                else
+                    overflow += counts_[k];
+            }
+        }
+
+        for (unsigned iy = 0; iy < nBinY; ++iy) {
+            rebinned->rowStart_[iy] = rebinned->counts_.size();
+            long yBegin = max((long)offsetY + (long)iy * factorY, 0L);
+            long yEnd = min((long)offsetY + (long)(iy + 1) * factorY,
+                            (long)nBinY_);
+            for (long y = yBegin; y < yEnd; ++y) {
+                for (unsigned long k = rowStart_[y]; k < rowStart_[y + 1]; ++k) {
+                    long x = (long)columns_[k] - offsetX;
+                    if (x < 0) {
+                        underflow += counts_[k];
+                        continue;
+                    }
+                    long ix = x / factorX;
+                    if (ix >= (long)nBinX) {
+                        overflow += counts_[k];
+                        continue;
+                    }
+                    if (row[ix] == 0)
+                        touched.push_back(ix);
+                    row[ix] += counts_[k];
+                }
+            }
+
+            sort(touched.begin(), touched.end());
+            touched.erase(unique(touched.begin(), touched.end()),
+                          touched.end());
+            for (unsigned t = 0; t < touched.size(); ++t) {
+                unsigned ix = touched[t];
+                // Sum may cancel out to 0 (negative counts)
+                if (row[ix] != 0) {
+                    rebinned->columns_.push_back(ix);
+                    rebinned->counts_.push_back(row[ix]);
+                }
+                row[ix] = 0;
+            }
+            touched.clear();
+        }
+        rebinned->rowStart_[nBinY] = rebinned->counts_.size();
+        rebinned->underflow_ = underflow;
+        rebinned->overflow_ = overflow;
+        return rebinned;
+    } else {
+        // Area-overlap weights, same separable scheme (and order of
+        // summation) as in Histogram2D::rebin, empty rows are skipped.
+        // Old rows go to new rows in increasing order, so only the new
+        // rows reachable from the current old row are held (dense) in
+        // pending, a row is compressed as soon as no later old row can
+        // reach it. Only the touched bins of rows are visited.
+        vector<unsigned> firstX, firstY;
+        vector<int> binsX, binsY;
+        vector<double> wX, wY;
+        overlapWeights(xMin_, binWidthX_, nBinX_, xMin, binWX,
+                       firstX, binsX, wX);
+        overlapWeights(yMin_, binWidthY_, nBinY_, yMin, binWY,
+                       firstY, binsY, wY);
+
+        double underflow = 0;
+        double overflow = 0;
+        vector<double> row(nBinX + 2, 0.0);
+        vector<unsigned> touchedX;
+
+        // New rows from done on, with their touched bins; compressed
+        // rows are kept in spare for reuse
+        deque<vector<double> > pending;
+        deque<vector<unsigned> > pendingTouched;
+        vector<vector<double> > spare;
+        unsigned done = 0;
+
+        // Compresses new rows below end, rounded as in setDataRaw
+        auto compress = [&] (unsigned end) {
+            for (; done < end; ++done) {
+                rebinned->rowStart_[done] = rebinned->counts_.size();
+                if (pending.empty())
+                    continue;
+                vector<double>& values = pending.front();
+                vector<unsigned>& touched = pendingTouched.front();
+                sort(touched.begin(), touched.end());
+                touched.erase(unique(touched.begin(), touched.end()),
+                              touched.end());
+                for (unsigned t = 0; t < touched.size(); ++t) {
+                    unsigned ix = touched[t];
+                    long count = (values[ix] != 0) ? roundCount(values[ix])
+                                                   : 0;
+                    if (count != 0) {
+                        rebinned->columns_.push_back(ix);
+                        rebinned->counts_.push_back(count);
+                    }
+                    values[ix] = 0.0;
+                }
+                spare.push_back(vector<double>());
+                spare.back().swap(values);
+                pending.pop_front();
+                pendingTouched.pop_front();
+            }
+        };
+
+        for (unsigned y = 0; y < nBinY_; ++y) {
+            if (rowStart_[y] == rowStart_[y + 1])
+                continue;
+
+            for (unsigned long k = rowStart_[y]; k < rowStart_[y + 1]; ++k) {
+                unsigned x = columns_[k];
+                double v = double(counts_[k]);
+                for (unsigned j = firstX[x]; j < firstX[x + 1]; ++j) {
+                    int ix = binsX[j];
+                    unsigned i;
+                    if (ix < 0)
+                        i = 0;
+                    else if (ix > (int)(nBinX - 1))
+                        i = nBinX + 1;
+                    else
+                        i = ix + 1;
+                    row[i] += wX[j] * v;
+                    touchedX.push_back(i);
+                }
+            }
+            sort(touchedX.begin(), touchedX.end());
+            touchedX.erase(unique(touchedX.begin(), touchedX.end()),
+                           touchedX.end());
+            bool under = !touchedX.empty() && touchedX.front() == 0;
+            bool over = !touchedX.empty() && touchedX.back() == nBinX + 1;
+
+            // No later old row reaches new rows below the first one
+            // of this row
+            int iyFirst = binsY[firstY[y]];
+            if (iyFirst > 0)
+                compress(min((unsigned)iyFirst, nBinY));
+
+            for (unsigned l = firstY[y]; l < firstY[y + 1]; ++l) {
+                int iy = binsY[l];
+                double w = wY[l];
+                if (iy < 0) {
+                    for (unsigned t = 0; t < touchedX.size(); ++t)
+                        underflow += w * row[touchedX[t]];
+                } else if (iy > (int)(nBinY - 1)) {
+                    if (under)
+                        underflow += w * row[0];
+                    for (unsigned t = under ? 1 : 0; t < touchedX.size(); ++t)
+                        overflow += w * row[touchedX[t]];
+                } else {
+                    if (under)
+                        underflow += w * row[0];
+                    if (over)
+                        overflow += w * row[nBinX + 1];
+                    while (done + pending.size() <= (unsigned)iy) {
+                        if (spare.empty()) {
+                            pending.push_back(vector<double>(nBinX, 0.0));
+                        } else {
+                            pending.push_back(vector<double>());
+                            pending.back().swap(spare.back());
+                            spare.pop_back();
+                        }
+                        pendingTouched.push_back(vector<unsigned>());
+                    }
+                    vector<double>& out = pending[iy - done];
+                    vector<unsigned>& touched = pendingTouched[iy - done];
+                    for (unsigned t = 0; t < touchedX.size(); ++t) {
+                        unsigned i = touchedX[t];
+                        if (i == 0 || i == nBinX + 1)
+                            continue;
+                        out[i - 1] += w * row[i];
+                        touched.push_back(i - 1);
+                    }
+                }
+            }
+
+            for (unsigned t = 0; t < touchedX.size(); ++t)
+                row[touchedX[t]] = 0.0;
+            touchedX.clear();
+        }
+        compress(nBinY);
+        rebinned->rowStart_[nBinY] = rebinned->counts_.size();
+        rebinned->underflow_ = underflow;
+        rebinned->overflow_ = overflow;
+        return rebinned;
+    }
+}
+
+SparseHistogram2D* SparseHistogram2D::rebin (double xMin, double xMax,
+                                             double yMin, double yMax,
+                                             double binWX,
+                                             double binWY) const {
+    if (binWX <= 0 || binWY <= 0)
+        throw GenError("SparseHistogram2D::rebin: bin width must be greater then 0");
+
+    unsigned nBinX = unsigned((xMax - xMin) / binWX) + 1;
+    xMax = xMin + nBinX * binWX;
+    unsigned nBinY = unsigned((yMax - yMin) / binWY) + 1;
+    yMax = yMin + nBinY * binWY;
+    return rebin(xMin, xMax, yMin, yMax, nBinX, nBinY);
+}
+
+void SparseHistogram2D::rebinInPlace (double xMin, double xMax,
+                                      double yMin, double yMax,
+                                      unsigned nBinX, unsigned nBinY) {
+    unique_ptr<SparseHistogram2D> rebinned(rebin(xMin, xMax, yMin, yMax,
+                                                 nBinX, nBinY));
+    rebinned->hisId_ = hisId_;
+    *this = std::move(*rebinned);
+}
+
+void SparseHistogram2D::rebinInPlace (double xMin, double xMax,
+                                      double yMin, double yMax,
+                                      double binWX, double binWY) {
+    unique_ptr<SparseHistogram2D> rebinned(rebin(xMin, xMax, yMin, yMax,
+                                                 binWX, binWY));
+    rebinned->hisId_ = hisId_;
+    *this = std::move(*rebinned);
+}
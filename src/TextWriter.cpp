@@ -0,0 +1,361 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include "TextWriter.h"
+
+namespace {
+    /** Blocks of streamParallel written to out in order. */
+    class OrderedBlocks {
+        public:
+            OrderedBlocks(std::ostream& out, unsigned nBlocks,
+                          unsigned window, unsigned maxChunks)
+                : out_(out), nBlocks_(nBlocks), window_(window),
+                  maxChunks_(maxChunks), next_(0), head_(0),
+                  held_(nBlocks), done_(nBlocks, false) {}
+
+            /** Returns next block to format (or nBlocks if there is
+             * none), waits while it is window blocks ahead of the
+             * first unfinished one. */
+            unsigned take() {
+                std::unique_lock<std::mutex> lock(mutex_);
+                changed_.wait(lock, [&] () {
+                    return next_ >= nBlocks_ || next_ < head_ + window_;
+                });
+                return (next_ < nBlocks_) ? next_++ : nBlocks_;
+            }
+
+            /** Writes chunk of block i, or holds it until the block
+             * before are finished. Chunk is taken over (left empty). */
+            void put(unsigned i, std::string& chunk) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                changed_.wait(lock, [&] () {
+                    return i == head_ || held_[i].size() < maxChunks_;
+                });
+                if (i == head_) {
+                    out_.write(chunk.data(), chunk.size());
+                    chunk.clear();
+                } else {
+                    held_[i].push_back(std::string());
+                    held_[i].back().swap(chunk);
+                }
+            }
+
+            /** Marks block i as finished, writes blocks waiting for
+             * it. */
+            void finish(unsigned i) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                done_[i] = true;
+                while (head_ < nBlocks_ && done_[head_]) {
+                    if (++head_ == nBlocks_)
+                        break;
+                    std::deque<std::string>& held = held_[head_];
+                    for (unsigned k = 0; k < held.size(); ++k)
+                        out_.write(held[k].data(), held[k].size());
+                    held.clear();
+                }
+                changed_.notify_all();
+            }
+
+        private:
+            std::ostream& out_;
+            unsigned nBlocks_;
+            unsigned window_;
+            unsigned maxChunks_;
+
+            /** Next block to format. */
+            unsigned next_;
+
+            /** First unfinished block, written straight to out_. */
+            unsigned head_;
+
+            /** Chunks of blocks after head_. */
+            std::vector<std::deque<std::string> > held_;
+            std::vector<bool> done_;
+
+            std::mutex mutex_;
+            std::condition_variable changed_;
+    };
+
+    /** Stream buffer of a single block of OrderedBlocks, passes data on
+     * in chunks of chunkSize bytes. */
+    class BlockBuffer : public std::streambuf {
+        public:
+            BlockBuffer(OrderedBlocks& blocks, unsigned i,
+                        unsigned chunkSize)
+                : blocks_(blocks), i_(i), chunkSize_(chunkSize) {
+                reset();
+            }
+
+            /** Passes remaining data on and finishes the block. */
+            void finish() {
+                send();
+                blocks_.finish(i_);
+            }
+
+        protected:
+            int overflow(int c) {
+                send();
+                if (c != traits_type::eof()) {
+                    *pptr() = traits_type::to_char_type(c);
+                    pbump(1);
+                }
+                return traits_type::not_eof(c);
+            }
+
+        private:
+            void send() {
+                chunk_.resize(pptr() - pbase());
+                if (!chunk_.empty())
+                    blocks_.put(i_, chunk_);
+                reset();
+            }
+
+            void reset() {
+                chunk_.resize(chunkSize_);
+                setp(&chunk_[0], &chunk_[0] + chunk_.size());
+            }
+
+            OrderedBlocks& blocks_;
+            unsigned i_;
+            unsigned chunkSize_;
+            std::string chunk_;
+    };
+}
+
+TextWriter::TextWriter(std::ostream& out, unsigned bufferSize)
+                      : out_(&out), str_(0), used_(0),
+                        bufferSize_(bufferSize) {
+    buffer_.resize(bufferSize_ + 64);
+}
+
+TextWriter::TextWriter(std::string& out, unsigned bufferSize)
+                      : out_(0), str_(&out), used_(0),
+                        bufferSize_(bufferSize) {
+    buffer_.resize(bufferSize_ + 64);
+}
+
+TextWriter::~TextWriter() {
+    flush();
+}
+
+void TextWriter::flush() {
+    if (used_ > 0) {
+        if (out_ != 0)
+            out_->write(&buffer_[0], used_);
+        else
+            str_->append(&buffer_[0], used_);
+    }
+    used_ = 0;
+}
+
+void TextWriter::writeParallel(std::ostream& out, unsigned nBlocks,
+                    unsigned nThreads,
+                    const std::function<void (unsigned, TextWriter&)>& format) {
+    if (nThreads <= 1 || nBlocks <= 1) {
+        TextWriter writer(out);
+        for (unsigned i = 0; i < nBlocks; ++i)
+            format(i, writer);
+        return;
+    }
+
+    // Block i goes to slot i % window, a slot is reused after 
+    // it is written out
+    const unsigned window = 2 * nThreads;
+    std::vector<std::string> text(window);
+    std::vector<bool> ready(window, false);
+    unsigned next = 0;
+    unsigned written = 0;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    auto worker = [&] () {
+        std::string buffer;
+        while (true) {
+            unsigned i;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] () { 
+                    return next >= nBlocks || next < written + window;
+                });
+                if (next >= nBlocks)
+                    return;
+                i = next++;
+            }
+
+            buffer.clear();
+            {
+                TextWriter writer(buffer);
+                format(i, writer);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            text[i % window].swap(buffer);
+            ready[i % window] = true;
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < nThreads; ++t)
+        threads.push_back(std::thread(worker));
+
+    std::string block;
+    for (unsigned i = 0; i < nBlocks; ++i) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] () { return bool(ready[i % window]); });
+            block.swap(text[i % window]);
+            ready[i % window] = false;
+            ++written;
+            changed.notify_all();
+        }
+        out.write(block.data(), block.size());
+    }
+
+    for (unsigned t = 0; t < threads.size(); ++t)
+        threads[t].join();
+}
+
+void TextWriter::streamParallel(std::ostream& out, unsigned nBlocks,
+                    unsigned nThreads,
+                    const std::function<void (unsigned, std::ostream&)>& format,
+                    unsigned chunkSize, unsigned maxChunks) {
+    if (nThreads <= 1 || nBlocks <= 1) {
+        for (unsigned i = 0; i < nBlocks; ++i)
+            format(i, out);
+        return;
+    }
+
+    OrderedBlocks blocks(out, nBlocks, 2 * nThreads, maxChunks);
+    auto worker = [&] () {
+        unsigned i;
+        while ((i = blocks.take()) < nBlocks) {
+            BlockBuffer buffer(blocks, i, chunkSize);
+            std::ostream stream(&buffer);
+            format(i, stream);
+            buffer.finish();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < nThreads; ++t)
+        threads.push_back(std::thread(worker));
+    for (unsigned t = 0; t < threads.size(); ++t)
+        threads[t].join();
+}
+
+void TextWriter::putDigits(unsigned long n) {
+    char digits[24];
+    unsigned len = 0;
+    do {
+        digits[len++] = char('0' + n % 10);
+        n /= 10;
+    } while (n > 0);
+    reserve(len);
+    while (len > 0)
+        buffer_[used_++] = digits[--len];
+}
+
+TextWriter& TextWriter::operator<< (long n) {
+    if (n < 0) {
+        *this << '-';
+        // Works also for the most negative number
+        putDigits(0ul - (unsigned long)(n));
+    } else
+        putDigits(n);
+    return *this;
+}
+
+TextWriter& TextWriter::operator<< (unsigned long n) {
+    putDigits(n);
+    return *this;
+}
+
+TextWriter& TextWriter::operator<< (double x) {
+    // Powers of 10 are exact in double up to 1e22
+    static const double pow10[] = {1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6};
+    const long maxDigits = 1000000;
+
+    // If x is the closest double to m / 10^k, with |m| < 10^6, the "%g"
+    // rounding to 6 significant digits gives exactly that decimal.
+    // Fixed notation is used by "%g" for 1e-4 <= |x| < 1e6.
+    double a = std::fabs(x);
+    if (a >= 1e-4 && a < 1e6) {
+        for (unsigned k = 0; k < 7; ++k) {
+            double m = a * pow10[k];
+            if (m >= maxDigits)
+                break;
+            if (m != std::floor(m) || m / pow10[k] != a)
+                continue;
+
+            unsigned long digits = (unsigned long)(m);
+            unsigned long scale = (unsigned long)(pow10[k]);
+            unsigned long whole = digits / scale;
+            unsigned long frac = digits % scale;
+            // Trailing zeros are not printed by "%g"
+            unsigned nFrac = k;
+            while (nFrac > 0 && frac % 10 == 0) {
+                frac /= 10;
+                --nFrac;
+            }
+
+            reserve(24);
+            if (x < 0)
+                buffer_[used_++] = '-';
+            putDigits(whole);
+            if (nFrac > 0) {
+                reserve(8);
+                buffer_[used_++] = '.';
+                unsigned pos = used_ + nFrac;
+                for (unsigned i = 0; i < nFrac; ++i) {
+                    buffer_[pos - 1 - i] = char('0' + frac % 10);
+                    frac /= 10;
+                }
+                used_ = pos;
+            }
+            return *this;
+        }
+    }
+
+    reserve(32);
+    int len = snprintf(&buffer_[used_], 32, "%g", x);
+    if (len > 0)
+        used_ += len;
+    return *this;
+}
+
+void TextWriter::write(const char* data, unsigned long n) {
+    // Large data goes directly, without copying to the buffer
+    if (n > bufferSize_) {
+        flush();
+        if (out_ != 0)
+            out_->write(data, n);
+        else
+            str_->append(data, n);
+        return;
+    }
+    reserve(n);
+    std::memcpy(&buffer_[used_], data, n);
+    used_ += n;
+}
+
+TextWriter& TextWriter::operator<< (const char* s) {
+    write(s, std::strlen(s));
+    return *this;
+}
+
+TextWriter& TextWriter::operator<< (const std::string& s) {
+    write(s.data(), s.size());
+    return *this;
+}
@@ -0,0 +1,370 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+/**
+ * Generator of synthetic his/drr files, for tests and benchmarks when
+ * real data can not be used. Files are created by HisDrr(drr, his,
+ * input) and filled with pseudo-random spectra:
+ *
+ * - 1D: exponential background and Gaussian peaks,
+ * - 2D: coincidence matrices, sparse ridges at energies of peaks
+ *   (peak in coincidence with background, along X and Y) with crossing
+ *   points (peak in coincidence with peak) and sparse background.
+ *
+ * All numbers come from a generator seeded with --seed and histogram
+ * id, so the same options always give the same files.
+ */
+
+#include <cmath>
+#include <climits>
+#include <cstdlib>
+#include <cstdio>
+#include <getopt.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "HisDrr.h"
+#include "Exceptions.h"
+
+using namespace std;
+
+/** Parameters of the generated file. */
+struct GenOptions {
+    /** Number of 1D and 2D histograms. */
+    unsigned n1 = 10;
+    unsigned n2 = 2;
+    /** Number of channels of 1D, X and Y of 2D histograms. */
+    unsigned size1 = 8192;
+    unsigned sizeX = 1024;
+    unsigned sizeY = 1024;
+    /** Size of channel in half-words (1 or 2) of 1D and 2D. */
+    unsigned width1 = 1;
+    unsigned width2 = 2;
+    /** Counts per 1D histogram, events per 2D histogram. */
+    double counts = 1.0e6;
+    double events = 1.0e6;
+    /** Number of peaks (1D) and ridges (2D) per histogram. */
+    unsigned peaks = 10;
+    /** Fraction of counts (events) in background. */
+    double background = 0.5;
+    /** Width (sigma) of peaks in channels. */
+    double sigma = 2.0;
+    /** Decay length of background as fraction of histogram size. */
+    double slope = 0.2;
+    unsigned long seed = 1;
+};
+
+/** Pseudo-random number generator (splitmix64), results do not depend
+ * on the standard library implementation. */
+class Random {
+    public:
+        Random(unsigned long seed) : state_(seed) {}
+
+        /** Returns uniform integer. */
+        unsigned long next() {
+            unsigned long z = (state_ += 0x9e3779b97f4a7c15ul);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ul;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebul;
+            return z ^ (z >> 31);
+        }
+
+        /** Returns uniform number in [0, 1). */
+        double uniform() {
+            return (next() >> 11) * (1.0 / 9007199254740992.0);
+        }
+
+        /** Returns number from normal distribution. */
+        double gauss(double mean, double sigma) {
+            double u = 1.0 - uniform();
+            double v = uniform();
+            return mean + sigma * sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+        }
+
+        /** Returns number from exponential distribution. */
+        double exponential(double length) {
+            return -length * log(1.0 - uniform());
+        }
+
+        /** Returns number from Poisson distribution, for large mean
+         * normal approximation is used. */
+        unsigned long poisson(double mean) {
+            if (mean <= 0)
+                return 0;
+            if (mean > 30) {
+                double n = floor(gauss(mean, sqrt(mean)) + 0.5);
+                return (n > 0) ? n : 0;
+            }
+            double limit = exp(-mean);
+            double p = uniform();
+            unsigned long n = 0;
+            while (p > limit) {
+                p *= uniform();
+                ++n;
+            }
+            return n;
+        }
+
+    private:
+        unsigned long state_;
+};
+
+/** Peak positions and relative intensities of histogram. */
+struct Peaks {
+    vector<double> position;
+    vector<double> intensity;
+};
+
+/** Draws peak positions in [0, size), avoiding the edges, and their
+ * relative intensities (summing to 1). */
+Peaks drawPeaks(Random& random, unsigned n, unsigned size) {
+    Peaks peaks;
+    double sum = 0;
+    for (unsigned i = 0; i < n; ++i) {
+        peaks.position.push_back(size * (0.05 + 0.9 * random.uniform()));
+        peaks.intensity.push_back(0.1 + random.uniform());
+        sum += peaks.intensity.back();
+    }
+    for (unsigned i = 0; i < n; ++i)
+        peaks.intensity[i] /= sum;
+    return peaks;
+}
+
+/** Returns generator of histogram id. */
+Random histogramRandom(const GenOptions& opt, int id) {
+    Random mix(opt.seed);
+    return Random(mix.next() ^ (0x2545f4914f6cdd1dul * (id + 1)));
+}
+
+/** Returns maximum value of channel. */
+unsigned long channelMax(unsigned width) {
+    return (width == 1) ? USHRT_MAX : UINT_MAX;
+}
+
+/** Fills 1D histogram: expected number of counts in each channel is
+ * calculated, then the count is drawn from Poisson distribution. */
+void fill1D(const GenOptions& opt, int id, vector<unsigned>& data) {
+    Random random = histogramRandom(opt, id);
+    unsigned size = opt.size1;
+    Peaks peaks = drawPeaks(random, opt.peaks, size);
+    double length = opt.slope * size;
+    double norm = 1.0 - exp(-double(size) / length);
+    double bgCounts = (opt.peaks > 0) ? opt.background * opt.counts
+                                      : opt.counts;
+    double peakCounts = opt.counts - bgCounts;
+    unsigned long maxCount = channelMax(opt.width1);
+
+    data.assign(size, 0);
+    for (unsigned x = 0; x < size; ++x) {
+        double mean = bgCounts / norm *
+                      (exp(-double(x) / length) - exp(-(x + 1.0) / length));
+        for (unsigned p = 0; p < opt.peaks; ++p) {
+            double d = (x + 0.5 - peaks.position[p]) / opt.sigma;
+            if (fabs(d) < 8)
+                mean += peakCounts * peaks.intensity[p] * exp(-0.5 * d * d)
+                        / (sqrt(2.0 * M_PI) * opt.sigma);
+        }
+        unsigned long n = random.poisson(mean);
+        data[x] = (n < maxCount) ? n : maxCount;
+    }
+}
+
+/** Returns channel from energy drawn from peaks or background. */
+double drawEnergy(Random& random, const GenOptions& opt, const Peaks& peaks,
+                  unsigned size, bool peak) {
+    if (!peak)
+        return random.exponential(opt.slope * size);
+    double u = random.uniform();
+    unsigned p = 0;
+    while (p + 1 < peaks.position.size() && u > peaks.intensity[p]) {
+        u -= peaks.intensity[p];
+        ++p;
+    }
+    return random.gauss(peaks.position[p], opt.sigma);
+}
+
+/** Fills 2D histogram with events: a pair of energies, each from peaks
+ * (with probability 1 - background) or from background, so peak-peak
+ * pairs make crossing points and peak-background pairs make ridges.
+ * Energies of peaks are the same on both axes (symmetric matrix). */
+void fill2D(const GenOptions& opt, int id, vector<unsigned>& data) {
+    Random random = histogramRandom(opt, id);
+    unsigned size = (opt.sizeX > opt.sizeY) ? opt.sizeX : opt.sizeY;
+    Peaks peaks = drawPeaks(random, opt.peaks, size);
+    double bg = (opt.peaks > 0) ? opt.background : 1.0;
+    unsigned long maxCount = channelMax(opt.width2);
+    unsigned long nEvents = opt.events;
+
+    data.assign(size_t(opt.sizeX) * opt.sizeY, 0);
+    for (unsigned long e = 0; e < nEvents; ++e) {
+        double x = drawEnergy(random, opt, peaks, size,
+                              random.uniform() >= bg);
+        double y = drawEnergy(random, opt, peaks, size,
+                              random.uniform() >= bg);
+        if (x < 0 || y < 0 || x >= opt.sizeX || y >= opt.sizeY)
+            continue;
+        unsigned& bin = data[size_t(y) * opt.sizeX + size_t(x)];
+        if (bin < maxCount)
+            ++bin;
+    }
+}
+
+/** Prints usage. */
+void help(const char* name) {
+    cout << "Usage: " << name << " [options] file.his" << endl
+         << "Creates file.his and file.drr with synthetic histograms,"
+         << " ids 1 to n1 (1D)" << endl
+         << "and n1 + 1 to n1 + n2 (2D)." << endl << endl
+         << "Options (defaults in brackets):" << endl
+         << "  --n1 n          number of 1D histograms (10)" << endl
+         << "  --n2 n          number of 2D histograms (2)" << endl
+         << "  --size1 n       channels of 1D histograms (8192)" << endl
+         << "  --size2 nx[,ny] channels of 2D histograms (1024)" << endl
+         << "  --width1 2|4    bytes per channel of 1D (2)" << endl
+         << "  --width2 2|4    bytes per channel of 2D (4)" << endl
+         << "  --counts n      counts per 1D histogram (1e6)" << endl
+         << "  --events n      events per 2D histogram (1e6)," << endl
+         << "                  sets occupancy of matrices" << endl
+         << "  --peaks n       peaks of 1D, ridges of 2D (10)" << endl
+         << "  --background f  fraction of counts in background (0.5)"
+         << endl
+         << "  --sigma s       width of peaks in channels (2)" << endl
+         << "  --slope f       decay length of background, fraction of"
+         << endl
+         << "                  histogram size (0.2)" << endl
+         << "  --seed n        seed of random numbers (1)" << endl
+         << "Sizes are limited to 32767 channels per axis and the his"
+         << " file to 4 GB" << endl
+         << "(drr format). Each histogram is held in memory twice while"
+         << " written." << endl;
+}
+
+/** Parses channel width in bytes, returns half-words. */
+unsigned parseWidth(const char* arg) {
+    int bytes = atoi(arg);
+    if (bytes != 2 && bytes != 4)
+        throw GenError("Channel width must be 2 or 4 bytes");
+    return bytes / 2;
+}
+
+int main(int argc, char* argv[]) {
+    static struct option long_options[] = {
+        {"n1",         required_argument, 0, 'a'},
+        {"n2",         required_argument, 0, 'b'},
+        {"size1",      required_argument, 0, 'c'},
+        {"size2",      required_argument, 0, 'd'},
+        {"width1",     required_argument, 0, 'e'},
+        {"width2",     required_argument, 0, 'f'},
+        {"counts",     required_argument, 0, 'g'},
+        {"events",     required_argument, 0, 'j'},
+        {"peaks",      required_argument, 0, 'p'},
+        {"background", required_argument, 0, 'k'},
+        {"sigma",      required_argument, 0, 'm'},
+        {"slope",      required_argument, 0, 'n'},
+        {"seed",       required_argument, 0, 's'},
+        {"help",       no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    GenOptions opt;
+    try {
+        int c;
+        while ((c = getopt_long(argc, argv, "s:h", long_options, 0)) != -1) {
+            switch (c) {
+                case 'a': opt.n1 = atoi(optarg); break;
+                case 'b': opt.n2 = atoi(optarg); break;
+                case 'c': opt.size1 = atoi(optarg); break;
+                case 'd': {
+                    string arg(optarg);
+                    size_t coma = arg.find(',');
+                    opt.sizeX = atoi(arg.substr(0, coma).c_str());
+                    opt.sizeY = (coma == string::npos) ? opt.sizeX :
+                                atoi(arg.substr(coma + 1).c_str());
+                    break;
+                }
+                case 'e': opt.width1 = parseWidth(optarg); break;
+                case 'f': opt.width2 = parseWidth(optarg); break;
+                case 'g': opt.counts = atof(optarg); break;
+                case 'j': opt.events = atof(optarg); break;
+                case 'p': opt.peaks = atoi(optarg); break;
+                case 'k': opt.background = atof(optarg); break;
+                case 'm': opt.sigma = atof(optarg); break;
+                case 'n': opt.slope = atof(optarg); break;
+                case 's': opt.seed = strtoul(optarg, 0, 10); break;
+                case 'h': help(argv[0]); return 0;
+                default: help(argv[0]); return 1;
+            }
+        }
+        if (optind != argc - 1) {
+            help(argv[0]);
+            return 1;
+        }
+
+        unsigned sizes[] = {opt.size1, opt.sizeX, opt.sizeY};
+        for (unsigned size : sizes)
+            if (size < 1 || size > SHRT_MAX)
+                throw GenError("Size must be from 1 to 32767 channels");
+        if (opt.background < 0 || opt.background > 1)
+            throw GenError("Background fraction must be from 0 to 1");
+        if (opt.sigma <= 0 || opt.slope <= 0)
+            throw GenError("Sigma and slope must be positive");
+
+        // Offsets in drr are ints in half-words
+        double halfWords = double(opt.n1) * opt.size1 * opt.width1 +
+                           double(opt.n2) * opt.sizeX * opt.sizeY *
+                           opt.width2;
+        if (halfWords > INT_MAX)
+            throw GenError("His file would be over the 4 GB limit");
+
+        string his(argv[optind]);
+        string baseName = his.substr(0, his.find_last_of("."));
+        string input = baseName + ".inp";
+        ofstream def(input.c_str());
+        def << "# id halfwords x y title" << endl;
+        for (unsigned i = 0; i < opt.n1; ++i)
+            def << i + 1 << " " << opt.width1 << " " << opt.size1
+                << " 0 hisgen 1D seed " << opt.seed << endl;
+        for (unsigned i = 0; i < opt.n2; ++i)
+            def << opt.n1 + i + 1 << " " << opt.width2 << " " << opt.sizeX
+                << " " << opt.sizeY << " hisgen 2D seed " << opt.seed
+                << endl;
+        def.close();
+        if (!def)
+            throw IOError("Could not write " + input);
+
+        HisDrr hisDrr(baseName + ".drr", his, input);
+        remove(input.c_str());
+
+        vector<unsigned> data;
+        for (unsigned i = 0; i < opt.n1 + opt.n2; ++i) {
+            int id = i + 1;
+            unsigned width;
+            if (i < opt.n1) {
+                fill1D(opt, id, data);
+                width = opt.width1;
+            } else {
+                fill2D(opt, id, data);
+                width = opt.width2;
+            }
+            if (width == 1) {
+                vector<unsigned short> shortData(data.begin(), data.end());
+                hisDrr.setValue(id, shortData);
+            } else {
+                hisDrr.setValue(id, data);
+            }
+        }
+
+        cout << "# Created " << his << ": " << opt.n1 << " 1D and "
+             << opt.n2 << " 2D histograms, " << halfWords * 2 / 1.0e6
+             << " MB" << endl;
+    } catch (GenError &err) {
+        cout << "Error: " << err.show() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -10,9 +10,19 @@
 #include <stdio.h>
 #include <string.h>
 #include <string>
+#include <vector>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <glob.h>
 #include "HisDrr.h"
 #include "HisDrrHisto.h"
+#include "Server.h"
+#include "TextWriter.h"
 #include "Exceptions.h"
 
 using namespace std;
@@ -21,11 +31,24 @@ static struct option long_options[] = {
     {"id",    required_argument, 0, 'i'},
     {"gx",    required_argument, 0, 'x'},
     {"gy",    required_argument, 0, 'y'},
+    {"gz",    required_argument, 0, 'Z'},
+    {"gw",    required_argument, 0, 'W'},
+    {"proj",  required_argument, 0, 'P'},
+    {"gate-file", required_argument, 0, 'G'},
     {"bg",    required_argument, 0, 'b'},
     {"sbg",   required_argument, 0, 's'},
     {"bin",   required_argument, 0, 'B'},
     {"every", required_argument, 0, 'e'},
     {"zero",  no_argument, 0,       'z'},
+    {"stats", no_argument, 0,       'S'},
+    {"format", required_argument, 0, 'F'},
+    {"threads", required_argument, 0, 'T'},
+    {"batch", required_argument, 0, 'A'},
+    {"serve", required_argument, 0, 'R'},
+    {"output", required_argument, 0, 'O'},
+    {"max-reads", required_argument, 0, 'M'},
+    {"index", no_argument, 0,       'N'},
+    {"autocrop", no_argument, 0,    'C'},
     {"info",  no_argument, 0,       'I'},
     {"list",  no_argument, 0,       'l'},
     {"List",  no_argument, 0,       'L'},
@@ -88,7 +111,7 @@ void helpItem(const string& title, const string& abbrev, const string& desc){
 
 void help() {
     cout << "USAGE:" << endl;
-    cout << "\treadhis [options] file.his " << endl;
+    cout << "\treadhis [options] file.his [file2.his ...]" << endl;
     cout << endl;
     cout << "DESCRIPTION:" << endl;
     cout << "\tProgram reads his file using binary description from drr file." << endl;
@@ -96,6 +119,8 @@ void help() {
     cout << "\tand with the same base name (e.g. t1.his and t1.drr)." << endl;
     cout << "\tResult is send to standard output, use redirection " << endl;
     cout << "\tin case you want to save it to file." << endl;
+    cout << "\tMany files (or wildcards, e.g. 'run*.his') may be given," << endl;
+    cout << "\tthey are processed in parallel (see --threads, --output)." << endl;
     cout << endl;
 
     cout << "OPTIONS:" << endl;
@@ -111,6 +136,9 @@ void help() {
  format: <BR> <BR> #Comment line <BR> x0 y0 <BR> x1 y1 <BR> (...) <BR> <BR>\
  at least 3 points are required. <BR> If filename,id syntax is used,\
  the file must be a BAN (damm) file, and id is a damm banana id to be used.\
+ Several bananas may be given as filename,id1:id2:... or filename,all\
+ (all bananas of the file), they are projected in a single pass over\
+ the matrix and written one after another, separated by two empty lines.\
  For the purpose of polygon gates, the edges of polygon (including vertices)\
  are assumed to be outside of the polygon.\
  ");
@@ -121,6 +149,27 @@ void help() {
  (gate on Y).\
  If both gx and gy are used the output would be 2D crop of histogram instead of\
  projection.\
+ ");
+
+    helpItem("\tOption:\t--gz AND z0,z1",
+             "",
+             "For 3D and 4D histograms only. Gate on Z axis from\
+ channel z0 to z1 (including both). For histograms of more then 2\
+ dimensions --gx and --gy are also gates on X and Y axes (no polygons).\
+ Axes without gate are taken in full range. The histogram is projected\
+ on the first axis without gate, unless --proj is used.\
+ ");
+
+    helpItem("\tOption:\t--gw AND w0,w1",
+             "",
+             "For 4D histograms only. As above, gate on W axis.\
+ ");
+
+    helpItem("\tOption:\t--proj AND axes",
+             "",
+             "For 3D and 4D histograms only. Selects one (e.g. z) or two\
+ (e.g. xy) of x, y, z, w axes the gated histogram is projected on.\
+ Projection on two axes gives 2D histogram output.\
  ");
 
     helpItem("\tOption:\t--bg AND x0,x1",
@@ -135,6 +184,18 @@ void help() {
              "For 2D histograms only, only with --gx or --gy.\
  Same as above exept that gate is split into two parts x0 to x1 and\
  x2 to x3.\
+ ");
+
+    helpItem("\tOption:\t--gate-file AND filename",
+             "",
+             "For 2D histograms only. Makes many gated projections from\
+ the matrix loaded once. Each line of the file holds axis (x for gate on X\
+ as --gx, y for gate on Y as --gy), gate limits and optionally limits of\
+ one or two background windows, e.g.: <BR> <BR> # axis gate background\
+ <BR> x 266 269 272 275 <BR> y 100 150 90 95 160 165 <BR> <BR> Text after\
+ # is a comment. Gates are calculated in parallel and written one after\
+ another, separated by two empty lines (use gnuplot 'index' to select).\
+ Options --gx, --gy, --bg and --sbg are ignored.\
  ");
 
     helpItem("\tOption:\t--bin AND (bx OR bx,by)",
@@ -157,6 +218,88 @@ void help() {
               with -z is no longer suitable for gnuplot pm3d map plotting.\
  ");
 
+    helpItem("\tOption:\t--stats",
+             "",
+             "Instead of bins prints statistics of the histogram (or of\
+ the result of gates, binning etc.): sum of counts, number of non-empty\
+ bins, min and max number of counts in a bin, mean (centroid), variance,\
+ FWHM estimate (of a single gaussian peak) and the range of non-empty\
+ bins (low edge of first, high edge of last). For 2D output these are\
+ given for X and Y axis.\
+ ");
+
+    helpItem("\tOption:\t--format AND (text OR raw OR gnuplot-matrix)",
+             "",
+             "Output format of 1D and 2D histograms, projections and\
+ gates. Default is text. Raw is binary: 'RHIS', dimension, number of X\
+ and Y bins (uint32), X and Y ranges (double), then counts (int64, X\
+ running fastest), all little-endian. Gnuplot-matrix is the gnuplot\
+ 'binary matrix' of float32 (plot 'file' binary matrix with image).\
+ Gates with background subtracted carry uncertainties: raw 1D output has\
+ then 2 Y bins, the second row holding variances of counts,\
+ gnuplot-matrix a second row (y = 1) holding dN. For binary formats comments and messages go to the standard error,\
+ --every and --zero are ignored. Multiple gates are written one after\
+ another.\
+ ");
+
+    helpItem("\tOption:\t--threads AND n",
+             "",
+             "Number of worker threads used for --gate-file, 2D text\
+ output and many his files. Default (0) is the number of cores.\
+ ");
+
+    helpItem("\tOption:\t--batch AND (filename OR -)",
+             "",
+             "Runs many commands on the histogram file opened once. Each\
+ line of the file (or of the standard input if - is given) holds options\
+ as on the command line, e.g.: <BR> <BR> -i 1734 --gx 266,269 > gate.txt\
+ <BR> <BR> '> file' sends the output of the line to the file (standard\
+ output is used otherwise). The histogram file name may be omitted.\
+ Empty lines and lines starting with # are skipped. Other options of\
+ the command line are ignored.\
+ ");
+
+    helpItem("\tOption:\t--output AND pattern",
+             "",
+             "Output of each his file goes to file named after the pattern,\
+ %n is replaced by the name of the his file without directory and\
+ extension, e.g. --output out/%n_1200.txt. Without it outputs of many\
+ files are written to the standard output one after another.\
+ ");
+
+    helpItem("\tOption:\t--max-reads AND n",
+             "",
+             "Maximal number of histograms read from disk at the same time\
+ when many files are processed (default 4, 0 for no limit).\
+ ");
+
+    helpItem("\tOption:\t--serve AND socket",
+             "",
+             "Runs as a server on the Unix domain socket. Each request is\
+ a line of options as on the command line, including the histogram file\
+ name. Files are opened on the first request and kept open. The\
+ response is a line 'OK n' (or 'ERROR n') followed by n bytes of output\
+ (data only for binary formats). Request 'stats' gives latency\
+ statistics, 'quit' closes the connection, 'shutdown' stops the server.\
+ Requests are served by --threads workers.\
+ ");
+
+    helpItem("\tOption:\t--index",
+             "",
+             "Does not require histogram id. Builds index file (e.g.\
+ run01.hidx next to run01.his) with sum, maximum, number of non-zero\
+ channels, box of non-zero channels, checksum and statistics of each\
+ histogram and lists it. The index is rebuilt only if his or drr file has\
+ changed. When valid it is used by --List, --stats (of whole histogram)\
+ and --autocrop instead of reading the data.\
+ ");
+
+    helpItem("\tOption:\t--autocrop",
+             "",
+             "For 2D histograms without gates, output is cropped to the\
+ box of non-empty bins.\
+ ");
+
     helpItem("\tOption:\t--info",
              "-I",
              "Displays detailed information on histogram.\
@@ -172,9 +315,9 @@ void help() {
     helpItem("\tOption:\t--List",
              "-L",
              "Does not require histogram id. As above except that\
-             marks empty/non-empty histograms with 'Y/N'.\
-             Warning! It is a slow operation to test emptiness of a large\
-             histograms!\
+             marks empty/non-empty histograms with 'Y/N' and shows\
+             number of non-zero channels and sum of each histogram.\
+             All data is read, histograms are shared by --threads.\
  ");
 
     helpItem("\tOption:\t--help",
@@ -183,11 +326,54 @@ void help() {
  ");
 }
      
-int main (int argc, char* argv[]) {
+/** Returns true if binary output format (--format other then text) is
+ * selected in argv. It is checked before options are parsed, as
+ * the comments printed while parsing must not go with the data. */
+bool binaryFormat (int argc, char* argv[]) {
+    bool binary = false;
+    for (int i = 1; i < argc; ++i) {
+        string arg(argv[i]);
+        string format;
+        if (arg == "--format" && i + 1 < argc)
+            format = argv[i + 1];
+        else if (arg.compare(0, 9, "--format=") == 0)
+            format = arg.substr(9);
+        if (!format.empty())
+            binary = (format != "text");
+    }
+    return binary;
+}
+
+/** Adds to fileNames files matching pattern (shell wildcards), or the
+ * name itself if it holds no wildcards. Returns false if nothing
+ * matches. */
+bool expandFileName (const string& pattern, vector<string>& fileNames) {
+    if (pattern.find_first_of("*?[") == string::npos) {
+        fileNames.push_back(pattern);
+        return true;
+    }
+    glob_t matches;
+    if (glob(pattern.c_str(), 0, 0, &matches) != 0) {
+        globfree(&matches);
+        return false;
+    }
+    for (size_t i = 0; i < matches.gl_pathc; ++i)
+        fileNames.push_back(matches.gl_pathv[i]);
+    globfree(&matches);
+    return true;
+}
 
+/** Parses options given in argv into options, names of the his files
+ * (wildcards are expanded) go to fileNames (unchanged if not given).
+ * On error a message is printed and false is returned. Help (-h) is
+ * only marked in options, it is up to the caller to print it. May be
+ * called many times (--batch). */
+bool parseOptions (int argc, char* argv[], Options* options,
+                   vector<string>& fileNames) {
     int flag = 0;
 
-    Options* options = new Options();
+    // Full reinitialization of GNU getopt
+    optind = 0;
 
     while (true) {
         /* getopt_long stores the option index here. */
@@ -207,7 +393,7 @@ int main (int argc, char* argv[]) {
                 if ( !options->setHisId(hisId) ) {
                     cout << "Wrong or missing histogram id " << endl;
                     cout << "Run readhis --help for more information" << endl;
-                    exit(1);
+                    return false;
                 }
                 cout << "# Histogram: " << options->getHisId() << endl;
                 break;
@@ -235,12 +421,12 @@ int main (int argc, char* argv[]) {
                         cout << "Error: option --gx requires two "  
                             << "arguments separated by coma e.g 10,20 " << endl;
                         cout << "Run readhis --help for more information" << endl;
-                        exit(1);
+                        return false;
                     }
                     if ( !(options->setGx(a[0], a[1])) ) {
                         cout << "Error: wrong arguments for --gx option" << endl;
                         cout << "Run readhis --help for more information" << endl;
-                        exit(1);
+                        return false;
                     }
                     cout << "# Gate on X from " << a[0] << " to " << a[1] << endl;
                 }
@@ -270,12 +456,12 @@ int main (int argc, char* argv[]) {
                         cout << "Error: option --gy requires two "  
                             << "arguments separated by coma e.g 10,20 " << endl;
                         cout << "Run readhis --help for more information" << endl;
-                        exit(1);
+                        return false;
                     }
                     if ( !(options->setGy(a[0], a[1])) ) {
                         cout << "Error: wrong arguments for --gy option" << endl;
                         cout << "Run readhis --help for more information" << endl;
-                        exit(1);
+                        return false;
                     }
                     cout << "# Gate on Y from " << a[0] << " to " << a[1] << endl;
                 }
@@ -293,12 +479,12 @@ int main (int argc, char* argv[]) {
                         cout << "Error: option --bg requires two "  
                             << "arguments separated by coma e.g 10,20 " << endl;
                         cout << "Run readhis --help for more information" << endl;
-                        exit(1);
+                        return false;
                     }
                     if ( !(options->setBg(a[0], a[1])) ) {
                         cout << "Error: wrong arguments for --bg option" << endl;
                         cout << "Run readhis --help for more information" << endl;
-                        exit(1);
+                        return false;
                     }
                     cout << "# Background taken from " << a[0] << " to " << a[1] << endl;
                 break;
@@ -314,18 +500,77 @@ int main (int argc, char* argv[]) {
                     cout << "Error: option --sbg requires four "  
                          << "arguments separated by coma e.g 10,20,30,40 " << endl;
                     cout << "Run readhis --help for more information" << endl;
-                    exit(1);
+                    return false;
                 }
                 if ( !(options->setSBg(a[0], a[1], a[2], a[3])) ) {
                     cout << "Error: wrong arguments for --sbg option" << endl;
                     cout << "Run readhis --help for more information" << endl;
-                    exit(1);
+                    return false;
                 }
                 cout << "# Background taken from " << a[0] << " to " << a[1] 
                         << " and " << a[2] << " to " << a[3] << endl;
                 break;
             }
 
+            case 'Z': {
+                int a[2] = {0};
+                Status status = parseMultiArgs(optarg, a, 2);
+                if (status == warning) {
+                    cout << "Warning: option --gz with more then two arguments" << endl;
+                }
+                if (status == error) {
+                    cout << "Error: option --gz requires two "  
+                        << "arguments separated by coma e.g 10,20 " << endl;
+                    cout << "Run readhis --help for more information" << endl;
+                    return false;
+                }
+                if ( !(options->setGz(a[0], a[1])) ) {
+                    cout << "Error: wrong arguments for --gz option" << endl;
+                    cout << "Run readhis --help for more information" << endl;
+                    return false;
+                }
+                cout << "# Gate on Z from " << a[0] << " to " << a[1] << endl;
+                break;
+            }
+
+            case 'W': {
+                int a[2] = {0};
+                Status status = parseMultiArgs(optarg, a, 2);
+                if (status == warning) {
+                    cout << "Warning: option --gw with more then two arguments" << endl;
+                }
+                if (status == error) {
+                    cout << "Error: option --gw requires two "  
+                        << "arguments separated by coma e.g 10,20 " << endl;
+                    cout << "Run readhis --help for more information" << endl;
+                    return false;
+                }
+                if ( !(options->setGw(a[0], a[1])) ) {
+                    cout << "Error: wrong arguments for --gw option" << endl;
+                    cout << "Run readhis --help for more information" << endl;
+                    return false;
+                }
+                cout << "# Gate on W from " << a[0] << " to " << a[1] << endl;
+                break;
+            }
+
+            case 'P': {
+                if ( !(options->setProjection(optarg)) ) {
+                    cout << "Error: wrong arguments for --proj option, "
+                         << "use one or two of x, y, z, w e.g. xz" << endl;
+                    cout << "Run readhis --help for more information" << endl;
+                    return false;
+                }
+                cout << "# Projection on " << optarg << endl;
+                break;
+            }
+
+            case 'G': {
+                options->setGateFile(optarg);
+                cout << "# Gate file: " << optarg << endl;
+                break;
+            }
+
             case 'B': {
                 int b[2] = {0};
                 Status status = parseMultiArgs(optarg, b, 1, 1);
@@ -336,12 +581,12 @@ int main (int argc, char* argv[]) {
                     cout << "Error: option --bin requires one or two "  
                          << "arguments separated by coma e.g 2,4 " << endl;
                     cout << "Run readhis --help for more information" << endl;
-                    exit(1);
+                    return false;
                 }
                 if ( !(options->setBin(b[0], b[1])) ) {
                     cout << "Error: wrong arguments for --bin option" << endl;
                     cout << "Run readhis --help for more information" << endl;
-                    exit(1);
+                    return false;
                 }
                 cout << "# Binning, X: " << b[0] << ", Y: " << b[1] << endl;
                 break;
@@ -357,13 +602,13 @@ int main (int argc, char* argv[]) {
                     cout << "Error: option --every requires one or two "  
                          << "arguments separated by coma e.g 2,4 " << endl;
                     cout << "Run readhis --help for more information" << endl;
-                    exit(1);
+                    return false;
                 }
                 cout << "#-> " << e[0] << " " << e[1] << endl;
                 if ( !(options->setEvery(e[0], e[1])) ) {
                     cout << "Error: wrong arguments for --every option" << endl;
                     cout << "Run readhis --help for more information" << endl;
-                    exit(1);
+                    return false;
                 }
                 cout << "# Every, X: " << e[0] << ", Y: " << e[1] << endl;
                 break;
@@ -379,6 +624,72 @@ int main (int argc, char* argv[]) {
                 break;
             }
 
+            case 'S': {
+                options->setStats(true);
+                break;
+            }
+
+            case 'F': {
+                if ( !(options->setFormat(optarg)) ) {
+                    cout << "Error: wrong arguments for --format option, "
+                         << "use text, raw or gnuplot-matrix" << endl;
+                    cout << "Run readhis --help for more information" << endl;
+                    return false;
+                }
+                break;
+            }
+
+            case 'T': {
+                int n = atoi(optarg);
+                if (n < 0) {
+                    cout << "Error: wrong arguments for --threads option" << endl;
+                    cout << "Run readhis --help for more information" << endl;
+                    return false;
+                }
+                options->setThreads(n);
+                break;
+            }
+
+            case 'A': {
+                options->setBatch(optarg);
+                cout << "# Batch: " << optarg << endl;
+                break;
+            }
+
+            case 'R': {
+                options->setServe(optarg);
+                cout << "# Serve: " << optarg << endl;
+                break;
+            }
+
+            case 'O': {
+                options->setOutput(optarg);
+                cout << "# Output: " << optarg << endl;
+                break;
+            }
+
+            case 'M': {
+                int n = atoi(optarg);
+                if (n < 0) {
+                    cout << "Error: wrong arguments for --max-reads option" 
+                         << endl;
+                    cout << "Run readhis --help for more information" << endl;
+                    return false;
+                }
+                options->setMaxReads(n);
+                break;
+            }
+
+            case 'N': {
+                options->setIndexMode(true);
+                break;
+            }
+
+            case 'C': {
+                options->setAutoCrop(true);
+                break;
+            }
+
             case 'I': {
                 options->setInfoMode(true);
                 break;
@@ -394,8 +705,7 @@ int main (int argc, char* argv[]) {
                 break;
 
             case 'h':
-                help();
-                exit(0);
+                options->setHelp(true);
                 break;
                 
             case '?':
@@ -404,20 +714,305 @@ int main (int argc, char* argv[]) {
 
             default:
                 help();
-                exit(1);
+                return false;
             }
         }
 
-    string fileName;
+    if (options->getHelp())
+        return true;
+
     if (optind < argc) {
-        fileName = argv[optind];
-        cout << "# File: " << fileName << endl;
-    } else {
+        vector<string> names;
+        for (int i = optind; i < argc; ++i) {
+            if (!expandFileName(argv[i], names)) {
+                cout << "Error: no files match " << argv[i] << endl;
+                return false;
+            }
+        }
+        fileNames.swap(names);
+        if (fileNames.size() == 1)
+            cout << "# File: " << fileNames[0] << endl;
+        else
+            cout << "# Files: " << fileNames.size() << endl;
+    }
+    return true;
+}
+
+/** Splits batch command line into arguments (separated by white 
+ * spaces), '> file' (or '>file') sets the output file. */
+void splitBatchLine (const string& line, vector<string>& args,
+                     string& output) {
+    istringstream iss(line);
+    string token;
+    while (iss >> token) {
+        if (token == ">") {
+            iss >> output;
+        } else if (token[0] == '>') {
+            output = token.substr(1);
+        } else {
+            args.push_back(token);
+        }
+    }
+}
+
+/** Parses options given as list of arguments (args[0] is the program
+ * name), see parseOptions. */
+bool parseArgs (const vector<string>& args, Options* options,
+                vector<string>& fileNames) {
+    // getopt and strtok require modifiable arguments
+    vector< vector<char> > text(args.size());
+    vector<char*> argv;
+    for (unsigned i = 0; i < args.size(); ++i) {
+        text[i].assign(args[i].begin(), args[i].end());
+        text[i].push_back('\0');
+        argv.push_back(&text[i][0]);
+    }
+    argv.push_back(0);
+    return parseOptions(args.size(), &argv[0], options, fileNames);
+}
+
+/** Parses server request (see Server), which may name one file only. */
+bool parseRequest (const vector<string>& args, Options& options,
+                   string& fileName) {
+    vector<string> fileNames;
+    if (!parseArgs(args, &options, fileNames))
+        return false;
+    if (options.getHelp()) {
+        cout << "Error: help is not available in server mode" << endl;
+        return false;
+    }
+    if (fileNames.size() > 1) {
+        cout << "Error: server requests take one histogram file" << endl;
+        return false;
+    }
+    if (!fileNames.empty())
+        fileName = fileNames[0];
+    return true;
+}
+
+/** Runs commands of batch file (or standard input if batchFile is '-')
+ * on already opened his file. Each line holds options as on the
+ * command line, the histogram file name may be omitted. Empty lines and
+ * lines starting with '#' are skipped. */
+void runBatch (HisDrrHisto& hisDrr, const string& batchFile,
+               const string& fileName, streambuf* stdoutBuffer) {
+    ifstream batchStream;
+    istream* in = &cin;
+    if (batchFile != "-") {
+        batchStream.open(batchFile.c_str());
+        if (!batchStream.good())
+            throw IOError("Could not open batch file " + batchFile);
+        in = &batchStream;
+    }
+
+    streambuf* coutBuffer = cout.rdbuf();
+    string line;
+    unsigned lineNumber = 0;
+    while (getline(*in, line)) {
+        ++lineNumber;
+        size_t first = line.find_first_not_of(" \t");
+        if (first == string::npos || line[first] == '#')
+            continue;
+
+        vector<string> args;
+        string output;
+        args.push_back("readhis");
+        splitBatchLine(line, args, output);
+        vector<char*> argv;
+        for (unsigned i = 0; i < args.size(); ++i)
+            argv.push_back(const_cast<char*>(args[i].c_str()));
+
+        ofstream outFile;
+        if (!output.empty()) {
+            outFile.open(output.c_str(), ios::out | ios::binary);
+            if (!outFile.good()) {
+                cerr << "Batch line " << lineNumber 
+                     << ": could not open output file " << output << endl;
+                continue;
+            }
+        }
+        ostream data(output.empty() ? stdoutBuffer : outFile.rdbuf());
+        if (binaryFormat(argv.size(), &argv[0]))
+            cout.rdbuf(cerr.rdbuf());
+        else
+            cout.rdbuf(data.rdbuf());
+
+        Options lineOptions;
+        vector<string> lineFiles(1, fileName);
+        if (parseArgs(args, &lineOptions, lineFiles)) {
+            if (lineOptions.getHelp()) {
+                cout << "Error: help is not available in batch mode" << endl;
+            } else if (lineFiles.size() != 1 || lineFiles[0] != fileName) {
+                cout << "Error: batch commands must use file " 
+                     << fileName << endl;
+            } else {
+                hisDrr.setOptions(&lineOptions);
+                hisDrr.setBinaryOutput(&data);
+                hisDrr.process();
+            }
+        }
+        cout.flush();
+        cout.rdbuf(coutBuffer);
+    }
+}
+
+/** Returns output file name for his file: %n in pattern is replaced by
+ * the name of his file without directory and extension. */
+string outputName (const string& pattern, const string& fileName) {
+    size_t slash = fileName.find_last_of("/");
+    string name = (slash == string::npos) ? fileName 
+                                          : fileName.substr(slash + 1);
+    name = name.substr(0, name.find_last_of("."));
+
+    string output = pattern;
+    size_t pos;
+    while ((pos = output.find("%n")) != string::npos)
+        output.replace(pos, 2, name);
+    return output;
+}
+
+/** Processes one of many his files, comments and messages go to text,
+ * binary data to data. */
+void processFile (const string& fileName, const Options* options,
+                  ostream& text, ostream& data) {
+    text << "# File: " << fileName << endl;
+    unsigned int dot = fileName.find_last_of(".");
+    string baseName = fileName.substr(0, dot);
+    try {
+        HisDrrHisto h(baseName + ".drr", baseName + ".his", options);
+        h.setOutput(&text);
+        h.setBinaryOutput(&data);
+        h.process();
+    } catch (GenError &err) {
+        text << "Error: " << err.show() << endl;
+    }
+}
+
+/** Processes many his files in parallel, each file by one worker
+ * thread. Output of each file goes to file named after --output pattern,
+ * or to stdoutBuffer in the order of files, as it is produced (see
+ * TextWriter::streamParallel). In binary formats comments go to
+ * standard error. */
+void runFiles (const vector<string>& fileNames, const Options* options,
+               streambuf* stdoutBuffer) {
+    const unsigned nFiles = fileNames.size();
+    const bool binary = (options->getFormat() != formatText);
+    const string pattern = options->getOutput();
+
+    if (nFiles > 1 && !pattern.empty() && 
+        pattern.find("%n") == string::npos)
+        throw GenError("Output pattern must hold %n for many files");
+
+    unsigned nThreads = options->getThreads();
+    if (nThreads == 0)
+        nThreads = thread::hardware_concurrency();
+    nThreads = max(1u, min(nThreads, nFiles));
+
+    // Files are processed one per thread, nested threads would only
+    // compete with each other
+    Options fileOptions(*options);
+    if (nThreads > 1)
+        fileOptions.setThreads(1);
+
+    mutex messageMutex;
+    auto process = [&] (unsigned i, ostream& out) {
+        stringstream comments;
+        if (binary) {
+            processFile(fileNames[i], &fileOptions, comments, out);
+            lock_guard<mutex> lock(messageMutex);
+            cerr << comments.str();
+        } else
+            processFile(fileNames[i], &fileOptions, out, out);
+    };
+
+    if (pattern.empty()) {
+        ostream out(stdoutBuffer);
+        TextWriter::streamParallel(out, nFiles, nThreads,
+            [&] (unsigned i, ostream& text) { process(i, text); });
+        out.flush();
+        return;
+    }
+
+    // Files are taken by the first free thread
+    atomic<unsigned> next(0);
+    auto worker = [&] () {
+        unsigned i;
+        while ((i = next++) < nFiles) {
+            string output = outputName(pattern, fileNames[i]);
+            ofstream out(output.c_str(), ios::out | ios::binary);
+            if (!out.good()) {
+                lock_guard<mutex> lock(messageMutex);
+                cerr << "Error: could not open output file " << output
+                     << endl;
+                continue;
+            }
+            process(i, out);
+        }
+    };
+    vector<thread> threads;
+    for (unsigned t = 0; t < nThreads; ++t)
+        threads.push_back(thread(worker));
+    for (unsigned t = 0; t < threads.size(); ++t)
+        threads[t].join();
+}
+
+int main (int argc, char* argv[]) {
+    Options* options = new Options();
+
+    // Standard output takes only the data in binary formats, comments
+    // printed while options are parsed go to standard error then
+    streambuf* coutBuffer = cout.rdbuf();
+    ostream data(coutBuffer);
+    if (binaryFormat(argc, argv))
+        cout.rdbuf(cerr.rdbuf());
+
+    vector<string> fileNames;
+    if (!parseOptions(argc, argv, options, fileNames))
+        exit(1);
+    if (options->getHelp()) {
+        cout.rdbuf(coutBuffer);
+        help();
+        exit(0);
+    }
+    HisDrr::setMaxReads(options->getMaxReads());
+
+    if (!options->getServe().empty()) {
+        try {
+            Server server(options->getServe(),
+                          options->getThreads(),
+                          parseRequest);
+            server.run();
+        } catch (GenError &err) {
+            cout << "Error: " << err.show() << endl;
+            exit(1);
+        }
+        delete options;
+        exit(0);
+    }
+
+    if (fileNames.empty()) {
         cout << "Error: missing histogram file name" << endl;
         cout << "Run readhis --help for more information" << endl;
         exit(1);
     }
-    
+
+    if (fileNames.size() > 1 || !options->getOutput().empty()) {
+        if (!options->getBatch().empty()) {
+            cout << "Error: --batch takes one histogram file" << endl;
+            exit(1);
+        }
+        try {
+            runFiles(fileNames, options, coutBuffer);
+        } catch (GenError &err) {
+            cout << "Error: " << err.show() << endl;
+        }
+        cout.rdbuf(coutBuffer);
+        delete options;
+        exit(0);
+    }
+
+    const string fileName = fileNames[0];
+
     unsigned int dot = fileName.find_last_of(".");
     string baseName = fileName.substr(0,dot);
     const string drr = baseName + ".drr";
@@ -425,11 +1020,16 @@ int main (int argc, char* argv[]) {
 
     try {
         HisDrrHisto h(drr, his, options);
-        h.process();
+        h.setBinaryOutput(&data);
+        if (!options->getBatch().empty())
+            runBatch(h, options->getBatch(), fileName, coutBuffer);
+        else
+            h.process();
     } catch (GenError &err) {
         cout << "Error: " << err.show() << endl;
     }
   
+    cout.rdbuf(coutBuffer);
     delete options;
     exit(0);
 }
@@ -0,0 +1,205 @@
+/*
+ * Copyright Krzysztof Miernik 2012
+ * k.a.miernik@gmail.com
+ *
+ * Distributed under GNU General Public Licence v3
+ */
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "readhis_c.h"
+#include "HisDrr.h"
+#include "Exceptions.h"
+
+using namespace std;
+
+struct readhis_file {
+    /** Opened files. */
+    HisDrr* hisDrr;
+
+    /** Name of his file (mapped on first readhis_map). */
+    string his;
+
+    /** Mapped his file (or 0) and its length. */
+    void* map;
+    size_t mapLength;
+};
+
+namespace {
+    /** Message of the last error, per thread. */
+    thread_local string lastError;
+
+    /** Runs f, returns -1 (and keeps the message) if it throws. */
+    template <typename F>
+    int guard(F f) {
+        try {
+            return f();
+        } catch (GenError &err) {
+            lastError = err.show();
+        } catch (std::exception &err) {
+            lastError = err.what();
+        }
+        return -1;
+    }
+
+    /** Returns description of histogram id, throws GenError if there
+     * is none. */
+    DrrHisRecordExtended findInfo(readhis_file* file, int id) {
+        if (file == 0)
+            throw GenError("readhis: null file handle");
+        return file->hisDrr->getHistogramInfo(id);
+    }
+
+    /** Returns total number of channels. */
+    uint64_t channels(const DrrHisRecordExtended& h) {
+        uint64_t n = 1;
+        for (int d = 0; d < h.hisDim; ++d)
+            n *= h.scaled[d];
+        return n;
+    }
+
+    /** Returns new handle, takes ownership of hisDrr. */
+    readhis_file* newHandle(HisDrr* hisDrr, const string& his) {
+        readhis_file* file = new readhis_file();
+        file->hisDrr = hisDrr;
+        file->his = his;
+        file->map = 0;
+        file->mapLength = 0;
+        return file;
+    }
+}
+
+readhis_file* readhis_open(const char* his) {
+    readhis_file* file = 0;
+    guard([&] () {
+        string hisName(his);
+        string baseName = hisName.substr(0, hisName.find_last_of("."));
+        file = newHandle(new HisDrr(baseName + ".drr", hisName), hisName);
+        return 0;
+    });
+    return file;
+}
+
+readhis_file* readhis_create(const char* drr, const char* his,
+                             const char* input) {
+    readhis_file* file = 0;
+    guard([&] () {
+        file = newHandle(new HisDrr(drr, his, input), his);
+        return 0;
+    });
+    return file;
+}
+
+void readhis_close(readhis_file* file) {
+    if (file == 0)
+        return;
+    if (file->map != 0)
+        munmap(file->map, file->mapLength);
+    delete file->hisDrr;
+    delete file;
+}
+
+const char* readhis_error(void) {
+    return lastError.c_str();
+}
+
+int readhis_count(readhis_file* file) {
+    return readhis_list(file, 0, 0);
+}
+
+int readhis_list(readhis_file* file, int* ids, int n) {
+    return guard([&] () {
+        if (file == 0)
+            throw GenError("readhis: null file handle");
+        vector<int> list;
+        file->hisDrr->getHisList(list);
+        for (int i = 0; i < n && i < int(list.size()); ++i)
+            ids[i] = list[i];
+        return int(list.size());
+    });
+}
+
+int readhis_info_get(readhis_file* file, int id, readhis_info* info) {
+    return guard([&] () {
+        DrrHisRecordExtended h = findInfo(file, id);
+        memset(info, 0, sizeof(*info));
+        info->id = h.hisID;
+        info->dim = h.hisDim;
+        info->bytes = h.halfWords * 2;
+        for (int d = 0; d < 4; ++d) {
+            info->nbin[d] = (d < h.hisDim) ? h.scaled[d] : 1;
+            info->minc[d] = (d < h.hisDim) ? h.minc[d] : 0;
+            info->maxc[d] = (d < h.hisDim) ? h.maxc[d] : 0;
+        }
+        info->size = channels(h);
+        memcpy(info->title, h.title, sizeof(h.title));
+        info->title[sizeof(h.title)] = '\0';
+        return 0;
+    });
+}
+
+int readhis_read(readhis_file* file, int id, uint32_t* buffer, size_t n) {
+    return guard([&] () {
+        findInfo(file, id);
+        file->hisDrr->getHistogram(buffer, n, id);
+        return 0;
+    });
+}
+
+const void* readhis_map(readhis_file* file, int id) {
+    const void* data = 0;
+    guard([&] () {
+        DrrHisRecordExtended h = findInfo(file, id);
+        if (file->map == 0) {
+            int fd = open(file->his.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw IOError("readhis_map: could not open " + file->his);
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                close(fd);
+                throw IOError("readhis_map: could not map " + file->his);
+            }
+            void* map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (map == MAP_FAILED)
+                throw IOError("readhis_map: could not map " + file->his);
+            file->map = map;
+            file->mapLength = st.st_size;
+        }
+
+        size_t begin = size_t(h.offset) * 2;
+        size_t length = channels(h) * h.halfWords * 2;
+        if (begin + length > file->mapLength)
+            throw IOError("readhis_map: his file is too short");
+        data = static_cast<const char*>(file->map) + begin;
+        return 0;
+    });
+    return data;
+}
+
+int readhis_write(readhis_file* file, int id, const uint32_t* buffer,
+                  size_t n) {
+    return guard([&] () {
+        DrrHisRecordExtended h = findInfo(file, id);
+        if (n != channels(h))
+            throw GenError("readhis_write: wrong number of channels");
+        if (h.halfWords == 1) {
+            vector<unsigned short> data(n);
+            for (size_t i = 0; i < n; ++i) {
+                if (buffer[i] > 0xffff)
+                    throw GenError("readhis_write: value too large for 2 byte histogram");
+                data[i] = buffer[i];
+            }
+            file->hisDrr->setValue(id, data);
+        } else {
+            vector<unsigned> data(buffer, buffer + n);
+            file->hisDrr->setValue(id, data);
+        }
+        return 0;
+    });
+}